@@ -6,6 +6,7 @@
 
 #include "global_env.h"
 #include "object.h"
+#include "snapshot.h"
 #include "value.h"
 #include "vm.h"
 
@@ -151,14 +152,18 @@ CieValue cie_value_number(double value){
     return result;
 }
 
-CieVM* cie_vm_create(void){
+static CieVM* createVM(bool prelude){
     CieVM* vm = malloc(sizeof(*vm));
 
     if(vm == NULL){
         return NULL;
     }
 
-    initVM(vm, 0, NULL);
+    if(prelude){
+        initVM(vm, 0, NULL);
+    }else{
+        initBareVM(vm, 0, NULL);
+    }
 
     /*
      * A script embedded must not be allowed to terminate host process through os.exit().
@@ -170,6 +175,42 @@ CieVM* cie_vm_create(void){
     return vm;
 }
 
+CieVM* cie_vm_create(void){
+    return createVM(true);
+}
+
+CieVM* cie_vm_create_from_snapshot(const char* path){
+    if(path == NULL){
+        return NULL;
+    }
+
+    // the snapshot's globals include the prelude, no need to define it first
+    CieVM* vm = createVM(false);
+
+    if(vm == NULL){
+        return NULL;
+    }
+
+    if(!loadSnapshotFile(vm, path, callHostFunc)){
+        cie_vm_destroy(vm);
+        return NULL;
+    }
+
+    return vm;
+}
+
+CieStatus cie_vm_save_snapshot(CieVM* vm, const char* path){
+    if(vm == NULL || path == NULL){
+        return CIE_STATUS_INVALID_ARGUMENT;
+    }
+
+    if(!writeSnapshotFile(vm, path)){
+        return CIE_STATUS_UNSUPPORTED_TYPE;
+    }
+
+    return CIE_STATUS_OK;
+}
+
 void cie_vm_destroy(CieVM* vm){
     if(vm == NULL){
         return;
@@ -295,7 +336,7 @@ const char* cie_call_get_string(const CieCall* call, int index, size_t* length){
         *length = string->length;
     }
 
-    return string->chars;
+    return stringCString(string);
 }
 
 void cie_call_return_null(CieCall* call){
@@ -351,6 +392,23 @@ CieStatus cie_vm_register_native(CieVM* vm, const char* name, CieNativeFunc func
 
     ObjectString* key = copyString(vm, name, (int)strlen(name));
 
+    /*
+     * A VM restored from a snapshot keeps its host functions unlinked.
+     * Link them in place, so every reference the snapshot holds sees the callback.
+    */
+
+    Value existing;
+
+    if(globalGetName(&vm->globals, key, &existing) && IS_CFUNC(existing)){
+        ObjectCFunc* unlinked = AS_CFUNC_OBJECT(existing);
+
+        if(unlinked->func == callHostFunc && unlinked->hostFunc == NULL){
+            unlinked->hostFunc = function;
+            unlinked->userData = user_data;
+            return CIE_STATUS_OK;
+        }
+    }
+
     //Root the key while the function object and global table may allocate.
     push(vm, OBJECT_VAL(key));
 
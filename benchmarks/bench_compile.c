@@ -0,0 +1,151 @@
+/*
+ * Compile-throughput benchmark.
+ *
+ * Generates a synthetic script with many functions, nested closures,
+ * loops, locals, comments and long strings, then measures how fast the
+ * scanner alone tokenizes it and how fast compile() turns it into
+ * bytecode. Nothing is executed.
+ *
+ * Usage: bench_compile [functions] [iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm.h"
+#include "compiler.h"
+#include "scanner.h"
+#include "mem.h"
+
+static double nowMs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+// scan the whole source once, returning the token count
+static long scanAll(const char* source){
+    long count = 0;
+
+    initScanner(source);
+    for(;;){
+        Token token = scan();
+        count++;
+        if(token.type == TOKEN_EOF || token.type == TOKEN_ERROR){
+            return token.type == TOKEN_EOF ? count : -1;
+        }
+    }
+}
+
+static char* buildSource(int funcCnt, size_t* length){
+    static const char* tmpl =
+        "#{\n"
+        "    work%d adds a closure over its locals ten times and reports\n"
+        "    the total. The body is indented like hand-written code.\n"
+        "}#\n"
+        "func work%d(a, b) {\n"
+        "    # start from the sum of both arguments\n"
+        "    var total = a + b;\n"
+        "    var note = \"a fairly long string literal that the scanner walks over\";\n"
+        "    var items = [total, a, b];\n"
+        "    var add = func(z) {\n"
+        "        return total + z + items[0];\n"
+        "    };\n"
+        "    for (var k = 0; k < 10; k++) {\n"
+        "        total = total + add(k);\n"
+        "    }\n"
+        "    if (total > 3) {\n"
+        "        print \"work%d: ${total}\";\n"
+        "    } else {\n"
+        "        total = total - 1;\n"
+        "    }\n"
+        "    return total;\n"
+        "}\n";
+
+    size_t cap = (size_t)funcCnt * (strlen(tmpl) + 64) + 1;
+    char* source = malloc(cap);
+    if(source == NULL){
+        return NULL;
+    }
+
+    size_t len = 0;
+    for(int i = 0; i < funcCnt; i++){
+        len += (size_t)snprintf(source + len, cap - len, tmpl, i, i, i);
+    }
+
+    *length = len;
+    return source;
+}
+
+int main(int argc, char* argv[]){
+    int funcCnt = argc > 1 ? atoi(argv[1]) : 2000;
+    int iterations = argc > 2 ? atoi(argv[2]) : 20;
+
+    size_t length = 0;
+    char* source = buildSource(funcCnt, &length);
+    if(source == NULL){
+        fprintf(stderr, "Could not allocate benchmark source.\n");
+        return 1;
+    }
+
+    long tokens = 0;
+    double scanBest = -1;
+
+    for(int i = 0; i < iterations; i++){
+        double start = nowMs();
+        tokens = scanAll(source);
+        double elapsed = nowMs() - start;
+
+        if(tokens < 0){
+            fprintf(stderr, "Benchmark source failed to scan.\n");
+            free(source);
+            return 1;
+        }
+
+        if(scanBest < 0 || elapsed < scanBest){
+            scanBest = elapsed;
+        }
+    }
+
+    VM vm;
+    initVM(&vm, 0, NULL);
+    vm.eagerCompile = true;   // measure full compilation, not lazy stubs
+
+    double best = -1;
+    double total = 0;
+
+    for(int i = 0; i < iterations; i++){
+        double start = nowMs();
+        ObjectFunc* func = compile(&vm, source, "bench_compile");
+        double elapsed = nowMs() - start;
+
+        if(func == NULL){
+            fprintf(stderr, "Benchmark source failed to compile.\n");
+            freeVM(&vm);
+            free(source);
+            return 1;
+        }
+
+        total += elapsed;
+        if(best < 0 || elapsed < best){
+            best = elapsed;
+        }
+        collectGarbage(&vm);
+    }
+
+    double mb = (double)length / (1024.0 * 1024.0);
+
+    printf("source:     %zu bytes, %ld tokens, %d functions\n", length, tokens, funcCnt);
+    printf("iterations: %d\n", iterations);
+    printf("scan:       best %.3f ms, %.2f MB/s, %.2f Mtokens/s\n", scanBest,
+           mb / (scanBest / 1000.0), (double)tokens / (scanBest * 1000.0));
+    printf("compile:    best %.3f ms, avg %.3f ms\n", best, total / iterations);
+    printf("throughput: %.2f MB/s, %.2f Mtokens/s\n", mb / (best / 1000.0),
+           (double)tokens / (best * 1000.0));
+
+    freeVM(&vm);
+    free(source);
+    return 0;
+}
@@ -0,0 +1,199 @@
+/*
+ * Substring search benchmark.
+ *
+ * Times the search kernels behind .find(), .split(), .replace() and
+ * .count() against the two searches they replaced: strstr() on the
+ * NUL-terminated data, and a memchr() on the first byte followed by a
+ * memcmp(). memmem() is timed too where libc has it. Every case counts the non-overlapping matches in a buffer,
+ * which is the loop split, replace and count run.
+ *
+ * Usage: bench_string_search [megabytes] [iterations]
+*/
+
+#define _GNU_SOURCE     // memmem()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "strsearch.h"
+
+typedef size_t (*CountFunc)(const char* hay, size_t hayLen, const char* needle, size_t needleLen);
+
+static double nowMs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+static size_t countStrstr(const char* hay, size_t hayLen, const char* needle, size_t needleLen){
+    size_t count = 0;
+    const char* p = hay;
+    (void)hayLen;
+    while((p = strstr(p, needle)) != NULL){
+        count++;
+        p += needleLen;
+    }
+    return count;
+}
+
+#ifdef CIETO_HAVE_MEMMEM
+static size_t countMemmem(const char* hay, size_t hayLen, const char* needle, size_t needleLen){
+    size_t count = 0;
+    const char* end = hay + hayLen;
+    const char* p = hay;
+    while((p = memmem(p, end - p, needle, needleLen)) != NULL){
+        count++;
+        p += needleLen;
+    }
+    return count;
+}
+#endif
+
+static const char* findMemchr(const char* hay, size_t hayLen, const char* needle, size_t needleLen){
+    if(needleLen > hayLen) return NULL;
+    const char* last = hay + hayLen - needleLen;
+    for(const char* p = hay; p <= last; p++){
+        p = (const char*)memchr(p, needle[0], (size_t)(last - p) + 1);
+        if(p == NULL) return NULL;
+        if(memcmp(p + 1, needle + 1, needleLen - 1) == 0) return p;
+    }
+    return NULL;
+}
+
+static size_t countMemchr(const char* hay, size_t hayLen, const char* needle, size_t needleLen){
+    size_t count = 0;
+    const char* end = hay + hayLen;
+    const char* p = hay;
+    while((p = findMemchr(p, end - p, needle, needleLen)) != NULL){
+        count++;
+        p += needleLen;
+    }
+    return count;
+}
+
+static size_t countSearcher(const char* hay, size_t hayLen, const char* needle, size_t needleLen){
+    Searcher searcher;
+    initSearcher(&searcher, needle, needleLen);
+
+    size_t count = 0;
+    const char* end = hay + hayLen;
+    const char* p = hay;
+    while((p = searchNext(&searcher, p, end - p)) != NULL){
+        count++;
+        p += needleLen;
+    }
+    return count;
+}
+
+static char* buildText(size_t length){
+    static const char* words[] = {
+        "register", "virtual", "machine", "closure", "upvalue", "bytecode",
+        "string", "slice", "module", "import", "garbage", "collector",
+    };
+    size_t wordCnt = sizeof(words) / sizeof(words[0]);
+
+    char* text = malloc(length + 1);
+    if(text == NULL){
+        return NULL;
+    }
+
+    size_t len = 0;
+    unsigned int seed = 12345;
+    while(len < length){
+        seed = seed * 1103515245u + 12345u;
+        const char* word = words[(seed >> 16) % wordCnt];
+        size_t wordLen = strlen(word);
+        for(size_t i = 0; i < wordLen && len < length; i++){
+            text[len++] = word[i];
+        }
+        if(len < length){
+            text[len++] = (seed >> 8) % 9 == 0 ? '\n' : ' ';
+        }
+    }
+    text[length] = '\0';
+    return text;
+}
+
+static char* buildRepeated(size_t length, char c){
+    char* text = malloc(length + 1);
+    if(text == NULL){
+        return NULL;
+    }
+    memset(text, c, length);
+    text[length] = '\0';
+    return text;
+}
+
+static double bestMs(CountFunc func, const char* hay, size_t hayLen, const char* needle,
+                     int iterations, size_t* count){
+    double best = -1;
+    for(int i = 0; i < iterations; i++){
+        double start = nowMs();
+        *count = func(hay, hayLen, needle, strlen(needle));
+        double elapsed = nowMs() - start;
+        if(best < 0 || elapsed < best){
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+static void runCase(const char* name, const char* hay, size_t hayLen, const char* needle, int iterations){
+    static const struct{
+        const char* name;
+        CountFunc func;
+    } kernels[] = {
+        {"strstr", countStrstr},
+        {"memchr", countMemchr},
+#ifdef CIETO_HAVE_MEMMEM
+        {"memmem", countMemmem},
+#endif
+        {"search", countSearcher},
+    };
+
+    double mb = (double)hayLen / (1024.0 * 1024.0);
+    printf("%-28s", name);
+    for(size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++){
+        size_t count = 0;
+        double best = bestMs(kernels[i].func, hay, hayLen, needle, iterations, &count);
+        printf("  %s %8.1f MB/s", kernels[i].name, mb / (best / 1000.0));
+        if(i == 0){
+            printf(" (%zu)", count);
+        }
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[]){
+    int megabytes = argc > 1 ? atoi(argv[1]) : 16;
+    int iterations = argc > 2 ? atoi(argv[2]) : 5;
+    size_t length = (size_t)megabytes * 1024 * 1024;
+
+    char* text = buildText(length);
+    char* repeated = buildRepeated(length / 16, 'a');
+    if(text == NULL || repeated == NULL){
+        fprintf(stderr, "Could not allocate benchmark text.\n");
+        free(text);
+        free(repeated);
+        return 1;
+    }
+
+    char periodic[65];
+    memset(periodic, 'a', 63);
+    periodic[63] = 'b';
+    periodic[64] = '\0';
+
+    printf("text: %zu bytes, best of %d\n", length, iterations);
+    runCase("one byte '\\n'", text, length, "\n", iterations);
+    runCase("short common \"machine\"", text, length, "machine", iterations);
+    runCase("short rare \"vm:\"", text, length, "vm:", iterations);
+    runCase("long rare (46 bytes)", text, length, "garbage collector module import closure string", iterations);
+    runCase("periodic short \"aaab\"", repeated, length / 16, "aaab", iterations);
+    runCase("periodic long (64 bytes)", repeated, length / 16, periodic, iterations);
+
+    free(text);
+    free(repeated);
+    return 0;
+}
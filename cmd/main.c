@@ -3,6 +3,8 @@
 #include "repl.h"
 #include "file.h"
 #include "version.h"
+#include "compile_cache.h"
+#include "module_loader.h"
 
 static void printVersion(void){
     printf("Cieto %s\n", CIETO_VERSION);
@@ -17,7 +19,22 @@ static void printHelp(const char* programName){
     printf("  %s                         Start the REPL\n", programName);
     printf("  %s <file.cies> [args...]    Run a script\n", programName);
     printf("  %s run <file.cies> [args...] Run a script\n", programName);
-    printf("  %s --dump, -d <file.cies>   Compile and dump bytecode\n", programName);
+    printf("  %s run <file.pco> [args...]  Run a compiled script\n", programName);
+    printf("  %s run <file.cbundle> [args...]\n", programName);
+    printf("                              Run a bundled application\n");
+    printf("  %s build <file.cies> [-o <file.pco>]\n", programName);
+    printf("                              Compile a script to bytecode\n");
+    printf("  %s bundle <file.cies> [-o <file.cbundle>]\n", programName);
+    printf("                              Compile a script and its imports into one file\n");
+    printf("  %s --dump, -d <file>        Compile and dump bytecode\n", programName);
+    printf("  %s --eager <file.cies>      Compile all function bodies before running\n", programName);
+    printf("  %s --no-cache <file.cies>   Do not cache compiled modules\n", programName);
+    printf("  %s --no-prefetch <file.cies>\n", programName);
+    printf("                              Do not compile imports on background threads\n");
+    printf("  %s --cache-dir <dir> <file.cies>\n", programName);
+    printf("                              Cache compiled modules in <dir>\n");
+    printf("  %s --import-stats <file.cies>\n", programName);
+    printf("                              Print per-module import timings on exit\n");
     printf("  %s --help                  Show this help message\n", programName);
     printf("  %s --version               Show version information\n", programName);
     printf("\n");
@@ -26,6 +43,18 @@ static void printHelp(const char* programName){
     printf("  %s examples/argv_echo.cies hello world\n", programName);
 }
 
+static void setupCache(VM* vm, bool useCache, const char* cacheDir){
+    // imported modules are cached unless disabled
+    if(!useCache){
+        return;
+    }
+    if(cacheDir != NULL){
+        setCacheDir(vm, cacheDir);
+    }else{
+        vm->cacheDir = defaultCacheDir();
+    }
+}
+
 int main(int argc, const char* argv[]){
     if(argc >= 2){
         if(strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0){
@@ -40,9 +69,38 @@ int main(int argc, const char* argv[]){
     }
     
     VM vm;
+    bool eager = false;
+    bool useCache = getenv("CIETO_NO_CACHE") == NULL;
+    bool prefetch = getenv("CIETO_NO_PREFETCH") == NULL;
+    const char* cacheDir = NULL;
+    bool importStats = false;
+
+    while(argc >= 2){
+        int used = 1;
+        if(strcmp(argv[1], "--eager") == 0){
+            // function bodies are compiled lazily by default
+            eager = true;
+        }else if(strcmp(argv[1], "--import-stats") == 0){
+            importStats = true;
+        }else if(strcmp(argv[1], "--no-cache") == 0){
+            useCache = false;
+        }else if(strcmp(argv[1], "--no-prefetch") == 0){
+            prefetch = false;
+        }else if(strcmp(argv[1], "--cache-dir") == 0 && argc >= 3){
+            cacheDir = argv[2];
+            used = 2;
+        }else{
+            break;
+        }
+        argv[used] = argv[0];
+        argv += used;
+        argc -= used;
+    }
 
     if(argc == 1){
         initVM(&vm, 0, NULL);
+        vm.eagerCompile = eager;
+        setupCache(&vm, useCache, cacheDir);
         repl(&vm);
     }else{
         if(strcmp(argv[1], "--dump") == 0 || strcmp(argv[1], "-d") == 0){
@@ -59,6 +117,41 @@ int main(int argc, const char* argv[]){
             return status;
         }
 
+        if(strcmp(argv[1], "build") == 0){
+            const char* outPath = NULL;
+            if(argc == 5 && strcmp(argv[3], "-o") == 0){
+                outPath = argv[4];
+            }else if(argc != 3){
+                printHelp(argv[0]);
+                return 64;
+            }
+
+            initVM(&vm, 0, NULL);
+            vm.eagerCompile = true;     // check every body before it ships
+
+            int status = buildScript(&vm, argv[2], outPath);
+
+            freeVM(&vm);
+            return status;
+        }
+
+        if(strcmp(argv[1], "bundle") == 0){
+            const char* outPath = NULL;
+            if(argc == 5 && strcmp(argv[3], "-o") == 0){
+                outPath = argv[4];
+            }else if(argc != 3){
+                printHelp(argv[0]);
+                return 64;
+            }
+
+            initVM(&vm, 0, NULL);
+
+            int status = bundleScript(&vm, argv[2], outPath);
+
+            freeVM(&vm);
+            return status;
+        }
+
         int scriptArgsSt = 1;
 
         if(strcmp(argv[1], "run") == 0){
@@ -72,7 +165,14 @@ int main(int argc, const char* argv[]){
         }
 
         initVM(&vm, argc - scriptArgsSt, argv + scriptArgsSt);
+        vm.eagerCompile = eager;
+        setupCache(&vm, useCache, cacheDir);
+        vm.importPrefetch = prefetch;
+        vm.importStats.enabled = importStats;
         runScript(&vm, argv[scriptArgsSt]);
+        if(importStats){
+            printImportStats(&vm);
+        }
     }
     
     freeVM(&vm);
@@ -38,6 +38,7 @@ static int emitInstruction(Compiler* compiler, Instruction instruction);
 
 static void expr2Reg(Compiler* compiler, ExprDesc* expr, int reg);
 static void expr2NextReg(Compiler* compiler, ExprDesc* expr);
+static void expr2AnyReg(Compiler* compiler, ExprDesc* expr);
 static void unplugExpr(Compiler* compiler, ExprDesc* expr);
 static void expr2RK(Compiler* compiler, ExprDesc* expr);
 static void freeExpr(Compiler* compiler, ExprDesc* expr);
@@ -65,6 +66,9 @@ static void handlePipe(Compiler* compiler, ExprDesc* expr, bool canAssign);
 static void addLocal(Compiler* compiler, Token name);
 static int resolveLocal(Compiler* compiler, Token* name);
 static int resolveUpvalue(Compiler* compiler, Token* name);
+static void markAssigned(Compiler* compiler, int reg);
+static void markUpvalueAssigned(Compiler* compiler, int index);
+static bool releaseLocal(Compiler* compiler, Local* local);
 static int identifierConst(Compiler* compiler);
 static void declLocal(Compiler* compiler);
 static int emitJmpIfFalse(Compiler* compiler, int reg);
@@ -313,12 +317,23 @@ static void expr2NextReg(Compiler* compiler, ExprDesc* expr){
     expr2Reg(compiler, expr, compiler->freeReg - 1);
 }
 
+static void expr2AnyReg(Compiler* compiler, ExprDesc* expr){
+    // a local or an already loaded value is used where it is
+    unplugExpr(compiler, expr);
+    if(expr->type != EXPR_LOCAL && expr->type != EXPR_REG){
+        expr2NextReg(compiler, expr);
+    }
+}
+
 static void storeVar(Compiler* compiler, ExprDesc* var, ExprDesc* val){
     switch(var->type){
         case EXPR_LOCAL:
+            storeLocalType(compiler, var->data.loc.index, val, false);
+            markAssigned(compiler, var->data.loc.index);
             expr2Reg(compiler, val, var->data.loc.index);
             break;
         case EXPR_UPVAL:{
+            markUpvalueAssigned(compiler, var->data.loc.index);
             expr2NextReg(compiler, val);
             emitABC(
                 compiler, 
@@ -368,25 +383,269 @@ static void storeVar(Compiler* compiler, ExprDesc* var, ExprDesc* val){
 }
 
 static void emitBinaryOp(Compiler* compiler, OpCode op, ExprDesc* left, ExprDesc* right){
-    expr2NextReg(compiler, left);
+    bool isNum = exprIsNum(compiler, left) && exprIsNum(compiler, right);
+    uint64_t deps = left->numDeps | right->numDeps;
+
+    expr2AnyReg(compiler, left);
     expr2NextReg(compiler, right);
     freeExpr(compiler, right);
     freeExpr(compiler, left);
 
-    int instructionIndex = emitABC(compiler, op, 0, left->data.loc.index, right->data.loc.index);
+    int instructionIndex = emitNumOp(compiler, op, 0, left->data.loc.index, right->data.loc.index, isNum, deps);
     left->type = EXPR_TBD;
     left->data.loc.index = instructionIndex;
+
+    if(op == OP_ADD || op == OP_DIV){
+        // string concatenation and path join
+        left->isNum = isNum;
+        left->numDeps = isNum ? deps : 0;
+    }else{
+        // the rest either yield a number or raise
+        left->isNum = true;
+        left->numDeps = 0;
+    }
+}
+
+static bool exprIsNum(Compiler* compiler, ExprDesc* expr){
+    if(!expr->isNum){
+        return false;
+    }
+
+    // a local read earlier in the expression may have been reassigned since
+    for(int i = 0; i < compiler->localCnt && i < NUM_TRACK_MAX; i++){
+        if((expr->numDeps & ((uint64_t)1 << i)) && !compiler->locals[i].isNum){
+            return false;
+        }
+    }
+    return true;
+}
+
+static OpCode numOpFor(OpCode op){
+    switch(op){
+        case OP_ADD:    return OP_ADD_NN;
+        case OP_SUB:    return OP_SUB_NN;
+        case OP_MUL:    return OP_MUL_NN;
+        case OP_LT:     return OP_LT_NN;
+        case OP_LE:     return OP_LE_NN;
+        default:        return op;
+    }
+}
+
+static OpCode checkedOpFor(OpCode op){
+    switch(op){
+        case OP_ADD_NN: return OP_ADD;
+        case OP_SUB_NN: return OP_SUB;
+        case OP_MUL_NN: return OP_MUL;
+        case OP_LT_NN:  return OP_LT;
+        case OP_LE_NN:  return OP_LE;
+        default:        return op;
+    }
+}
+
+static int emitNumOp(Compiler* compiler, OpCode op, int a, int b, int c, bool isNum, uint64_t deps){
+    OpCode numOp = numOpFor(op);
+    if(!isNum || numOp == op){
+        return emitABC(compiler, op, a, b, c);
+    }
+
+    int offset = emitABC(compiler, numOp, a, b, c);
+    if(deps == 0){
+        return offset;  // literals and fresh arithmetic results only
+    }
+
+    if(compiler->numPatchCnt == compiler->numPatchCapacity){
+        int newCapacity = GROW_CAPACITY(compiler->numPatchCapacity);
+        compiler->numPatches = (NumPatch*)arenaGrow(
+            compiler->arena,
+            compiler->numPatches,
+            sizeof(NumPatch) * compiler->numPatchCapacity,
+            sizeof(NumPatch) * newCapacity
+        );
+        compiler->numPatchCapacity = newCapacity;
+    }
+
+    compiler->numPatches[compiler->numPatchCnt].offset = offset;
+    compiler->numPatches[compiler->numPatchCnt].deps = deps;
+    compiler->numPatchCnt++;
+    return offset;
+}
+
+static int localIndexForReg(Compiler* compiler, int reg){
+    for(int i = compiler->localCnt - 1; i >= 0; i--){
+        if(compiler->locals[i].reg == reg){
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void downgradeLocal(Compiler* compiler, int index){
+    Local* local = &compiler->locals[index];
+    if(!local->isNum){
+        return;
+    }
+    local->isNum = false;
+
+    if(index >= NUM_TRACK_MAX){
+        return;
+    }
+    uint64_t bit = (uint64_t)1 << index;
+
+    Instruction* code = compiler->func->chunk.code;
+    for(int i = 0; i < compiler->numPatchCnt; i++){
+        NumPatch* patch = &compiler->numPatches[i];
+        if(patch->deps & bit){
+            Instruction instruction = code[patch->offset];
+            code[patch->offset] = CREATE_ABC(
+                checkedOpFor(GET_OPCODE(instruction)),
+                GET_ARG_A(instruction),
+                GET_ARG_B(instruction),
+                GET_ARG_C(instruction)
+            );
+            patch->deps = 0;
+        }
+    }
+
+    for(int i = 0; i < compiler->localCnt; i++){
+        if(compiler->locals[i].numDeps & bit){
+            downgradeLocal(compiler, i);
+        }
+    }
+}
+
+static void storeLocalType(Compiler* compiler, int reg, ExprDesc* val, bool isInit){
+    /*
+     * Flow-insensitive: a local stays a number only while every store
+     * into it is one. A single other store reverts all code that relied
+     * on it, so loops see the same answer for every iteration.
+    */
+    int index = localIndexForReg(compiler, reg);
+    if(index == -1){
+        return;
+    }
+
+    Local* local = &compiler->locals[index];
+    bool isNum = exprIsNum(compiler, val);
+
+    if(isInit){
+        local->isNum = isNum && index < NUM_TRACK_MAX;
+        local->numDeps = isNum ? val->numDeps : 0;
+    }else if(!isNum){
+        downgradeLocal(compiler, index);
+    }else{
+        local->numDeps |= val->numDeps;
+    }
 }
 
 static void freeExpr(Compiler* compiler, ExprDesc* expr){
-    if(expr->type == EXPR_TBD){
-        int minReg = compiler->localCnt > 0 ? compiler->locals[compiler->localCnt - 1].reg + 1 : 1;
-        if(expr->data.loc.index >= minReg){
-            if(expr->data.loc.index < compiler->freeReg){
-                freeRegs(compiler, 1);
-            }
+    // an EXPR_TBD holds the index of its instruction, not a register, so there
+    // is nothing to give back yet; freeing by that index released live temporaries
+    (void)compiler;
+    (void)expr;
+}
+
+static void* arenaAlloc(CompilerArena* arena, size_t size){
+    size = (size + 15) & ~(size_t)15;
+
+    ArenaBlock* block = arena->head;
+    if(block == NULL || block->used + size > block->capacity){
+        size_t capacity = size > ARENA_BLOCK_SIZE / 2 ? size : ARENA_BLOCK_SIZE;
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + capacity);
+        if(block == NULL){
+            fprintf(stderr, "Not enough memory to compile.\n");
+            exit(EXIT_FAILURE);
+        }
+        block->used = 0;
+        block->capacity = capacity;
+        // oversized blocks go behind the head so small allocations keep using it
+        if(capacity > ARENA_BLOCK_SIZE && arena->head != NULL){
+            block->next = arena->head->next;
+            arena->head->next = block;
+        }else{
+            block->next = arena->head;
+            arena->head = block;
         }
     }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+static void* arenaGrow(CompilerArena* arena, void* ptr, size_t oldSize, size_t newSize){
+    ArenaBlock* block = arena->head;
+    size_t oldAligned = (oldSize + 15) & ~(size_t)15;
+    size_t newAligned = (newSize + 15) & ~(size_t)15;
+
+    if(ptr != NULL && block != NULL && 
+        (char*)ptr + oldAligned == block->data + block->used &&
+        block->used - oldAligned + newAligned <= block->capacity){
+            block->used = block->used - oldAligned + newAligned;
+            return ptr;
+    }   // last allocation of the head block, extend in place
+
+    void* newPtr = arenaAlloc(arena, newSize);
+    if(ptr != NULL){
+        memcpy(newPtr, ptr, oldSize);
+    }
+    return newPtr;
+}
+
+static void freeArena(CompilerArena* arena){
+    ArenaBlock* block = arena->head;
+    while(block != NULL){
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->spare = NULL;
+}
+
+static Compiler* acquireCompiler(CompilerArena* arena){
+    Compiler* compiler = arena->spare;
+    if(compiler != NULL){
+        arena->spare = compiler->enclosing;
+    }else{
+        compiler = (Compiler*)arenaAlloc(arena, sizeof(Compiler));
+        compiler->locals = NULL;
+        compiler->localCapacity = 0;
+        compiler->upvalues = NULL;
+        compiler->upvalueCapacity = 0;
+        compiler->numPatches = NULL;
+        compiler->numPatchCapacity = 0;
+        compiler->constSlots = NULL;
+        compiler->constSlotCapacity = 0;
+        compiler->constUses = NULL;
+        compiler->constUseCapacity = 0;
+    }
+    compiler->arena = arena;
+    return compiler;
+}
+
+static void releaseCompiler(Compiler* compiler){
+    compiler->enclosing = compiler->arena->spare;
+    compiler->arena->spare = compiler;
+}
+
+static Local* pushLocal(Compiler* compiler){
+    if(compiler->localCnt == compiler->localCapacity){
+        int newCapacity = compiler->localCapacity < LOCAL_INIT ? LOCAL_INIT : compiler->localCapacity * 2;
+        compiler->locals = (Local*)arenaGrow(
+            compiler->arena,
+            compiler->locals,
+            sizeof(Local) * compiler->localCapacity,
+            sizeof(Local) * newCapacity
+        );
+        compiler->localCapacity = newCapacity;
+    }
+    Local* local = &compiler->locals[compiler->localCnt++];
+    local->isNum = false;
+    local->numDeps = 0;
+    local->agg = NULL;
+    local->isAssigned = false;
+    local->capturedAt = -1;
+    return local;
 }
 
 static void initCompiler(Compiler* compiler, VM* vm, Compiler* enclosing, FuncType type, ObjectString* srcName){
@@ -408,6 +667,12 @@ static void initCompiler(Compiler* compiler, VM* vm, Compiler* enclosing, FuncTy
     }
 
     compiler->upvalueCnt = 0;
+    compiler->numPatchCnt = 0;
+    compiler->constSlotCnt = 0;
+    compiler->constUseCnt = 0;
+    for(int i = 0; i < compiler->constSlotCapacity; i++){
+        compiler->constSlots[i].index = CONST_SLOT_FREE;
+    }
     compiler->localCnt = 0;
     compiler->scopeDepth = 0;
     compiler->loopCnt = 0;
@@ -419,7 +684,7 @@ static void initCompiler(Compiler* compiler, VM* vm, Compiler* enclosing, FuncTy
 
     compiler->freeReg = 0;
 
-    Local *local = &compiler->locals[compiler->localCnt++];
+    Local *local = pushLocal(compiler);
     local->depth = 0;
     local->reg = 0;
     
@@ -436,12 +701,10 @@ static void initCompiler(Compiler* compiler, VM* vm, Compiler* enclosing, FuncTy
 }
 
 ObjectFunc* compile(VM* vm, const char* code, const char* srcNameStr){
-    Compiler* compiler = (Compiler*)reallocate(vm, NULL, 0, sizeof(Compiler));
-    if(compiler == NULL){
-        fprintf(stderr, "Not enough memory to compile.\n");
-        return false;
-    }
+    CompilerArena arena = {NULL, NULL};
+    Compiler* compiler = acquireCompiler(&arena);
     initScanner(code);
+    setScannerQuiet(vm->quietCompile);
     ObjectString* srcName = copyString(vm, srcNameStr, (int)strlen(srcNameStr));
 
     push(vm, OBJECT_VAL(srcName));
@@ -454,6 +717,8 @@ ObjectFunc* compile(VM* vm, const char* code, const char* srcNameStr){
 
     advance(compiler);  // Initialize the first token
     if(compiler->parser.cur.type == TOKEN_EOF){
+        vm->compiler = compiler->enclosing;
+        freeArena(&arena);
         return NULL;  // No code to compile
     }
     // expression(&compiler); // Start parsing the expression
@@ -466,7 +731,7 @@ ObjectFunc* compile(VM* vm, const char* code, const char* srcNameStr){
 
     bool hadError = compiler->parser.hadError;
     vm->compiler = compiler->enclosing;
-    reallocate(vm, compiler, sizeof(Compiler), 0);
+    freeArena(&arena);
     
     return hadError ? NULL : func;
 }
@@ -502,7 +767,7 @@ static void decl(Compiler* compiler){
         stmt(compiler);
     
     if(compiler->parser.panic){
-        sync(compiler);
+        synchronize(compiler);
     }
 }
 
@@ -510,11 +775,22 @@ static void varDecl(Compiler* compiler){
     int global = parseVar(compiler, "Expect variable name.");
 
     if(compiler->scopeDepth > 0){
-        int reg = compiler->locals[compiler->localCnt - 1].reg;
+        int localIndex = compiler->localCnt - 1;
+        int reg = compiler->locals[localIndex].reg;
         if(match(compiler, TOKEN_ASSIGN)){
-            ExprDesc initExpr;
-            expression(compiler, &initExpr);
-            expr2Reg(compiler, &initExpr, reg);
+            ScalarAgg* agg = NULL;
+            if(checkType(compiler, TOKEN_LEFT_BRACKET) || checkType(compiler, TOKEN_LEFT_BRACE)){
+                agg = scanScalarAgg(compiler, compiler->locals[localIndex].name);
+            }
+
+            if(agg != NULL){
+                scalarInit(compiler, localIndex, agg);
+            }else{
+                ExprDesc initExpr;
+                expression(compiler, &initExpr);
+                storeLocalType(compiler, reg, &initExpr, true);
+                expr2Reg(compiler, &initExpr, reg);
+            }
         }else{
             emitABC(compiler, OP_LOADNULL, reg, 0, 0);
         }
@@ -542,29 +818,232 @@ static void varDecl(Compiler* compiler){
     }
 }
 
-static void compileFunc(Compiler* compiler, FuncType type, int destReg, Token* funcName){
-    Compiler* funcCompiler = (Compiler*)reallocate(compiler->vm, NULL, 0, sizeof(Compiler));    
-    if(funcCompiler == NULL){
-        errorAt(compiler, &compiler->parser.pre, "Not enough memory to compile function.");
-        return;
+static bool scanStringKey(Token* key){
+    // expects the token after '"'; accepts only plain literals
+    Token token = scan();
+    key->len = 0;
+    if(token.type == TOKEN_INTERPOLATION_CONTENT){
+        if(memchr(token.head, '\\', token.len) != NULL){
+            return false;   // escapes could spell one key two ways
+        }
+        *key = token;
+        token = scan();
     }
-    funcCompiler->parser = compiler->parser;
+    return token.type == TOKEN_STRING_END;
+}
 
-    funcCompiler->enclosing = compiler;
-    funcCompiler->vm = compiler->vm;
-    funcCompiler->func = NULL;  
-    compiler->vm->compiler = funcCompiler;
+static ScalarAgg* scanScalarAgg(Compiler* compiler, Token name){
+    /*
+     * Looks ahead over the literal and the rest of its block. The literal
+     * may live in registers only if every later mention of the name is
+     * name[<literal>] naming an existing element. Anything else, or any
+     * closure that might capture it, lets the container escape. Only
+     * SCALAR_SCAN_MAX tokens of the block are looked at, a literal still
+     * in scope past them is allocated, so a long block of literals is not
+     * rescanned once per declaration.
+    */
+    Scanner state = saveScanner();
+    setScannerQuiet(true);
+
+    bool isList = checkType(compiler, TOKEN_LEFT_BRACKET);
+    TokenType closeType = isList ? TOKEN_RIGHT_BRACKET : TOKEN_RIGHT_BRACE;
+    Token keys[SCALAR_MAX];
+    int count = 0;
+    int depth = 0;
+    bool ok = true;
+    bool expectKey = !isList;
+
+    Token token = scan();
+    if(token.type == closeType){
+        ok = false;     // nothing to keep
+    }
+
+    while(ok){
+        if(expectKey){
+            if(token.type != TOKEN_STRING_START || count == SCALAR_MAX || !scanStringKey(&keys[count])){
+                ok = false;
+                break;
+            }
+            for(int i = 0; i < count; i++){
+                if(keys[i].len == keys[count].len && memcmp(keys[i].head, keys[count].head, keys[i].len) == 0){
+                    ok = false;
+                }
+            }
+            token = scan();
+            if(token.type != TOKEN_COLON){
+                ok = false;
+            }
+            token = scan();
+            expectKey = false;
+            continue;
+        }
 
-    initCompiler(funcCompiler, compiler->vm, compiler, type, compiler->func->srcName);
+        if(depth == 0 && (token.type == TOKEN_COMMA || token.type == closeType)){
+            if(count == SCALAR_MAX){
+                ok = false;
+                break;
+            }
+            count++;
+            if(token.type == closeType){
+                break;
+            }
+            token = scan();
+            expectKey = !isList;
+            continue;
+        }
 
-    if(funcName != NULL){
-        funcCompiler->func->name = copyString(
-            compiler->vm, 
-            funcName->head, 
-            funcName->len
-        );
+        switch(token.type){
+            case TOKEN_LEFT_PAREN:
+            case TOKEN_LEFT_BRACKET:
+            case TOKEN_LEFT_BRACE:
+                depth++;
+                break;
+            case TOKEN_RIGHT_PAREN:
+            case TOKEN_RIGHT_BRACKET:
+            case TOKEN_RIGHT_BRACE:
+                depth--;
+                break;
+            case TOKEN_SEMICOLON:   // [item; count]
+            case TOKEN_EOF:
+            case TOKEN_ERROR:
+                ok = false;
+                break;
+            default:
+                break;
+        }
+        token = scan();
     }
 
+    if(ok && scan().type != TOKEN_SEMICOLON){
+        ok = false;
+    }
+
+    depth = 0;
+    TokenType prev = TOKEN_SEMICOLON;
+    bool done = false;
+    int scanned = 0;
+    while(ok && !done){
+        if(++scanned > SCALAR_SCAN_MAX){
+            ok = false;
+            break;
+        }
+        token = scan();
+        switch(token.type){
+            case TOKEN_EOF:
+                done = true;
+                break;
+            case TOKEN_LEFT_BRACE:
+                depth++;
+                break;
+            case TOKEN_RIGHT_BRACE:
+                if(depth == 0){
+                    done = true;    // end of the declaring block
+                }
+                depth--;
+                break;
+            case TOKEN_FUNC:
+            case TOKEN_DEFER:
+            case TOKEN_METHOD:
+            case TOKEN_CLASS:
+            case TOKEN_ERROR:
+                ok = false;
+                break;
+            case TOKEN_IDENTIFIER:{
+                if(token.len != name.len || memcmp(token.head, name.head, name.len) != 0){
+                    break;
+                }
+                if(prev == TOKEN_DOT || scan().type != TOKEN_LEFT_BRACKET){
+                    ok = false;
+                    break;
+                }
+
+                token = scan();
+                if(isList){
+                    double index = strtod(token.head, NULL);
+                    ok = token.type == TOKEN_NUMBER && index >= 0 && index < count && index == floor(index);
+                }else{
+                    Token key = {0};
+                    ok = token.type == TOKEN_STRING_START && scanStringKey(&key);
+                    bool found = false;
+                    for(int i = 0; ok && i < count; i++){
+                        if(keys[i].len == key.len && memcmp(keys[i].head, key.head, key.len) == 0){
+                            found = true;
+                        }
+                    }
+                    ok = ok && found;
+                }
+
+                token = scan();
+                if(token.type != TOKEN_RIGHT_BRACKET){
+                    ok = false;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        prev = token.type;
+    }
+
+    restoreScanner(state);
+
+    if(!ok){
+        return NULL;
+    }
+
+    ScalarAgg* agg = (ScalarAgg*)arenaAlloc(compiler->arena, sizeof(ScalarAgg));
+    agg->count = count;
+    agg->baseReg = 0;
+    agg->keys = NULL;
+    if(!isList){
+        agg->keys = (Token*)arenaAlloc(compiler->arena, sizeof(Token) * count);
+        memcpy(agg->keys, keys, sizeof(Token) * count);
+    }
+    return agg;
+}
+
+static void scalarInit(Compiler* compiler, int localIndex, ScalarAgg* agg){
+    bool isList = agg->keys == NULL;
+    consume(compiler, isList ? TOKEN_LEFT_BRACKET : TOKEN_LEFT_BRACE, "Expect literal.");
+
+    Token hidden = compiler->parser.pre;
+    hidden.len = 0;     // can never be resolved by name
+
+    for(int i = 0; i < agg->count; i++){
+        addLocal(compiler, hidden);
+        compiler->locals[compiler->localCnt - 1].depth = compiler->scopeDepth;
+    }
+    agg->baseReg = compiler->locals[compiler->localCnt - agg->count].reg;
+
+    for(int i = 0; i < agg->count; i++){
+        if(i > 0){
+            consume(compiler, TOKEN_COMMA, "Expect ',' between elements.");
+        }
+        if(!isList){
+            consume(compiler, TOKEN_STRING_START, "Expect map key.");
+            if(checkType(compiler, TOKEN_INTERPOLATION_CONTENT)){
+                advance(compiler);
+            }
+            consume(compiler, TOKEN_STRING_END, "Expect '\"' after map key.");
+            consume(compiler, TOKEN_COLON, "Expect ':' after map key.");
+        }
+
+        ExprDesc elemExpr;
+        expression(compiler, &elemExpr);
+        int reg = agg->baseReg + i;
+        storeLocalType(compiler, reg, &elemExpr, true);
+        expr2Reg(compiler, &elemExpr, reg);
+        compiler->freeReg = agg->baseReg + agg->count;
+    }
+
+    consume(compiler, isList ? TOKEN_RIGHT_BRACKET : TOKEN_RIGHT_BRACE, 
+        isList ? "Expect ']' after list." : "Expect '}' after map.");
+
+    compiler->locals[localIndex].depth = compiler->scopeDepth;
+    compiler->locals[localIndex].agg = agg;
+}
+
+static void compileFuncBody(Compiler* funcCompiler){
     beginScope(funcCompiler);
     consume(funcCompiler, TOKEN_LEFT_PAREN, "Expect '(' after function name.");
 
@@ -582,6 +1061,28 @@ static void compileFunc(Compiler* compiler, FuncType type, int destReg, Token* f
     consume(funcCompiler, TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
     consume(funcCompiler, TOKEN_LEFT_BRACE, "Expect '{' before function body.");
     block(funcCompiler);
+}
+
+static void compileFunc(Compiler* compiler, FuncType type, int destReg, Token* funcName){
+    Compiler* funcCompiler = acquireCompiler(compiler->arena);
+    funcCompiler->parser = compiler->parser;
+
+    funcCompiler->enclosing = compiler;
+    funcCompiler->vm = compiler->vm;
+    funcCompiler->func = NULL;  
+    compiler->vm->compiler = funcCompiler;
+
+    initCompiler(funcCompiler, compiler->vm, compiler, type, compiler->func->srcName);
+
+    if(funcName != NULL){
+        funcCompiler->func->name = copyString(
+            compiler->vm, 
+            funcName->head, 
+            funcName->len
+        );
+    }
+
+    compileFuncBody(funcCompiler);
 
     ObjectFunc* func = stopCompiler(funcCompiler);
     
@@ -591,7 +1092,120 @@ static void compileFunc(Compiler* compiler, FuncType type, int destReg, Token* f
 
     compiler->parser = funcCompiler->parser;
     compiler->vm->compiler = compiler;
-    reallocate(compiler->vm, funcCompiler, sizeof(Compiler), 0);
+    releaseCompiler(funcCompiler);
+}
+
+static void deferFunc(Compiler* compiler, int destReg, Token* funcName){
+    /*
+     * A top-level function has no enclosing locals, so it can never
+     * capture upvalues. Its body only needs bracket matching here;
+     * compileLazyFunc() generates the bytecode on the first call.
+    */
+    VM* vm = compiler->vm;
+    Token open = compiler->parser.cur;
+
+    consume(compiler, TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+
+    int arity = 0;
+    while(!checkType(compiler, TOKEN_RIGHT_PAREN) && !checkType(compiler, TOKEN_EOF)){
+        if(checkType(compiler, TOKEN_IDENTIFIER)){
+            arity++;
+        }
+        advance(compiler);
+    }
+
+    consume(compiler, TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+    consume(compiler, TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+
+    int depth = 1;
+    while(depth > 0 && !checkType(compiler, TOKEN_EOF)){
+        if(checkType(compiler, TOKEN_LEFT_BRACE)){
+            depth++;
+        }else if(checkType(compiler, TOKEN_RIGHT_BRACE)){
+            depth--;
+        }
+        advance(compiler);
+    }
+
+    if(depth > 0){
+        errorAt(compiler, &compiler->parser.cur, "Expect '}' after block.");
+        return;
+    }
+
+    const char* end = compiler->parser.pre.head + compiler->parser.pre.len;
+    int len = (int)(end - open.head);
+
+    ObjectFunc* func = newFunction(vm);
+    push(vm, OBJECT_VAL(func));
+
+    func->type = TYPE_FUNC;
+    func->srcName = compiler->func->srcName;
+    func->name = copyString(vm, funcName->head, funcName->len);
+    func->arity = arity;
+
+    char* src = GROW_ARRAY(vm, char, NULL, 0, len + 1);
+    memcpy(src, open.head, len);
+    src[len] = '\0';
+
+    func->lazySrc = src;
+    func->lazyLen = len;
+    func->lazyLine = open.line;
+
+    int constIndex = makeConstant(compiler, OBJECT_VAL(func));
+    pop(vm);
+
+    emitABx(compiler, OP_CLOSURE, destReg, constIndex);
+}
+
+bool compileLazyFunc(VM* vm, ObjectFunc* func, GlobalEnv* globals){
+    CompilerArena arena = {NULL, NULL};
+    Compiler* compiler = acquireCompiler(&arena);
+
+    push(vm, OBJECT_VAL(func));
+    initScannerAt(func->lazySrc, func->lazyLine);
+    setScannerQuiet(vm->quietCompile);
+
+    Compiler* enclosing = vm->compiler;
+    compiler->vm = vm;
+    compiler->func = NULL;
+    compiler->parser.pre = (Token){
+        .type = TOKEN_IDENTIFIER,
+        .head = func->name->chars,
+        .len = (int)func->name->length,
+        .line = func->lazyLine
+    };  // local 0 is named after the function, as in compileFunc()
+    compiler->parser.hadError = false;
+    compiler->parser.panic = false;
+    vm->compiler = compiler;
+
+    initCompiler(compiler, vm, NULL, TYPE_FUNC, func->srcName);
+    compiler->globals = globals;
+    compiler->func = func;  // compile into the stub already referenced by closures
+
+    int arity = func->arity;
+    func->arity = 0;
+
+    advance(compiler);
+    compileFuncBody(compiler);
+    consume(compiler, TOKEN_EOF, "Expect end of function.");
+    stopCompiler(compiler);
+
+    bool hadError = compiler->parser.hadError;
+    if(hadError){
+        freeChunk(vm, &func->chunk);
+        initChunk(&func->chunk);
+        func->arity = arity;
+    }else{
+        FREE_ARRAY(vm, char, func->lazySrc, func->lazyLen + 1);
+        func->lazySrc = NULL;
+        func->lazyLen = 0;
+    }
+
+    vm->compiler = enclosing;
+    freeArena(&arena);
+    pop(vm);
+
+    return !hadError;
 }
 
 static void funcExpr(Compiler* compiler, ExprDesc* expr, bool canAssign){
@@ -606,23 +1220,23 @@ static void funcDecl(Compiler* compiler){
     Token funcName = compiler->parser.pre;
 
     if(compiler->scopeDepth > 0){
-        int reg = compiler->localCnt - 1;
+        int reg = compiler->locals[compiler->localCnt - 1].reg;
         compileFunc(compiler, TYPE_FUNC, reg, &funcName);
         defineVar(compiler, global);
     }else{
         int tmpReg = getFreeReg(compiler);
-        compileFunc(compiler, TYPE_FUNC, tmpReg, &funcName);
+        if(compiler->enclosing == NULL && !compiler->vm->eagerCompile){
+            deferFunc(compiler, tmpReg, &funcName);
+        }else{
+            compileFunc(compiler, TYPE_FUNC, tmpReg, &funcName);
+        }
         emitABx(compiler, OP_SET_GLOBAL, tmpReg, global);
         defineVar(compiler, global);
     }
 }
 
 static void compileMethod(Compiler* compiler, Token recvName, Token methodName, FuncType type, int destReg){
-    Compiler* methodCompiler = (Compiler*)reallocate(compiler->vm, NULL, 0, sizeof(Compiler));    
-    if(methodCompiler == NULL){
-        errorAt(compiler, &compiler->parser.pre, "Not enough memory to compile method.");
-        return;
-    }
+    Compiler* methodCompiler = acquireCompiler(compiler->arena);
 
     methodCompiler->parser = compiler->parser;
     methodCompiler->enclosing = compiler;
@@ -667,7 +1281,7 @@ static void compileMethod(Compiler* compiler, Token recvName, Token methodName,
 
     compiler->parser = methodCompiler->parser;
     compiler->vm->compiler = compiler;
-    reallocate(compiler->vm, methodCompiler, sizeof(Compiler), 0);
+    releaseCompiler(methodCompiler);
 }
 
 static void classDecl(Compiler* compiler){
@@ -708,8 +1322,8 @@ static void classDecl(Compiler* compiler){
             emitABC(compiler, OP_LOADNULL, valReg, 0, 0);
         }
 
-        reserveReg(compiler, 1); // reserve register for field value
-        int keyReg = getFreeReg(compiler);
+        reserveReg(compiler, 1); // reserve register for field name
+        int keyReg = getFreeReg(compiler) - 1;
         emitABx(compiler, OP_LOADK, keyReg, fieldNameIndex);
         
         emitABC(compiler, OP_FIELD, classReg, keyReg, valReg);
@@ -832,8 +1446,10 @@ static void endScope(Compiler* compiler){
     compiler->scopeDepth--;
     while(compiler->localCnt > 0 && 
         compiler->locals[compiler->localCnt-1].depth > compiler->scopeDepth){
-            int closedReg = compiler->locals[compiler->localCnt - 1].reg;
-            emitABC(compiler, OP_CLOSE_UPVAL, closedReg, 0, 0);
+            Local* local = &compiler->locals[compiler->localCnt - 1];
+            if(releaseLocal(compiler, local)){
+                emitABC(compiler, OP_CLOSE_UPVAL, local->reg, 0, 0);
+            }
             compiler->localCnt--;
     }
 
@@ -891,7 +1507,7 @@ static bool match(Compiler* compiler, TokenType type){
     return true;
 }
 
-static void sync(Compiler* compiler){
+static void synchronize(Compiler* compiler){
     compiler->parser.panic = false;
     while(compiler->parser.cur.type != TOKEN_EOF){
         if(compiler->parser.pre.type == TOKEN_SEMICOLON){
@@ -954,8 +1570,9 @@ static void ifStmt(Compiler* compiler){
 
         if(GET_OPCODE(instFalse) == OP_LOADBOOL && GET_OPCODE(instTrue) == OP_LOADBOOL){
             OpCode cmpOp = GET_OPCODE(instCmp);
-            if(cmpOp == OP_LT || cmpOp == OP_LE || cmpOp == OP_EQ){
-                compiler->func->chunk.count -= 2;
+            if(cmpOp == OP_LT || cmpOp == OP_LE || cmpOp == OP_EQ ||
+                cmpOp == OP_LT_NN || cmpOp == OP_LE_NN){
+                truncateChunk(&compiler->func->chunk, compiler->func->chunk.count - 2);
                 freeRegs(compiler, 1);  // free targetReg
 
                 // expect False
@@ -1030,8 +1647,9 @@ static void whileStmt(Compiler* compiler){
 
         if(GET_OPCODE(instFalse) == OP_LOADBOOL && GET_OPCODE(instTrue) == OP_LOADBOOL){
             OpCode cmpOp = GET_OPCODE(instCmp);
-            if(cmpOp == OP_LT || cmpOp == OP_LE || cmpOp == OP_EQ){
-                compiler->func->chunk.count -= 2;
+            if(cmpOp == OP_LT || cmpOp == OP_LE || cmpOp == OP_EQ ||
+                cmpOp == OP_LT_NN || cmpOp == OP_LE_NN){
+                truncateChunk(&compiler->func->chunk, compiler->func->chunk.count - 2);
                 freeRegs(compiler, 1);  // free targetReg
 
                 // expect False
@@ -1100,6 +1718,7 @@ static void forStmt(Compiler* compiler){
             emitABC(compiler, OP_LOADNULL, stateReg, 0, 0);
 
             addLocal(compiler, varName);
+            compiler->locals[compiler->localCnt - 1].isAssigned = true;   // by OP_FOREACH
             reserveReg(compiler, 1);
             defineVar(compiler, 0);
             consume(compiler, TOKEN_RIGHT_PAREN, "Expect ')' after foreach variable.");
@@ -1110,6 +1729,7 @@ static void forStmt(Compiler* compiler){
             if(match(compiler, TOKEN_ASSIGN)){
                 ExprDesc initExpr;
                 expression(compiler, &initExpr);
+                storeLocalType(compiler, reg, &initExpr, true);
                 expr2Reg(compiler, &initExpr, reg);
             }else{
                 emitABC(compiler, OP_LOADNULL, reg, 0, 0);
@@ -1211,27 +1831,257 @@ static void breakStmt(Compiler* compiler){
         errorAt(compiler, &compiler->parser.pre, "Cannot use 'break' outside of a loop.");
         return;
     }
-    consume(compiler, TOKEN_SEMICOLON, "Expect ';' after 'break'.");
+    consume(compiler, TOKEN_SEMICOLON, "Expect ';' after 'break'.");
+
+    Loop *loop = &compiler->loops[compiler->loopCnt - 1];
+    closeUpvalues(compiler, loop->scopeDepth);
+    if(loop->breakCnt == LOOP_MAX){
+        errorAt(compiler, &compiler->parser.pre, "Too many breaks in one loop.");
+        return;
+    }
+    loop->breakJump[loop->breakCnt++] = emitJmp(compiler);
+}
+
+static void continueStmt(Compiler* compiler){
+    if(compiler->loopCnt == 0){
+        errorAt(compiler, &compiler->parser.pre, "Cannot use 'continue' outside of a loop.");
+        return;
+    }
+    consume(compiler, TOKEN_SEMICOLON, "Expect ';' after 'continue'.");
+
+    Loop *loop = &compiler->loops[compiler->loopCnt - 1];
+    closeUpvalues(compiler, loop->scopeDepth);
+    emitLoop(compiler, loop->start);
+}
+
+static bool skipSwitchArm(Token* token){
+    // an arm body is a block or a simple statement ending in ';'
+    int depth = 0;
+    if(token->type == TOKEN_LEFT_BRACE){
+        do{
+            *token = scan();
+            if(token->type == TOKEN_LEFT_BRACE) depth++;
+            if(token->type == TOKEN_RIGHT_BRACE) depth--;
+            if(token->type == TOKEN_EOF || token->type == TOKEN_ERROR) return false;
+        }while(depth >= 0);
+        *token = scan();
+        return true;
+    }
+
+    while(depth > 0 || token->type != TOKEN_SEMICOLON){
+        switch(token->type){
+            case TOKEN_LEFT_PAREN:
+            case TOKEN_LEFT_BRACKET:
+            case TOKEN_LEFT_BRACE:
+                depth++;
+                break;
+            case TOKEN_RIGHT_PAREN:
+            case TOKEN_RIGHT_BRACKET:
+            case TOKEN_RIGHT_BRACE:
+                if(--depth < 0) return false;
+                break;
+            case TOKEN_EOF:
+            case TOKEN_ERROR:
+                return false;
+            default:
+                break;
+        }
+        *token = scan();
+    }
+    *token = scan();
+    return true;
+}
+
+static bool scanSwitchLabels(Compiler* compiler){
+    /*
+     * Looks ahead over the switch body. A jump table is possible only if
+     * every case label is a number or plain string literal and default,
+     * if any, is the last arm (an earlier default falls into the arms
+     * after it, which a table cannot express).
+    */
+    Scanner state = saveScanner();
+    setScannerQuiet(true);
+
+    Token token = compiler->parser.cur;
+    int labelCnt = 0;
+    bool hasDefault = false;
+    bool ok = true;
+
+    while(ok && token.type != TOKEN_RIGHT_BRACE){
+        if(hasDefault){
+            ok = false;
+            break;
+        }
+
+        if(token.type == TOKEN_DEFAULT){
+            hasDefault = true;
+            token = scan();
+        }else{
+            while(ok){
+                if(token.type == TOKEN_MINUS){
+                    token = scan();
+                    ok = token.type == TOKEN_NUMBER;
+                }
+
+                if(token.type == TOKEN_NUMBER){
+                    token = scan();
+                }else if(token.type == TOKEN_STRING_START){
+                    token = scan();
+                    if(token.type == TOKEN_INTERPOLATION_CONTENT){
+                        token = scan();
+                    }
+                    ok = ok && token.type == TOKEN_STRING_END;
+                    token = scan();
+                }else{
+                    ok = false;
+                }
+                labelCnt++;
+
+                if(token.type != TOKEN_COMMA){
+                    break;
+                }
+                token = scan();
+            }
+        }
+
+        if(!ok || token.type != TOKEN_FAT_ARROW){
+            ok = false;
+            break;
+        }
+        token = scan();
+        ok = skipSwitchArm(&token);
+    }
+
+    restoreScanner(state);
+    return ok && labelCnt >= SWITCH_TABLE_MIN;
+}
+
+static void switchTable(Compiler* compiler, int condReg){
+    /*
+     * | OP_SWITCH cond K | OP_JMP default | arm 1 | OP_JMP end | ... | default | end
+     * The table is filled with offsets from the instruction after OP_SWITCH
+     * once all arms have been compiled.
+    */
+    VM* vm = compiler->vm;
+    int switchIndex = emitABx(compiler, OP_SWITCH, condReg, 0);
+    int defaultJmp = emitJmp(compiler);
+
+    int caseCnt = 0;
+    int caseCapacity = 0;
+    Value* caseValues = NULL;
+    int* caseTargets = NULL;
+    int endJmpCnt = 0;
+    int endJmpCapacity = 0;
+    int* endJmps = NULL;
+
+    while(!checkType(compiler, TOKEN_RIGHT_BRACE) && !checkType(compiler, TOKEN_EOF)){
+        if(match(compiler, TOKEN_DEFAULT)){
+            consume(compiler, TOKEN_FAT_ARROW, "Expect '=>' after 'default'.");
+            patchJump(compiler, defaultJmp);
+            defaultJmp = -1;
+            stmt(compiler);
+            continue;
+        }
+
+        int firstCase = caseCnt;
+        do{
+            ExprDesc caseExpr;
+            expression(compiler, &caseExpr);
+
+            Value value = NULL_VAL;
+            if(caseExpr.type == EXPR_NUM){
+                value = NUM_VAL(caseExpr.data.num);
+            }else if(caseExpr.type == EXPR_K){
+                value = compiler->func->chunk.constants.values[caseExpr.data.loc.index];
+            }else{
+                errorAt(compiler, &compiler->parser.pre, "Expect literal case label.");
+            }
+
+            if(caseCnt == caseCapacity){
+                int newCapacity = GROW_CAPACITY(caseCapacity);
+                caseValues = (Value*)arenaGrow(compiler->arena, caseValues, 
+                    sizeof(Value) * caseCapacity, sizeof(Value) * newCapacity);
+                caseTargets = (int*)arenaGrow(compiler->arena, caseTargets, 
+                    sizeof(int) * caseCapacity, sizeof(int) * newCapacity);
+                caseCapacity = newCapacity;
+            }
+            caseValues[caseCnt++] = value;
+        }while(match(compiler, TOKEN_COMMA));
+
+        consume(compiler, TOKEN_FAT_ARROW, "Expect '=>' after case expressions.");
+        for(int i = firstCase; i < caseCnt; i++){
+            caseTargets[i] = compiler->func->chunk.count - (switchIndex + 1);
+        }
+
+        stmt(compiler);
+
+        if(endJmpCnt == endJmpCapacity){
+            int newCapacity = GROW_CAPACITY(endJmpCapacity);
+            endJmps = (int*)arenaGrow(compiler->arena, endJmps, 
+                sizeof(int) * endJmpCapacity, sizeof(int) * newCapacity);
+            endJmpCapacity = newCapacity;
+        }
+        endJmps[endJmpCnt++] = emitJmp(compiler);
+    }
+
+    if(defaultJmp != -1){
+        patchJump(compiler, defaultJmp);
+    }   // no default, leave the switch
+
+    for(int i = 0; i < endJmpCnt; i++){
+        patchJump(compiler, endJmps[i]);
+    }
 
-    Loop *loop = &compiler->loops[compiler->loopCnt - 1];
-    closeUpvalues(compiler, loop->scopeDepth);
-    if(loop->breakCnt == LOOP_MAX){
-        errorAt(compiler, &compiler->parser.pre, "Too many breaks in one loop.");
-        return;
+    // integer cases that span a small range index a list, the rest a map
+    bool isDense = true;
+    double minCase = 0;
+    double maxCase = 0;
+    for(int i = 0; i < caseCnt; i++){
+        if(!IS_NUM(caseValues[i]) || AS_NUM(caseValues[i]) != floor(AS_NUM(caseValues[i]))){
+            isDense = false;
+            break;
+        }
+        double num = AS_NUM(caseValues[i]);
+        if(i == 0 || num < minCase) minCase = num;
+        if(i == 0 || num > maxCase) maxCase = num;
+    }
+    if(isDense && maxCase - minCase + 1 > caseCnt * 2 + 8){
+        isDense = false;
+    }
+
+    Value table;
+    if(isDense){
+        int span = (int)(maxCase - minCase) + 1;
+        ObjectList* jumps = newList(vm);
+        push(vm, OBJECT_VAL(jumps));
+        appendToList(vm, jumps, NUM_VAL(minCase));
+        for(int i = 0; i < span; i++){
+            appendToList(vm, jumps, NUM_VAL(0));
+        }
+        for(int i = 0; i < caseCnt; i++){
+            int slot = (int)(AS_NUM(caseValues[i]) - minCase) + 1;
+            if(AS_NUM(jumps->items[slot]) == 0){
+                jumps->items[slot] = NUM_VAL(caseTargets[i]);
+            }   // the first of duplicate labels wins, as with a compare chain
+        }
+        table = OBJECT_VAL(jumps);
+    }else{
+        ObjectMap* jumps = newMap(vm);
+        push(vm, OBJECT_VAL(jumps));
+        for(int i = 0; i < caseCnt; i++){
+            Value existing;
+            if(!tableGet(vm, &jumps->table, caseValues[i], &existing)){
+                tableSet(vm, &jumps->table, caseValues[i], NUM_VAL(caseTargets[i]));
+            }
+        }
+        table = OBJECT_VAL(jumps);
     }
-    loop->breakJump[loop->breakCnt++] = emitJmp(compiler);
-}
 
-static void continueStmt(Compiler* compiler){
-    if(compiler->loopCnt == 0){
-        errorAt(compiler, &compiler->parser.pre, "Cannot use 'continue' outside of a loop.");
-        return;
-    }
-    consume(compiler, TOKEN_SEMICOLON, "Expect ';' after 'continue'.");
+    int tableConst = makeConstant(compiler, table);
+    pop(vm);
 
-    Loop *loop = &compiler->loops[compiler->loopCnt - 1];
-    closeUpvalues(compiler, loop->scopeDepth);
-    emitLoop(compiler, loop->start);
+    Instruction* code = compiler->func->chunk.code;
+    code[switchIndex] = CREATE_ABx(OP_SWITCH, condReg, tableConst);
 }
 
 static void switchStmt(Compiler* compiler){
@@ -1245,6 +2095,13 @@ static void switchStmt(Compiler* compiler){
 
     consume(compiler, TOKEN_LEFT_BRACE, "Expect '{' before switch body.");
 
+    if(scanSwitchLabels(compiler)){
+        switchTable(compiler, condReg);
+        consume(compiler, TOKEN_RIGHT_BRACE, "Expect '}' after switch body.");
+        freeExpr(compiler, &condExpr);
+        return;
+    }
+
     int endJmps[CASE_MAX];
     int endJmpCnt = 0;
 
@@ -1329,11 +2186,7 @@ static void systemStmt(Compiler* compiler){
 }
 
 static void deferStmt(Compiler* compiler){
-    Compiler* funcCompiler = (Compiler*)reallocate(compiler->vm, NULL, 0, sizeof(Compiler));
-    if(funcCompiler == NULL){
-        errorAt(compiler, &compiler->parser.pre, "Not enough memory for defer.");
-        return;
-    }
+    Compiler* funcCompiler = acquireCompiler(compiler->arena);
 
     funcCompiler->parser = compiler->parser;
     funcCompiler->enclosing = compiler;
@@ -1357,7 +2210,7 @@ static void deferStmt(Compiler* compiler){
 
     compiler->parser = funcCompiler->parser;
     compiler->vm->compiler = compiler;
-    reallocate(compiler->vm, funcCompiler, sizeof(Compiler), 0);
+    releaseCompiler(funcCompiler);
 
     freeRegs(compiler, 1);  // free defer function register
 }
@@ -1424,13 +2277,20 @@ static void parsePrecedence(Compiler* compiler, ExprDesc* expr, Precedence prece
             expression(compiler, &valExpr);
             expr2NextReg(compiler, &valExpr);
 
-            emitABC(
+            bool isNum = exprIsNum(compiler, &augendExpr) && exprIsNum(compiler, &valExpr);
+            uint64_t deps = augendExpr.numDeps | valExpr.numDeps;
+
+            emitNumOp(
                 compiler, 
                 OP_ADD, 
                 augendExpr.data.loc.index, 
                 augendExpr.data.loc.index, 
-                valExpr.data.loc.index
+                valExpr.data.loc.index,
+                isNum,
+                deps
             );
+            augendExpr.isNum = isNum;
+            augendExpr.numDeps = isNum ? deps : 0;
 
             freeExpr(compiler, &valExpr);
 
@@ -1445,13 +2305,17 @@ static void parsePrecedence(Compiler* compiler, ExprDesc* expr, Precedence prece
             expression(compiler, &valExpr);
             expr2NextReg(compiler, &valExpr);
 
-            emitABC(
+            emitNumOp(
                 compiler, 
                 OP_SUB, 
                 minuendExpr.data.loc.index, 
                 minuendExpr.data.loc.index, 
-                valExpr.data.loc.index
+                valExpr.data.loc.index,
+                exprIsNum(compiler, &minuendExpr) && exprIsNum(compiler, &valExpr),
+                minuendExpr.numDeps | valExpr.numDeps
             );
+            minuendExpr.isNum = true;
+            minuendExpr.numDeps = 0;
 
             freeExpr(compiler, &valExpr);
 
@@ -1469,6 +2333,7 @@ static void handlePostfix(Compiler* compiler, ExprDesc* expr, bool canAssign){
 
     TokenType type = compiler->parser.pre.type;
     ExprDesc lval = *expr;
+    bool isNum = exprIsNum(compiler, expr);
 
     expr2NextReg(compiler, expr);
 
@@ -1493,20 +2358,24 @@ static void handlePostfix(Compiler* compiler, ExprDesc* expr, bool canAssign){
     );
 
     if(type == TOKEN_PLUS_PLUS){
-        emitABC(
+        emitNumOp(
             compiler,
             OP_ADD,
             mathReg,
             mathReg,
-            oneReg
+            oneReg,
+            isNum,
+            expr->numDeps
         );
     }else if(type == TOKEN_MINUS_MINUS){
-        emitABC(
+        emitNumOp(
             compiler,
             OP_SUB,
             mathReg,
             mathReg,
-            oneReg
+            oneReg,
+            isNum,
+            expr->numDeps
         );
     }
 
@@ -1514,6 +2383,8 @@ static void handlePostfix(Compiler* compiler, ExprDesc* expr, bool canAssign){
 
     ExprDesc storeExpr;
     initExpr(&storeExpr, EXPR_REG, mathReg);
+    storeExpr.isNum = isNum || type == TOKEN_MINUS_MINUS;
+    storeExpr.numDeps = type == TOKEN_PLUS_PLUS ? expr->numDeps : 0;
     storeVar(compiler, &lval, &storeExpr);
 }
 
@@ -1528,6 +2399,7 @@ static void handlePrefix(Compiler* compiler, ExprDesc* expr, bool canAssign){
     }
 
     ExprDesc lval = *expr;
+    bool isNum = exprIsNum(compiler, expr);
 
     // for unary plus and minus, emit code to compute the value first before storing it back
     // e.g. -x => temp = x; temp = 0 - temp; x = temp;
@@ -1545,20 +2417,24 @@ static void handlePrefix(Compiler* compiler, ExprDesc* expr, bool canAssign){
     );
 
     if(type == TOKEN_PLUS_PLUS){
-        emitABC(
+        emitNumOp(
             compiler,
             OP_ADD,
             expr->data.loc.index,
             expr->data.loc.index,
-            oneReg
+            oneReg,
+            isNum,
+            expr->numDeps
         );
     }else if(type == TOKEN_MINUS_MINUS){
-        emitABC(
+        emitNumOp(
             compiler,
             OP_SUB,
             expr->data.loc.index,
             expr->data.loc.index,
-            oneReg
+            oneReg,
+            isNum,
+            expr->numDeps
         );
     }
 
@@ -1576,7 +2452,12 @@ static void handlePrefix(Compiler* compiler, ExprDesc* expr, bool canAssign){
 
     ExprDesc storeExpr;
     initExpr(&storeExpr, EXPR_REG, storeReg);
+    storeExpr.isNum = isNum || type == TOKEN_MINUS_MINUS;
+    storeExpr.numDeps = type == TOKEN_PLUS_PLUS ? expr->numDeps : 0;
     storeVar(compiler, &lval, &storeExpr);
+
+    expr->isNum = storeExpr.isNum;
+    expr->numDeps = storeExpr.numDeps;
 }
 
 static int identifierConst(Compiler* compiler){
@@ -1611,7 +2492,7 @@ static void addLocal(Compiler* compiler, Token name){
         errorAt(compiler, &name, "Too many local variables");
         return;
     }
-    Local* local = &compiler->locals[compiler->localCnt++];
+    Local* local = pushLocal(compiler);
     local->name = name;
     local->depth = -1;  // sentinel, decl-ed but not def-ed
 
@@ -1686,6 +2567,17 @@ static int addUpvalue(Compiler* compiler, uint16_t index, bool isLocal){
         return 0;
     }
 
+    if(compiler->upvalueCnt == compiler->upvalueCapacity){
+        int newCapacity = GROW_CAPACITY(compiler->upvalueCapacity);
+        compiler->upvalues = (Upvalue*)arenaGrow(
+            compiler->arena,
+            compiler->upvalues,
+            sizeof(Upvalue) * compiler->upvalueCapacity,
+            sizeof(Upvalue) * newCapacity
+        );
+        compiler->upvalueCapacity = newCapacity;
+    }
+
     compiler->upvalues[compiler->upvalueCnt].isLocal = isLocal;
     compiler->upvalues[compiler->upvalueCnt].index = index;
     compiler->func->upvalueCnt = compiler->upvalueCnt + 1;
@@ -1697,6 +2589,15 @@ static int resolveUpvalue(Compiler* compiler, Token* name){
     
     int localIndex = resolveLocal(compiler->enclosing, name);
     if(localIndex != -1){
+        // a closure may store anything into it
+        int index = localIndexForReg(compiler->enclosing, localIndex);
+        if(index != -1){
+            downgradeLocal(compiler->enclosing, index);
+            Local* local = &compiler->enclosing->locals[index];
+            if(local->capturedAt == -1){
+                local->capturedAt = (int)compiler->enclosing->func->chunk.count;
+            }
+        }
         return addUpvalue(compiler, (uint16_t)localIndex, true);
     }
 
@@ -1730,10 +2631,116 @@ static void emitLoop(Compiler* compiler, int loopStart){
 static void emitClosure(Compiler* compiler, int destReg, int constIndex, Compiler* funcCompiler){
     emitABx(compiler, OP_CLOSURE, destReg, constIndex);
     for(int i = 0; i < funcCompiler->upvalueCnt; i++){
-        int isLocal = funcCompiler->upvalues[i].isLocal ? 1 : 0;
+        CaptureKind kind = funcCompiler->upvalues[i].isLocal ? CAPTURE_LOCAL : CAPTURE_UPVAL;
         int index = funcCompiler->upvalues[i].index;
-        emitABC(compiler, OP_LOADNULL, 0, isLocal, index);
+        emitABC(compiler, OP_LOADNULL, 0, kind, index);
+    }
+}
+
+static void markAssigned(Compiler* compiler, int reg){
+    int index = localIndexForReg(compiler, reg);
+    if(index != -1){
+        compiler->locals[index].isAssigned = true;
+    }
+}
+
+static void markUpvalueAssigned(Compiler* compiler, int index){
+    // follow the upvalue out to the local it captures
+    Upvalue* upvalue = &compiler->upvalues[index];
+    if(upvalue->isLocal){
+        markAssigned(compiler->enclosing, upvalue->index);
+    }else{
+        markUpvalueAssigned(compiler->enclosing, upvalue->index);
+    }
+}
+
+/*
+ * A captured local is only known to be final once it leaves scope, so
+ * the closures made in the meantime are patched then: their captures
+ * of it become copies, and so do those of functions nested in them
+ * that pass it on. With apply false nothing is written, it only checks
+ * that every upvalue on the way is below FLAT_UPVALUE_MAX.
+*/
+static bool flattenUpvalue(ObjectFunc* func, int slot, bool apply);
+
+static bool flattenCaptures(Chunk* chunk, size_t offset, CaptureKind kind, int index, bool apply){
+    ObjectFunc* func = AS_FUNC(chunk->constants.values[GET_ARG_Bx(chunk->code[offset])]);
+
+    for(int i = 0; i < func->upvalueCnt; i++){
+        Instruction* capture = &chunk->code[offset + 1 + i];
+        if(GET_ARG_B(*capture) != kind || GET_ARG_C(*capture) != index){
+            continue;
+        }
+        if(!flattenUpvalue(func, i, apply)){
+            return false;
+        }
+        if(apply){
+            CaptureKind flat = kind == CAPTURE_LOCAL ? CAPTURE_FLAT_LOCAL : CAPTURE_FLAT_UPVAL;
+            *capture = CREATE_ABC(OP_LOADNULL, 0, flat, index);
+        }
+    }
+    return true;
+}
+
+static bool flattenUpvalue(ObjectFunc* func, int slot, bool apply){
+    if(slot >= FLAT_UPVALUE_MAX){
+        return false;
+    }
+    if(apply){
+        func->flatUpvalues |= (uint64_t)1 << slot;
+    }
+
+    Chunk* chunk = &func->chunk;
+    for(size_t i = 0; i < chunk->count; i++){
+        Instruction instruction = chunk->code[i];
+        OpCode op = GET_OPCODE(instruction);
+
+        if(op == OP_GET_UPVAL && GET_ARG_B(instruction) == slot){
+            if(apply){
+                chunk->code[i] = CREATE_ABC(
+                    OP_GET_UPVAL_FLAT,
+                    GET_ARG_A(instruction),
+                    slot,
+                    GET_ARG_C(instruction)
+                );
+            }
+        }else if(op == OP_CLOSURE){
+            if(!flattenCaptures(chunk, i, CAPTURE_UPVAL, slot, apply)){
+                return false;
+            }
+            i += AS_FUNC(chunk->constants.values[GET_ARG_Bx(instruction)])->upvalueCnt;
+        }
+    }
+    return true;
+}
+
+static bool flattenLocal(Compiler* compiler, Local* local, bool apply){
+    Chunk* chunk = &compiler->func->chunk;
+
+    // the register belongs to this local from its first capture on
+    for(size_t i = (size_t)local->capturedAt; i < chunk->count; i++){
+        Instruction instruction = chunk->code[i];
+        if(GET_OPCODE(instruction) != OP_CLOSURE){
+            continue;
+        }
+        if(!flattenCaptures(chunk, i, CAPTURE_LOCAL, local->reg, apply)){
+            return false;
+        }
+        i += AS_FUNC(chunk->constants.values[GET_ARG_Bx(instruction)])->upvalueCnt;
+    }
+    return true;
+}
+
+// true if the local is still shared through upvalues that must be closed
+static bool releaseLocal(Compiler* compiler, Local* local){
+    if(local->capturedAt == -1){
+        return false;
+    }
+    if(local->isAssigned || !flattenLocal(compiler, local, false)){
+        return true;
     }
+    flattenLocal(compiler, local, true);
+    return false;
 }
 
 static void patchJump(Compiler* compiler, int jmpIndex){
@@ -1752,20 +2759,27 @@ static ObjectFunc* stopCompiler(Compiler* compiler){
         emitABC(compiler, OP_RETURN, 0, 2, 0);
     }else{
         int reg = getFreeReg(compiler);
+        reserveReg(compiler, 1);    // counted in maxRegSlots like any other
         emitABC(compiler, OP_LOADNULL, reg, 0, 0);
         emitABC(compiler, OP_RETURN, reg, 2, 0);
     }
 
     ObjectFunc* func = compiler->func;
 
+    // the outermost locals never see endScope(), their captures are final now
+    for(int i = compiler->localCnt - 1; i >= 0; i--){
+        releaseLocal(compiler, &compiler->locals[i]);
+    }
+
     func->maxRegSlots = compiler->maxRegSlots;
+    shrinkChunk(compiler->vm, &func->chunk);
 
     #ifdef DEBUG_PRINT_CODE
     if(!compiler->parser.hadError){
         printf("== Compiled code: %s ==\n", func->name != NULL ? func->name->chars : "<script>");
         dasmChunk(
             &compiler->func->chunk, 
-            func->name != NULL ? func->name->chars : "<script>"
+            func->name != NULL ? func->name->chars : "<script>",
             compiler->globals
         );
     }
@@ -1778,9 +2792,90 @@ static void handleNum(Compiler* compiler, ExprDesc* expr, bool canAssign){
     double value = strtod(compiler->parser.pre.head, NULL);
     initExpr(expr, EXPR_NUM, 0);
     expr->data.num = value;
+    expr->isNum = true;
+}
+
+static uint32_t constHash(Value value){
+    uint64_t hash = (uint64_t)value;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return (uint32_t)hash;
+}
+
+static ConstSlot* findConstSlot(ConstSlot* slots, int capacity, Value value){
+    // stops at the entry for value or at a never used slot
+    int index = (int)(constHash(value) & (uint32_t)(capacity - 1));
+    while(slots[index].index != CONST_SLOT_FREE &&
+          (slots[index].index == CONST_SLOT_DROPPED || slots[index].value != value)){
+        index = (index + 1) & (capacity - 1);
+    }
+    return &slots[index];
+}
+
+static void rememberConstant(Compiler* compiler, Value value, int constIndex){
+    if((compiler->constSlotCnt + 1) * 4 > compiler->constSlotCapacity * 3){
+        int capacity = compiler->constSlotCapacity < CONST_SLOT_INIT ? CONST_SLOT_INIT : compiler->constSlotCapacity * 2;
+        ConstSlot* slots = (ConstSlot*)arenaAlloc(compiler->arena, sizeof(ConstSlot) * capacity);
+        for(int i = 0; i < capacity; i++){
+            slots[i].index = CONST_SLOT_FREE;
+        }
+
+        int count = 0;
+        for(int i = 0; i < compiler->constSlotCapacity; i++){
+            ConstSlot* slot = &compiler->constSlots[i];
+            if(slot->index >= 0){
+                *findConstSlot(slots, capacity, slot->value) = *slot;
+                count++;
+            }
+        }
+
+        compiler->constSlots = slots;
+        compiler->constSlotCapacity = capacity;
+        compiler->constSlotCnt = count;
+    }
+
+    ConstSlot* slot = findConstSlot(compiler->constSlots, compiler->constSlotCapacity, value);
+    slot->value = value;
+    slot->index = constIndex;
+    compiler->constSlotCnt++;
+}
+
+static void countConstantUse(Compiler* compiler, int constIndex){
+    if(constIndex >= compiler->constUseCapacity){
+        int capacity = compiler->constUseCapacity < CONST_SLOT_INIT ? CONST_SLOT_INIT : compiler->constUseCapacity;
+        while(capacity <= constIndex){
+            capacity *= 2;
+        }
+        compiler->constUses = (int*)arenaGrow(
+            compiler->arena,
+            compiler->constUses,
+            sizeof(int) * compiler->constUseCapacity,
+            sizeof(int) * capacity
+        );
+        compiler->constUseCapacity = capacity;
+    }
+
+    if(constIndex >= compiler->constUseCnt){
+        for(int i = compiler->constUseCnt; i <= constIndex; i++){
+            compiler->constUses[i] = 0;
+        }
+        compiler->constUseCnt = constIndex + 1;
+    }
+    compiler->constUses[constIndex]++;
 }
 
 static int makeConstant(Compiler* compiler, Value value){
+    // numbers and interned strings are the same constant exactly when their bits match
+    bool shared = IS_NUM(value) || IS_STRING(value);
+    if(shared && compiler->constSlotCnt > 0){
+        ConstSlot* slot = findConstSlot(compiler->constSlots, compiler->constSlotCapacity, value);
+        if(slot->index >= 0){
+            countConstantUse(compiler, slot->index);
+            return slot->index;
+        }
+    }
+
     push(compiler->vm, value);
     int constIndex = addConstant(compiler->vm, &compiler->func->chunk, value);
     pop(compiler->vm);
@@ -1792,6 +2887,11 @@ static int makeConstant(Compiler* compiler, Value value){
         errorAt(compiler, &compiler->parser.pre, "Too many constants in one chunk.");
         return 0;
     }
+
+    if(shared){
+        rememberConstant(compiler, value, constIndex);
+    }
+    countConstantUse(compiler, constIndex);
     return constIndex;
 }
 
@@ -1800,7 +2900,12 @@ static void handleVar(Compiler* compiler, ExprDesc* expr, bool canAssign){
 
     int index = resolveLocal(compiler, name);
     if(index != -1){
-        initExpr(expr, EXPR_LOCAL, index);
+        int localIndex = localIndexForReg(compiler, index);
+        if(localIndex != -1 && compiler->locals[localIndex].agg != NULL){
+            scalarElement(compiler, expr, compiler->locals[localIndex].agg);
+        }else{
+            initLocalExpr(compiler, expr, index);
+        }
     }else if((index = resolveUpvalue(compiler, name)) != -1){
         initExpr(expr, EXPR_UPVAL, index);
     }else{
@@ -1809,6 +2914,48 @@ static void handleVar(Compiler* compiler, ExprDesc* expr, bool canAssign){
     }
 }
 
+static void initLocalExpr(Compiler* compiler, ExprDesc* expr, int reg){
+    initExpr(expr, EXPR_LOCAL, reg);
+    int localIndex = localIndexForReg(compiler, reg);
+    if(localIndex != -1 && compiler->locals[localIndex].isNum){
+        expr->isNum = true;
+        expr->numDeps = (uint64_t)1 << localIndex;
+    }
+}
+
+static void scalarElement(Compiler* compiler, ExprDesc* expr, ScalarAgg* agg){
+    // subscripts were validated by scanScalarAgg()
+    consume(compiler, TOKEN_LEFT_BRACKET, "Expect '[' after name.");
+
+    int slot = -1;
+    if(agg->keys == NULL){
+        consume(compiler, TOKEN_NUMBER, "Expect index.");
+        slot = (int)strtod(compiler->parser.pre.head, NULL);
+    }else{
+        consume(compiler, TOKEN_STRING_START, "Expect map key.");
+        Token key = compiler->parser.cur;
+        key.len = 0;
+        if(checkType(compiler, TOKEN_INTERPOLATION_CONTENT)){
+            key = compiler->parser.cur;
+            advance(compiler);
+        }
+        consume(compiler, TOKEN_STRING_END, "Expect '\"' after map key.");
+
+        for(int i = 0; i < agg->count; i++){
+            if(agg->keys[i].len == key.len && memcmp(agg->keys[i].head, key.head, key.len) == 0){
+                slot = i;
+            }
+        }
+    }
+    consume(compiler, TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+
+    if(slot < 0 || slot >= agg->count){
+        errorAt(compiler, &compiler->parser.pre, "Invalid subscript.");
+        slot = 0;
+    }
+    initLocalExpr(compiler, expr, agg->baseReg + slot);
+}
+
 static void handleGrouping(Compiler* compiler, ExprDesc* expr, bool canAssign){
     expression(compiler, expr);
     consume(compiler, TOKEN_RIGHT_PAREN, "Expected ')' after expression");
@@ -1841,12 +2988,20 @@ static void handleUnary(Compiler* compiler, ExprDesc* expr, bool canAssign){
         default: return;  // Should not reach here
     }
     initExpr(expr, EXPR_REG, targetReg);
+    expr->isNum = type == TOKEN_MINUS;   // OP_NEG yields a number or raises
 }
 
 static void handleBinary(Compiler* compiler, ExprDesc* expr, bool canAssign){
     TokenType type = compiler->parser.pre.type;
     ParseRule* rule = getRule(type);
 
+    // load the left operand first, or a pending operation would get its
+    // register after the right operand's code has used it; literals stay for folding
+    Value literal;
+    if(!literalValue(compiler, expr, &literal)){
+        expr2AnyReg(compiler, expr);
+    }
+
     ExprDesc right;
     parsePrecedence(compiler, &right, (Precedence)(rule->precedence + 1));  // parse the right-hand side, parse only if precedence is higher
     // parse the right-hand side, parse only if precedence is higher
@@ -1892,6 +3047,10 @@ static void handleBinary(Compiler* compiler, ExprDesc* expr, bool canAssign){
         }
     }
 
+    if((type == TOKEN_PLUS || type == TOKEN_SLASH) && foldString(compiler, type, expr, &right)){
+        return;
+    }
+
     switch(type){
         case TOKEN_PLUS:            emitBinaryOp(compiler, OP_ADD, expr, &right); break;
         case TOKEN_MINUS:           emitBinaryOp(compiler, OP_SUB, expr, &right); break;
@@ -1916,12 +3075,15 @@ static void handleBinary(Compiler* compiler, ExprDesc* expr, bool canAssign){
                 default:                    op = OP_EQ; break;  // Should not reach here
             }
             
-            expr2NextReg(compiler, expr);
+            bool isNum = exprIsNum(compiler, expr) && exprIsNum(compiler, &right);
+            uint64_t deps = expr->numDeps | right.numDeps;
+
+            expr2AnyReg(compiler, expr);
             expr2NextReg(compiler, &right);
             freeExpr(compiler, &right);
             freeExpr(compiler, expr);
 
-            emitABC(compiler, op, expectTrue, expr->data.loc.index, right.data.loc.index);
+            emitNumOp(compiler, op, expectTrue, expr->data.loc.index, right.data.loc.index, isNum, deps);
             reserveReg(compiler, 1);
             int targetReg = getFreeReg(compiler) - 1;
             emitABC(compiler, OP_LOADBOOL, targetReg, 1, 1);
@@ -1975,99 +3137,210 @@ static void handleLiteral(Compiler* compiler, ExprDesc* expr,  bool canAssign){
     }
 }
 
+static bool literalValue(Compiler* compiler, ExprDesc* expr, Value* value){
+    switch(expr->type){
+        case EXPR_NULL:     *value = NULL_VAL; return true;
+        case EXPR_TRUE:     *value = BOOL_VAL(true); return true;
+        case EXPR_FALSE:    *value = BOOL_VAL(false); return true;
+        case EXPR_NUM:      *value = NUM_VAL(expr->data.num); return true;
+        case EXPR_K:
+            *value = compiler->func->chunk.constants.values[expr->data.loc.index];
+            return true;
+        default:            return false;
+    }
+}
+
+static void dropConstant(Compiler* compiler, ExprDesc* expr){
+    // a folded operand's constant is unused if nothing was added after it
+    // and no other expression was handed the same shared constant
+    ValueArray* constants = &compiler->func->chunk.constants;
+    int index = expr->data.loc.index;
+    if(expr->type != EXPR_K || index != (int)constants->count - 1 ||
+       index >= compiler->constUseCnt || compiler->constUses[index] != 1){
+        return;
+    }
+
+    Value value = constants->values[index];
+    if(compiler->constSlotCnt > 0){
+        ConstSlot* slot = findConstSlot(compiler->constSlots, compiler->constSlotCapacity, value);
+        if(slot->index == index){
+            slot->index = CONST_SLOT_DROPPED;
+        }
+    }
+    compiler->constUses[index] = 0;
+    compiler->constUseCnt = index;
+    constants->count--;
+}
+
+static bool foldString(Compiler* compiler, TokenType type, ExprDesc* left, ExprDesc* right){
+    VM* vm = compiler->vm;
+    Value a, b;
+    if(!literalValue(compiler, left, &a) || !literalValue(compiler, right, &b)){
+        return false;
+    }
+
+    if(type == TOKEN_SLASH){
+        if(!IS_STRING(a) || !IS_STRING(b)) return false;
+    }else if(!IS_STRING(a) && !IS_STRING(b)){
+        return false;
+    }
+
+    // OP_ADD stringifies the other operand, so do the same here
+    ObjectString* head = IS_STRING(a) ? AS_STRING(a) : toString(vm, a);
+    push(vm, OBJECT_VAL(head));
+    ObjectString* tail = IS_STRING(b) ? AS_STRING(b) : toString(vm, b);
+    push(vm, OBJECT_VAL(tail));
+
+    ObjectString* result = type == TOKEN_SLASH ? joinPathRaw(vm, head, tail) 
+                                               : concatStringRaw(vm, head, tail);
+    if(result == NULL){
+        // invalid path characters, leave the error to runtime
+        pop(vm);
+        pop(vm);
+        return false;
+    }
+
+    push(vm, OBJECT_VAL(result));
+    result = copyString(vm, result->chars, result->length);
+    pop(vm);
+    pop(vm);
+    pop(vm);
+
+    dropConstant(compiler, right);
+    dropConstant(compiler, left);
+    initExpr(left, EXPR_K, makeConstant(compiler, OBJECT_VAL(result)));
+    left->isNum = false;
+    return true;
+}
+
+static void appendLiteral(Compiler* compiler, char** buffer, int* len, int* capacity, const char* chars, int charsLen){
+    if(*len + charsLen > *capacity){
+        int newCapacity = *capacity < 8 ? 8 : *capacity;
+        while(newCapacity < *len + charsLen){
+            newCapacity *= 2;
+        }
+        *buffer = (char*)arenaGrow(compiler->arena, *buffer, *capacity, newCapacity);
+        *capacity = newCapacity;
+    }
+    memcpy(*buffer + *len, chars, charsLen);
+    *len += charsLen;
+}
+
+static void flushConcat(Compiler* compiler, int baseReg, int* partCnt){
+    // fold a full range into its first register so more parts can follow
+    if(*partCnt == 1){
+        emitABC(compiler, OP_TO_STRING, baseReg, baseReg, 0);
+        return;
+    }
+    emitABC(compiler, OP_CONCAT, baseReg, baseReg, *partCnt);
+    freeRegs(compiler, *partCnt - 1);
+    *partCnt = 1;
+}
+
+static void emitPendingText(Compiler* compiler, int baseReg, int* partCnt, const char* text, int len){
+    // the target register is already reserved
+    int idx = makeConstant(compiler, OBJECT_VAL(copyString(compiler->vm, text, len)));
+    emitABx(compiler, OP_LOADK, baseReg + *partCnt, idx);
+    (*partCnt)++;
+}
+
 static void handleString(Compiler* compiler, ExprDesc* expr, bool canAssign){
+    /*
+     * Parts are placed in consecutive registers from baseReg and joined
+     * by one OP_CONCAT. Adjacent literal text, including interpolated
+     * literals, collects in pending and takes a single register; a string
+     * with no runtime part folds into one interned constant.
+    */
+    VM* vm = compiler->vm;
     ExprDesc tmpExpr;
+    int baseReg = getFreeReg(compiler);
     int partCnt = 0;
-    int resReg = getFreeReg(compiler);
+    char* pending = NULL;
+    int pendingLen = 0;
+    int pendingCapacity = 0;
+    bool hasPending = false;
 
     while(compiler->parser.cur.type != TOKEN_STRING_END && compiler->parser.cur.type != TOKEN_EOF){
         if(compiler->parser.cur.type == TOKEN_INTERPOLATION_CONTENT){
             Token* token = &compiler->parser.cur;
 
-            char* unescaped_chars = malloc(token->len + 1);
-            if(unescaped_chars == NULL){
-                errorAt(compiler, token, "Memory Error while processing string.");
-                advance(compiler);
-                continue;
-            }
-
-            int unescaped_len = 0;
             for(int i = 0; i < token->len; i++){
-                if(token->head[i] == '\\' && i + 1 < token->len){
+                char c = token->head[i];
+                if(c == '\\' && i + 1 < token->len){
                     i++;
                     switch(token->head[i]){
-                        case 'a': unescaped_chars[unescaped_len++] = '\a'; break;
-                        case 'b': unescaped_chars[unescaped_len++] = '\b'; break;
-                        case 'f': unescaped_chars[unescaped_len++] = '\f'; break;
-                        case 'r': unescaped_chars[unescaped_len++] = '\r'; break;
-                        case 'n': unescaped_chars[unescaped_len++] = '\n'; break;
-                        case 'v': unescaped_chars[unescaped_len++] = '\v'; break;
-                        case 't': unescaped_chars[unescaped_len++] = '\t'; break;
-                        case '\\': unescaped_chars[unescaped_len++] = '\\'; break;
-                        case '"': unescaped_chars[unescaped_len++] = '"'; break;
-                        case '$': unescaped_chars[unescaped_len++] = '$'; break;
-                        case '0': unescaped_chars[unescaped_len++] = '\0'; break;
+                        case 'a': c = '\a'; break;
+                        case 'b': c = '\b'; break;
+                        case 'f': c = '\f'; break;
+                        case 'r': c = '\r'; break;
+                        case 'n': c = '\n'; break;
+                        case 'v': c = '\v'; break;
+                        case 't': c = '\t'; break;
+                        case '\\': c = '\\'; break;
+                        case '"': c = '"'; break;
+                        case '$': c = '$'; break;
+                        case '0': c = '\0'; break;
                         default: {
                             char err_msg[30];
                             snprintf(err_msg, sizeof(err_msg), "Invalid escape character '\\%c'.", token->head[i]);
                             errorAt(compiler, token, err_msg);
-                            unescaped_chars[unescaped_len++] = token->head[i]; 
+                            c = token->head[i]; 
                             break;
                         }
                     }
-                }else{
-                    unescaped_chars[unescaped_len++] = token->head[i];
                 }
+                appendLiteral(compiler, &pending, &pendingLen, &pendingCapacity, &c, 1);
             }
-
-            ObjectString* str = copyString(compiler->vm, unescaped_chars, unescaped_len);
-            free(unescaped_chars);
-            int idx = makeConstant(compiler, OBJECT_VAL(str));
-            initExpr(&tmpExpr, EXPR_K, idx);
-            if(partCnt == 0){
-                expr2Reg(compiler, &tmpExpr, resReg);
-                reserveReg(compiler, 1);
-            }else{
-                expr2NextReg(compiler, &tmpExpr);
-                emitABC(compiler, OP_ADD, resReg, resReg, tmpExpr.data.loc.index);
-                freeRegs(compiler, 1);
-            }
+            hasPending = true;
             advance(compiler);
         }else{
             consume(compiler, TOKEN_INTERPOLATION_START, "Expect string or interpolation.");
+            if(partCnt + 2 > CONCAT_MAX){
+                flushConcat(compiler, baseReg, &partCnt);
+            }
+            if(hasPending){
+                reserveReg(compiler, 1);    // keep a register for the pending text
+            }
             expression(compiler, &tmpExpr);
-            expr2NextReg(compiler, &tmpExpr);
-            emitABC(
-                compiler, 
-                OP_TO_STRING, 
-                tmpExpr.data.loc.index, 
-                tmpExpr.data.loc.index, 
-                0
-            );
 
-            if(partCnt == 0){
-                if(tmpExpr.data.loc.index != resReg){
-                    emitABC(compiler, OP_MOVE, resReg, tmpExpr.data.loc.index, 0);
+            Value literal;
+            if(literalValue(compiler, &tmpExpr, &literal)){
+                ObjectString* str = IS_STRING(literal) ? AS_STRING(literal) : toString(vm, literal);
+                appendLiteral(compiler, &pending, &pendingLen, &pendingCapacity, str->chars, str->length);
+                dropConstant(compiler, &tmpExpr);
+                if(hasPending){
+                    freeRegs(compiler, 1);
                 }
-                freeExpr(compiler, &tmpExpr);
-                reserveReg(compiler, 1);
+                hasPending = true;
             }else{
-                emitABC(compiler, OP_ADD, resReg, resReg, tmpExpr.data.loc.index);
+                if(hasPending){
+                    emitPendingText(compiler, baseReg, &partCnt, pending, pendingLen);
+                    pendingLen = 0;
+                    hasPending = false;
+                }
+                expr2Reg(compiler, &tmpExpr, baseReg + partCnt);
                 freeExpr(compiler, &tmpExpr);
+                reserveReg(compiler, 1);
+                partCnt++;
             }
             consume(compiler, TOKEN_INTERPOLATION_END, "Expect '}' after interpolation expression.");
         }
-        partCnt++;
     }
 
     consume(compiler, TOKEN_STRING_END, "Unterminated string.");
 
     if(partCnt == 0){
-        int idx = makeConstant(compiler, OBJECT_VAL(copyString(compiler->vm, "", 0)));
+        int idx = makeConstant(compiler, OBJECT_VAL(copyString(vm, pendingLen > 0 ? pending : "", pendingLen)));
         initExpr(expr, EXPR_K, idx);
-    }else{
-        initExpr(expr, EXPR_REG, resReg);
+        return;
+    }
+
+    if(hasPending){
+        reserveReg(compiler, 1);
+        emitPendingText(compiler, baseReg, &partCnt, pending, pendingLen);
     }
+    flushConcat(compiler, baseReg, &partCnt);
+    initExpr(expr, EXPR_REG, baseReg);
 }
 
 static void handleAnd(Compiler* compiler, ExprDesc* expr, bool canAssign){
@@ -2078,6 +3351,7 @@ static void handleAnd(Compiler* compiler, ExprDesc* expr, bool canAssign){
     expr2Reg(compiler, &right, expr->data.loc.index);
     freeExpr(compiler, &right);
     patchJump(compiler, endJmp);
+    expr->isNum = false;
 }
 
 static void handleOr(Compiler* compiler, ExprDesc* expr, bool canAssign){
@@ -2088,6 +3362,7 @@ static void handleOr(Compiler* compiler, ExprDesc* expr, bool canAssign){
     expr2Reg(compiler, &right, expr->data.loc.index);
     freeExpr(compiler, &right);
     patchJump(compiler, endJmp);
+    expr->isNum = false;
 }
 
 static int argList(Compiler* compiler, ExprDesc* func){
@@ -2194,61 +3469,116 @@ static void handleDot(Compiler* compiler, ExprDesc* expr, bool canAssign){
     expr->type = EXPR_PROP;
     expr->data.loc.index = objReg;
     expr->data.loc.aux = keyReg;
+    expr->isNum = false;
+}
+
+static bool templateValue(Compiler* compiler, ExprDesc* expr, Value* value){
+    // a plain literal, nothing was emitted for it
+    return expr->tJmp == -1 && expr->fJmp == -1 && literalValue(compiler, expr, value);
 }
 
 static void handleList(Compiler* compiler, ExprDesc* expr, bool canAssign){
+    VM* vm = compiler->vm;
     int listReg = getFreeReg(compiler);
     reserveReg(compiler, 1);
 
-    if(!checkType(compiler, TOKEN_RIGHT_BRACKET)){
-        ExprDesc firstElem;
-        expression(compiler, &firstElem);
+    if(match(compiler, TOKEN_RIGHT_BRACKET)){
+        emitABC(compiler, OP_BUILD_LIST, listReg, 0, 0);
+        initExpr(expr, EXPR_REG, listReg);
+        return;
+    }
+
+    ExprDesc elemExpr;
+    expression(compiler, &elemExpr);
 
-        if(checkType(compiler, TOKEN_SEMICOLON)){
-            consume(compiler, TOKEN_SEMICOLON, "Expect ';' for bulk initialization.");
+    if(checkType(compiler, TOKEN_SEMICOLON)){
+        consume(compiler, TOKEN_SEMICOLON, "Expect ';' for bulk initialization.");
 
-            expr2NextReg(compiler, &firstElem);
-            int itemReg = firstElem.data.loc.index;
+        expr2NextReg(compiler, &elemExpr);
+        int itemReg = elemExpr.data.loc.index;
 
-            ExprDesc countExpr;
-            expression(compiler, &countExpr);
-            expr2NextReg(compiler, &countExpr);
-            int countReg = countExpr.data.loc.index;
+        ExprDesc countExpr;
+        expression(compiler, &countExpr);
+        expr2NextReg(compiler, &countExpr);
+        int countReg = countExpr.data.loc.index;
 
-            emitABC(compiler, OP_FILL_LIST, listReg, itemReg, countReg);
-            freeExpr(compiler, &firstElem);
-            freeExpr(compiler, &countExpr);
+        emitABC(compiler, OP_FILL_LIST, listReg, itemReg, countReg);
+        freeExpr(compiler, &elemExpr);
+        freeExpr(compiler, &countExpr);
 
-            consume(compiler, TOKEN_RIGHT_BRACKET, "Expect ']' after list.");
-            initExpr(expr, EXPR_REG, listReg);
-            return;
-        }
+        consume(compiler, TOKEN_RIGHT_BRACKET, "Expect ']' after list.");
+        initExpr(expr, EXPR_REG, listReg);
+        return;
+    }
 
-        int startReg = getFreeReg(compiler);
-        expr2Reg(compiler, &firstElem, startReg);
-        reserveReg(compiler, 1);
-        freeExpr(compiler, &firstElem);
+    /*
+     * Leading literal elements go into a template list in the constant
+     * pool, which OP_CLONE_K copies in one go. From the first element
+     * that needs code on, elements are loaded into the registers above
+     * the list and appended LIST_BATCH at a time, so a literal is not
+     * bounded by the registers.
+    */
+    int baseReg = getFreeReg(compiler);
+    ObjectList* proto = NULL;
+    int protoConst = -1;
+    int buildIndex = -1;
+    bool isOpen = false;
+    int pending = 0;
+    int tailCnt = 0;
 
-        int elemCnt = 1;
-        while(match(compiler, TOKEN_COMMA)){
-            if(elemCnt >= 255){
-                errorAt(compiler, &compiler->parser.pre, "Cannot have more than 255 elements in a list.");
+    while(true){
+        Value value;
+        if(!isOpen && templateValue(compiler, &elemExpr, &value)){
+            push(vm, value);
+            dropConstant(compiler, &elemExpr);
+            if(proto == NULL){
+                proto = newList(vm);
+                protoConst = makeConstant(compiler, OBJECT_VAL(proto));     // the pool keeps it alive
+            }
+            appendToList(vm, proto, value);
+            pop(vm);
+        }else{
+            if(!isOpen){
+                if(proto != NULL){
+                    emitABx(compiler, OP_CLONE_K, listReg, protoConst);
+                }else{
+                    buildIndex = emitABC(compiler, OP_BUILD_LIST, listReg, 0, 0);
+                }
+                isOpen = true;
             }
-            ExprDesc elemExpr;
-            expression(compiler, &elemExpr);
-            expr2Reg(compiler, &elemExpr, startReg + elemCnt);
+
+            int itemReg = baseReg + pending;
+            expr2Reg(compiler, &elemExpr, itemReg);
+            compiler->freeReg = itemReg;    // whatever the element left above it is dead
             reserveReg(compiler, 1);
-            freeExpr(compiler, &elemExpr);
-            elemCnt++;
+            pending++;
+            tailCnt++;
+
+            if(pending == LIST_BATCH){
+                emitABC(compiler, OP_INIT_LIST, listReg, baseReg, pending);
+                compiler->freeReg = baseReg;
+                pending = 0;
+            }
         }
 
-        consume(compiler, TOKEN_RIGHT_BRACKET, "Expect ']' after list.");
-        emitABC(compiler, OP_BUILD_LIST, listReg, elemCnt, 0);
-        emitABC(compiler, OP_INIT_LIST, listReg, startReg, elemCnt);
-        freeRegs(compiler, elemCnt);  // free registers used for elements
-    }else{
-        consume(compiler, TOKEN_RIGHT_BRACKET, "Expect ']' after list.");
-        emitABC(compiler, OP_BUILD_LIST, listReg, 0, 0);
+        if(!match(compiler, TOKEN_COMMA)){
+            break;
+        }
+        expression(compiler, &elemExpr);
+    }
+
+    consume(compiler, TOKEN_RIGHT_BRACKET, "Expect ']' after list.");
+
+    if(!isOpen){
+        emitABx(compiler, OP_CLONE_K, listReg, protoConst);
+    }else if(pending > 0){
+        emitABC(compiler, OP_INIT_LIST, listReg, baseReg, pending);
+    }
+    compiler->freeReg = baseReg;
+
+    if(buildIndex != -1){
+        // now the size is known, let OP_BUILD_LIST allocate it up front
+        compiler->func->chunk.code[buildIndex] = CREATE_ABC(OP_BUILD_LIST, listReg, tailCnt > 255 ? 255 : tailCnt, 0);
     }
 
     initExpr(expr, EXPR_REG, listReg);
@@ -2317,35 +3647,91 @@ static void handleIndex(Compiler* compiler, ExprDesc* expr, bool canAssign){
     expr->type = EXPR_INDEX;
     expr->data.loc.index = objReg;
     expr->data.loc.aux = keyReg;
+    expr->isNum = false;
+}
+
+static bool templateKey(Compiler* compiler, ExprDesc* expr, Value* key){
+    // keys OP_SET_INDEX would reject stay in code, to fail at runtime as before
+    return templateValue(compiler, expr, key) &&
+           (!IS_NUM(*key) || AS_NUM(*key) == (int64_t)AS_NUM(*key));
+}
+
+static void openMap(Compiler* compiler, int mapReg, int protoConst){
+    if(protoConst != -1){
+        emitABx(compiler, OP_CLONE_K, mapReg, protoConst);
+    }else{
+        emitABC(compiler, OP_BUILD_MAP, mapReg, 0, 0);
+    }
 }
 
 static void handleMap(Compiler* compiler, ExprDesc* expr, bool canAssign){
+    // like lists, leading literal entries are cloned from a template map
+    VM* vm = compiler->vm;
     int mapReg = getFreeReg(compiler);
     reserveReg(compiler, 1);
-    emitABC(compiler, OP_BUILD_MAP, mapReg, 0, 0);
+    int baseReg = getFreeReg(compiler);
+
+    ObjectMap* proto = NULL;
+    int protoConst = -1;
+    bool isOpen = false;
 
     if(!checkType(compiler, TOKEN_RIGHT_BRACE)){
         do{
             ExprDesc keyExpr;
             expression(compiler, &keyExpr);
-            expr2NextReg(compiler, &keyExpr);
-            int keyReg = keyExpr.data.loc.index;
+
+            Value key;
+            bool keyIsLiteral = !isOpen && templateKey(compiler, &keyExpr, &key);
+            if(!keyIsLiteral){
+                if(!isOpen){
+                    openMap(compiler, mapReg, protoConst);
+                    isOpen = true;
+                }
+                expr2NextReg(compiler, &keyExpr);
+            }
 
             consume(compiler, TOKEN_COLON, "Expect ':' after map key.");
 
             ExprDesc valueExpr;
             expression(compiler, &valueExpr);
+
+            Value value;
+            if(keyIsLiteral && templateValue(compiler, &valueExpr, &value)){
+                push(vm, key);
+                push(vm, value);
+                dropConstant(compiler, &valueExpr);
+                dropConstant(compiler, &keyExpr);
+                if(proto == NULL){
+                    proto = newMap(vm);
+                    protoConst = makeConstant(compiler, OBJECT_VAL(proto));   // the pool keeps it alive
+                }
+                tableSet(vm, &proto->table, key, value);
+                pop(vm);
+                pop(vm);
+                continue;
+            }
+
+            if(!isOpen){
+                openMap(compiler, mapReg, protoConst);
+                isOpen = true;
+            }
+
             expr2NextReg(compiler, &valueExpr);
-            int valReg = valueExpr.data.loc.index;
+            if(keyIsLiteral){
+                expr2NextReg(compiler, &keyExpr);     // a literal, loading it late changes nothing
+            }
 
-            emitABC(compiler, OP_SET_INDEX, mapReg, keyReg, valReg);
+            emitABC(compiler, OP_SET_INDEX, mapReg, keyExpr.data.loc.index, valueExpr.data.loc.index);
             // reuse OP_SET_INDEX for setting map entries
 
-            freeExpr(compiler, &keyExpr);
-            freeExpr(compiler, &valueExpr);
+            compiler->freeReg = baseReg;    // the entry is stored, its registers are dead
         }while(match(compiler, TOKEN_COMMA));
     }
     consume(compiler, TOKEN_RIGHT_BRACE, "Expect '}' after map.");
+
+    if(!isOpen){
+        openMap(compiler, mapReg, protoConst);
+    }
     initExpr(expr, EXPR_REG, mapReg);
 }
 
@@ -2375,6 +3761,11 @@ static void errorAt(Compiler* compiler, Token* token, const char* message){
                             ? compiler->func->srcName->chars 
                             : "<script>";
 
+    compiler->parser.hadError = true;
+    if(compiler->vm->quietCompile){
+        return;
+    }
+
     fprintf(stderr, "Error [%s, line %d] ",srcName, compiler->parser.cur.line);
     if(token->type != TOKEN_EOF){
         fprintf(stderr, "at '%.*s': ", token->len, token->head);
@@ -2383,5 +3774,4 @@ static void errorAt(Compiler* compiler, Token* token, const char* message){
     }
     fprintf(stderr, "%s", message);
     fprintf(stderr, "\n");
-    compiler->parser.hadError = true;
 }
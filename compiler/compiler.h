@@ -6,16 +6,50 @@
 #include "common.h"
 
 #define LOCAL_MAX (UINT16_MAX + 1)
+#define LOCAL_INIT 16
+#define ARENA_BLOCK_SIZE (16 * 1024)
 #define REG_MAX 256
 #define LOOP_MAX 16
 #define CASE_MAX 32
+#define SWITCH_TABLE_MIN 4  // fewer case labels keep the compare chain
+#define CONCAT_MAX 64       // parts joined per OP_CONCAT, bounds register use
+#define NUM_TRACK_MAX 64    // locals beyond this are never treated as numbers
+#define SCALAR_MAX 16       // largest literal kept in registers instead of allocated
+#define SCALAR_SCAN_MAX 4096    // tokens looked ahead for its uses before giving up
+#define LIST_BATCH 32       // list elements appended per OP_INIT_LIST, bounds register use
+
+/*
+ * A list or map literal that never leaves its block and is only
+ * accessed with constant subscripts. Element i lives in register
+ * baseReg + i; keys holds the string literal of each map entry.
+*/
+typedef struct{
+    int count;
+    int baseReg;
+    Token* keys;    // NULL for a list
+}ScalarAgg;
 
 typedef struct{
     Token name;
     int depth;
     int reg;
+    bool isNum;         // every value stored so far is a number
+    uint64_t numDeps;   // locals that fact relies on
+    ScalarAgg* agg;     // non-NULL if replaced by registers
+    bool isAssigned;    // stored into after its initializer
+    int capturedAt;     // code offset of its first capture, -1 if never captured
 }Local;
 
+/*
+ * An unchecked *_NN instruction and the locals it assumed to be numbers.
+ * If one of them later receives a non-number, the instruction is turned
+ * back into its checked form.
+*/
+typedef struct{
+    int offset;
+    uint64_t deps;
+}NumPatch;
+
 typedef struct{
     Token pre;  // Previous token
     Token cur;  // Current token
@@ -35,15 +69,59 @@ typedef struct{
     bool isLocal;   // T: local; F: upvalue
 }Upvalue;
 
+/*
+ * Numbers and strings already in the function's constant pool, so each
+ * is stored once. constUses counts the expressions handed each index,
+ * dropConstant() only takes back a constant no other expression holds.
+*/
+#define CONST_SLOT_INIT     16
+#define CONST_SLOT_FREE     -1
+#define CONST_SLOT_DROPPED  -2
+
+typedef struct{
+    Value value;
+    int index;
+}ConstSlot;
+
+typedef struct ArenaBlock{
+    struct ArenaBlock* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+}ArenaBlock;
+
+/*
+ * Scratch memory owned by one compile() call. Every Compiler of the
+ * call, and its locals/upvalues, lives here and is released at once
+ * when the call returns. Finished nested compilers are kept on a spare
+ * list so the next function reuses their already grown arrays.
+*/
+typedef struct CompilerArena{
+    ArenaBlock* head;
+    struct Compiler* spare;
+}CompilerArena;
+
 typedef struct Compiler{
     struct Compiler* enclosing;  // Enclosing compiler for nested functions
     Parser parser;
     VM* vm;
     GlobalEnv* globals;   // point to defining module's global env for global access
-    Local locals[LOCAL_MAX];
+    CompilerArena* arena;
+    Local* locals;
     int localCnt;
-    Upvalue upvalues[LOCAL_MAX];
+    int localCapacity;
+    Upvalue* upvalues;
     int upvalueCnt;
+    int upvalueCapacity;
+    NumPatch* numPatches;
+    int numPatchCnt;
+    int numPatchCapacity;
+    ConstSlot* constSlots;
+    int constSlotCnt;   // dropped slots included, they still lengthen probes
+    int constSlotCapacity;
+    int* constUses;
+    int constUseCnt;
+    int constUseCapacity;
     int scopeDepth;
     Loop loops[LOOP_MAX];
     int loopCnt;
@@ -82,11 +160,28 @@ typedef struct{
     }data;
     int tJmp;
     int fJmp;
+    bool isNum;         // value is known to be a number
+    uint64_t numDeps;   // locals that knowledge relies on
 }ExprDesc;
 
 ObjectFunc* compile(VM* vm, const char* code, const char* srcName);
+bool compileLazyFunc(VM* vm, ObjectFunc* func, GlobalEnv* globals);
 void markCompilerRoots(VM* vm);
 static ObjectFunc* stopCompiler(Compiler* compiler);
+static void* arenaAlloc(CompilerArena* arena, size_t size);
+static void* arenaGrow(CompilerArena* arena, void* ptr, size_t oldSize, size_t newSize);
+static void freeArena(CompilerArena* arena);
+static Compiler* acquireCompiler(CompilerArena* arena);
+static void releaseCompiler(Compiler* compiler);
+static Local* pushLocal(Compiler* compiler);
+static bool exprIsNum(Compiler* compiler, ExprDesc* expr);
+static int emitNumOp(Compiler* compiler, OpCode op, int a, int b, int c, bool isNum, uint64_t deps);
+static void storeLocalType(Compiler* compiler, int reg, ExprDesc* val, bool isInit);
+static void downgradeLocal(Compiler* compiler, int index);
+static ScalarAgg* scanScalarAgg(Compiler* compiler, Token name);
+static void scalarInit(Compiler* compiler, int localIndex, ScalarAgg* agg);
+static void scalarElement(Compiler* compiler, ExprDesc* expr, ScalarAgg* agg);
+static void initLocalExpr(Compiler* compiler, ExprDesc* expr, int reg);
 static int emitJmp(Compiler* compiler);
 static void patchJump(Compiler* compiler, int offset);
 static void emitLoop(Compiler* compiler, int loopStart);
@@ -108,6 +203,10 @@ static void handleBinary(Compiler* compiler, ExprDesc* expr, bool canAssign);
 
 static void handleLiteral(Compiler* compiler, ExprDesc* expr, bool canAssign);
 
+static bool literalValue(Compiler* compiler, ExprDesc* expr, Value* value);
+static void dropConstant(Compiler* compiler, ExprDesc* expr);
+static bool foldString(Compiler* compiler, TokenType type, ExprDesc* left, ExprDesc* right);
+static void flushConcat(Compiler* compiler, int baseReg, int* partCnt);
 static void handleString(Compiler* compiler, ExprDesc* expr, bool canAssign);
 
 static void handleAnd(Compiler* compiler, ExprDesc* expr, bool canAssign);
@@ -135,6 +234,8 @@ static void decl(Compiler* compiler);
 static void varDecl(Compiler* compiler);
 static void defineVar(Compiler* compiler, int global);
 static void funcDecl(Compiler* compiler);
+static void compileFuncBody(Compiler* funcCompiler);
+static void deferFunc(Compiler* compiler, int destReg, Token* funcName);
 static void funcExpr(Compiler* compiler, ExprDesc* expr, bool canAssign);
 static void classDecl(Compiler* compiler);
 static void methodDecl(Compiler* compiler);
@@ -150,7 +251,7 @@ static void expressionStmt(Compiler* compiler);
 
 static bool checkType(Compiler* compiler, TokenType type);
 static bool match(Compiler* compiler, TokenType type);
-static void sync(Compiler* compiler);
+static void synchronize(Compiler* compiler);
 
 static void printStmt(Compiler* compiler);
 
@@ -161,6 +262,8 @@ static void forStmt(Compiler* compiler);
 static void breakStmt(Compiler* compiler);
 static void continueStmt(Compiler* compiler);
 static void switchStmt(Compiler* compiler);
+static bool scanSwitchLabels(Compiler* compiler);
+static void switchTable(Compiler* compiler, int condReg);
 static void systemStmt(Compiler* compiler);
 static void deferStmt(Compiler* compiler);
 static void returnStmt(Compiler* compiler);
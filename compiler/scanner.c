@@ -1,20 +1,133 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "scanner.h"
 #include "common.h"
 #include "keywords.h"
+#include "simd.h"
+
+_Thread_local Scanner sc;    // one per thread, background compiles scan alongside the main thread
+
+/*
+ * Long runs (indentation, comments, string bodies, identifiers) are
+ * skipped a block at a time where the target has SSE2 or AVX2. Blocks
+ * stay inside the source, up to its terminating '\0'; the last partial
+ * block goes to the byte loop.
+*/
+typedef enum{
+    STOP_LINE_END,      // '\n'
+    STOP_STRING,        // '"', '$', '\\'
+    STOP_COMMENT,       // '#', '}'
+    STOP_NON_SPACE,     // anything but ' ', '\t', '\r', '\n'
+    STOP_NON_IDENT,     // anything but [A-Za-z0-9_]
+}StopSet;               // every set also stops at '\0'
+
+static bool isStop(char c, StopSet set){
+    switch(set){
+        case STOP_LINE_END:     return c == '\n' || c == '\0';
+        case STOP_STRING:       return c == '"' || c == '$' || c == '\\' || c == '\0';
+        case STOP_COMMENT:      return c == '#' || c == '}' || c == '\0';
+        case STOP_NON_SPACE:    return c != ' ' && c != '\t' && c != '\n' && c != '\r';
+        case STOP_NON_IDENT:    return !isAlpha(c) && !isDigit(c);
+    }
+    return true;
+}
+
+static const char* findStopBytes(const char* p, StopSet set, int* lines){
+    while(!isStop(*p, set)){
+        if(lines != NULL && *p == '\n'){
+            (*lines)++;
+        }
+        p++;
+    }
+    return p;
+}
+
+#ifdef BLOCK_SIZE
+static inline uint32_t stopMask(Block bytes, StopSet set){
+    Block stop = blockEq(bytes, blockSplat('\0'));
+    switch(set){
+        case STOP_LINE_END:
+            stop = blockOr(stop, blockEq(bytes, blockSplat('\n')));
+            break;
+        case STOP_STRING:
+            stop = blockOr(stop, blockEq(bytes, blockSplat('"')));
+            stop = blockOr(stop, blockEq(bytes, blockSplat('$')));
+            stop = blockOr(stop, blockEq(bytes, blockSplat('\\')));
+            break;
+        case STOP_COMMENT:
+            stop = blockOr(stop, blockEq(bytes, blockSplat('#')));
+            stop = blockOr(stop, blockEq(bytes, blockSplat('}')));
+            break;
+        case STOP_NON_SPACE:{
+            Block space = blockOr(blockEq(bytes, blockSplat(' ')), blockEq(bytes, blockSplat('\t')));
+            space = blockOr(space, blockEq(bytes, blockSplat('\n')));
+            space = blockOr(space, blockEq(bytes, blockSplat('\r')));
+            return ~blockMask(space) & BLOCK_ALL;
+        }
+        case STOP_NON_IDENT:{
+            Block ident = blockOr(blockIn(bytes, 'a', 'z'), blockIn(bytes, 'A', 'Z'));
+            ident = blockOr(ident, blockIn(bytes, '0', '9'));
+            ident = blockOr(ident, blockEq(bytes, blockSplat('_')));
+            return ~blockMask(ident) & BLOCK_ALL;
+        }
+    }
+    return blockMask(stop);
+}
+
+static const char* findStop(const char* p, StopSet set, int* lines){
+    // lines, when given, gains the newlines skipped on the way
+    while(sc.end - p >= BLOCK_SIZE){
+        Block bytes = blockLoad(p);
+        uint32_t mask = stopMask(bytes, set);
+        uint32_t newlines = lines != NULL ? blockMask(blockEq(bytes, blockSplat('\n'))) : 0;
+
+        if(mask != 0){
+            int index = __builtin_ctz(mask);
+            if(lines != NULL){
+                *lines += __builtin_popcount(newlines & (uint32_t)((1ull << index) - 1));
+            }
+            return p + index;
+        }
 
-Scanner sc;
+        if(lines != NULL){
+            *lines += __builtin_popcount(newlines);
+        }
+        p += BLOCK_SIZE;
+    }
+    return findStopBytes(p, set, lines);
+}
+#else
+#define findStop findStopBytes
+#endif
 
 void initScanner(const char* code){
+    initScannerAt(code, 1);
+}
+
+void initScannerAt(const char* code, int line){
     sc.head = code;
     sc.cur = code;
-    sc.line = 1;
+    sc.end = code + strlen(code);
+    sc.line = line;
     sc.modeStackTop = -1;   // Initialize mode stack top
+    sc.quiet = false;
     pushMode(MODE_DEFAULT); // Start in default mode
 }
 
+Scanner saveScanner(){
+    return sc;
+}
+
+void restoreScanner(Scanner state){
+    sc = state;
+}
+
+void setScannerQuiet(bool quiet){
+    sc.quiet = quiet;
+}
+
 static inline void pushMode(ScannerMode mode){
     if(sc.modeStackTop < MAX_MODE_STACK - 1){
         sc.modeStack[++sc.modeStackTop] = mode;
@@ -49,7 +162,9 @@ static inline Token pack(TokenType type, const char* head, int len, int line){
 }
 
 static inline Token error(const char* message, int line){
-    fprintf(stderr, "Error at line %d: %s\n", line, message);
+    if(!sc.quiet){
+        fprintf(stderr, "Error at line %d: %s\n", line, message);
+    }
     return pack(TOKEN_ERROR, message, (int)strlen(message), line);
 }
 
@@ -67,24 +182,39 @@ static inline bool is_next(char c){
     return false;
 }
 
+static inline bool isSpace(char c){
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
 static inline void skipWhitespace(){
-    while(*sc.cur == ' ' || *sc.cur == '\t' || *sc.cur == '\n' || *sc.cur == '\r'){
+    // a single space between tokens is the common case, not worth a block
+    if(!isSpace(sc.cur[0])){
+        return;
+    }
+    if(!isSpace(sc.cur[1])){
         if(*sc.cur == '\n') sc.line++;
         next();
+        return;
     }
-    return;
+    sc.cur = findStop(sc.cur, STOP_NON_SPACE, &sc.line);
 }
 
 static inline void handleLineComment(){
-    while(*sc.cur != '\n' && *sc.cur != '\0'){
-        next();
-    }
+    sc.cur = findStop(sc.cur, STOP_LINE_END, NULL);
 }
 
 static inline void handleBlockComment(){
     next(); next(); // Skip #{
     int depth = 1;
-    while(depth > 0 && *sc.cur != '\0'){
+    while(depth > 0){
+        sc.cur = findStop(sc.cur, STOP_COMMENT, &sc.line);
+
+        if(*sc.cur == '\0'){
+            if(sc.quiet) return;
+            fprintf(stderr, "Error: Unclosed block comment at line %d\n", sc.line);
+            return;
+        }
+
         if(*sc.cur == '#' && sc.cur[1] == '{'){
             next(); next(); // Skip #{
             depth++;
@@ -97,14 +227,7 @@ static inline void handleBlockComment(){
             continue;
         }
 
-        if(*sc.cur == '\n') sc.line++;
-
-        next();
-
-        if(*sc.cur == '\0' && depth > 0){
-            fprintf(stderr, "Error: Unclosed block comment at line %d\n", sc.line);
-            return;
-        }
+        next();     // a lone '#' or '}'
     }
 }
 
@@ -159,9 +282,7 @@ static Token handleNumber(){
 }
 
 static inline Token handleIdentifier(){
-    while(isAlpha(*sc.cur) || isDigit(*sc.cur)){
-        next();
-    }
+    sc.cur = findStop(sc.cur, STOP_NON_IDENT, NULL);
 
     return pack(TOKEN_IDENTIFIER, sc.head, (int)(sc.cur - sc.head), sc.line);
 }
@@ -257,7 +378,11 @@ static Token scanDefault(){
 
 static Token scanString(){
     sc.head = sc.cur;
-    while(*sc.cur != '"' && *sc.cur != '\0'){
+    while(true){
+        sc.cur = findStop(sc.cur, STOP_STRING, NULL);
+        if(*sc.cur == '"' || *sc.cur == '\0'){
+            break;
+        }
         if(*sc.cur == '$' && sc.cur[1] == '{'){
             break; // Interpolation start
         }
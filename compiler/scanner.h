@@ -43,9 +43,11 @@ typedef enum{
 typedef struct{
     const char* head;
     const char* cur;
+    const char* end;    // the terminating '\0', block loads stop short of it
     int line;
     ScannerMode modeStack[MAX_MODE_STACK];
     int modeStackTop;
+    bool quiet;     // suppress diagnostics while the compiler looks ahead
 }Scanner;
 
 typedef struct{
@@ -56,6 +58,10 @@ typedef struct{
 }Token;
 
 void initScanner(const char* code);
+void initScannerAt(const char* code, int line);
+Scanner saveScanner();
+void restoreScanner(Scanner state);
+void setScannerQuiet(bool quiet);
 static Token scanDefault();
 static Token scanString();
 static Token scanSystem();
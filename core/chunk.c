@@ -24,27 +24,84 @@ void writeChunk(VM* vm, Chunk* chunk, Instruction instruction, int line){
             oldCapacity,
             chunk->capacity
         );
+    }
+    chunk->code[chunk->count] = instruction;
+
+    if(chunk->lineCount == 0 || chunk->lines[chunk->lineCount - 1].line != line){
+        addLineStart(vm, chunk, (int)chunk->count, line);
+    }
+    chunk->count++;
+}
+
+void addLineStart(VM* vm, Chunk* chunk, int offset, int line){
+    if(chunk->lineCount + 1 > chunk->lineCapacity){
+        int oldCapacity = chunk->lineCapacity;
+        chunk->lineCapacity = GROW_CAPACITY(oldCapacity);
         chunk->lines = GROW_ARRAY(
             vm,
-            int,
+            LineStart,
             chunk->lines,
-            oldCapacity * 2,
-            chunk->capacity * 2
+            oldCapacity,
+            chunk->lineCapacity
         );
     }
-    chunk->code[chunk->count] = instruction;
-    chunk->lines[chunk->count] = line;
-    chunk->count++;
-    
+    chunk->lines[chunk->lineCount].offset = offset;
+    chunk->lines[chunk->lineCount].line = line;
+    chunk->lineCount++;
+}
+
+void truncateChunk(Chunk* chunk, size_t count){
+    // drop the trailing instructions and the runs that only covered them
+    chunk->count = count;
+    while(chunk->lineCount > 0 && (size_t)chunk->lines[chunk->lineCount - 1].offset >= count){
+        chunk->lineCount--;
+    }
+}
+
+void shrinkChunk(VM* vm, Chunk* chunk){
+    // a finished chunk only grows again by the odd constant, give the slack back
+    if(chunk->capacity > chunk->count){
+        chunk->code = GROW_ARRAY(vm, Instruction, chunk->code, chunk->capacity, chunk->count);
+        chunk->capacity = chunk->count;
+    }
+    if(chunk->lineCapacity > chunk->lineCount){
+        chunk->lines = GROW_ARRAY(vm, LineStart, chunk->lines, chunk->lineCapacity, chunk->lineCount);
+        chunk->lineCapacity = chunk->lineCount;
+    }
+
+    ValueArray* constants = &chunk->constants;
+    if(constants->capacity > constants->count){
+        constants->values = GROW_ARRAY(vm, Value, constants->values, constants->capacity, constants->count);
+        constants->capacity = constants->count;
+    }
 }
 
 void freeChunk(VM* vm, Chunk* chunk){
     FREE_ARRAY(vm, Instruction, chunk->code, chunk->capacity);
-    FREE_ARRAY(vm, int, chunk->lines, chunk->lineCapacity * 2);
+    FREE_ARRAY(vm, LineStart, chunk->lines, chunk->lineCapacity);
     freeValueArray(vm, &chunk->constants);
     initChunk(chunk);
 }
 
+int getLine(const Chunk* chunk, int offset){
+    if(offset < 0 || offset >= (int)chunk->count || chunk->lineCount == 0){
+        return -1;
+    }
+
+    // the last run starting at or before offset
+    int low = 0;
+    int high = chunk->lineCount - 1;
+    while(low < high){
+        int mid = low + (high - low + 1) / 2;
+        if(chunk->lines[mid].offset <= offset){
+            low = mid;
+        }else{
+            high = mid - 1;
+        }
+    }
+    return chunk->lines[low].line;
+}
+
 int addConstant(VM* vm, Chunk* chunk, Value value){
     writeValueArray(vm, &chunk->constants, value);
     return (int)(chunk->constants.count - 1);
@@ -5,20 +5,35 @@
 #include "value.h"
 #include "instruction.h"
 
+/*
+ * Line info is run-length encoded: one entry per run of instructions
+ * from the same source line, in increasing offset order, so a lookup
+ * is a binary search over the runs.
+*/
+typedef struct{
+    int offset;     // first instruction of the run
+    int line;
+}LineStart;
+
 typedef struct Chunk {
     Instruction* code;
     size_t count;
     size_t capacity;
     ValueArray constants;
-    int* lines;
+    LineStart* lines;
     int lineCount;
     int lineCapacity;
 } Chunk;
 
 void initChunk(Chunk* chunk);
 void writeChunk(VM* vm, Chunk* chunk, Instruction instruction, int line);
+void addLineStart(VM* vm, Chunk* chunk, int offset, int line);
+void truncateChunk(Chunk* chunk, size_t count);
+void shrinkChunk(VM* vm, Chunk* chunk);
 void freeChunk(VM* vm, Chunk* chunk);
 
+int getLine(const Chunk* chunk, int offset);
+
 int addConstant(VM* vm, Chunk* chunk, Value value);
 
 #endif  // CIETO_CHUNK_H
\ No newline at end of file
@@ -3,14 +3,9 @@
 #include "compiler.h"
 #include "chunk.h"
 #include "debug.h"
-
-static bool endsWith(const char* str, const char* suffix){
-    if(!str || !suffix) return false;
-    size_t str_len = strlen(str);
-    size_t suffix_len = strlen(suffix);
-    if(suffix_len > str_len)    return false;
-    return strncmp(str+str_len-suffix_len, suffix, suffix_len) == 0;
-}
+#include "bytecode.h"
+#include "import_prefetch.h"
+#include "bundle.h"
 
 char* readScript(const char* path){
     FILE* file = fopen(path, "rb");
@@ -34,7 +29,17 @@ char* readScript(const char* path){
 }
 
 void runScript(VM* vm, const char* path) {
+    if(isBytecodePath(path)){
+        runBytecode(vm, path);
+        return;
+    }
+    if(isBundlePath(path)){
+        runBundle(vm, path);
+        return;
+    }
+
     char* content = readScript(path);
+    startImportPrefetch(vm, content, path);
     InterpreterStatus status = interpret(vm, content, path);
     free(content);
 
@@ -42,53 +47,106 @@ void runScript(VM* vm, const char* path) {
     if(status == VM_RUNTIME_ERROR) exit(EXIT_FAILURE);
 }
 
-void buildScript(VM* vm, const char* path){
-    char* source = readScript(path);
+void runBytecode(VM* vm, const char* path){
+    ObjectFunc* func = loadBytecodeFile(vm, path, vm->curGlobal);
+    if(func == NULL){
+        fprintf(stderr, "Could not load bytecode file %s\n", path);
+        exit(EXIT_FAILURE);
+    }
 
-    Chunk chunk;
-    initChunk(&chunk);
+    if(interpretFunc(vm, func) != VM_OK) exit(EXIT_FAILURE);
+}
 
-    ObjectFunc* func = compile(vm, source, path);
+void runBundle(VM* vm, const char* path){
+    ObjectFunc* func = openBundle(vm, path) ? loadBundleEntry(vm) : NULL;
     if(func == NULL){
-        free(source);
-        exit(65);
+        fprintf(stderr, "Could not load bundle %s\n", path);
+        exit(EXIT_FAILURE);
     }
 
-    char outputPath[1024];
-    strncpy(outputPath, path, sizeof(outputPath) - 1);
-    outputPath[sizeof(outputPath) - 1] = '\0';  // null end
-    char* dot = strrchr(outputPath, '.');
+    if(interpretFunc(vm, func) != VM_OK) exit(EXIT_FAILURE);
+}
+
+static bool defaultOutputPath(const char* path, const char* ext, char* out, size_t size){
+    // the script path with its extension replaced
+    const char* dot = strrchr(path, '.');
+    const char* sep = strrchr(path, '/');
+    const char* winSep = strrchr(path, '\\');
+    if(winSep != NULL && (sep == NULL || winSep > sep)){
+        sep = winSep;
+    }
     int base_len;
-    if(dot != NULL){
-        base_len = dot - outputPath;
+    if(dot != NULL && (sep == NULL || dot > sep)){
+        base_len = (int)(dot - path);
     }else{
-        base_len = strlen(path);
+        base_len = (int)strlen(path);
     }
 
-    int written = snprintf(outputPath, sizeof(outputPath), "%.*s.pco", base_len, path);
+    int written = snprintf(out, size, "%.*s%s", base_len, path, ext);
+    return written >= 0 && written < (int)size;
+}
 
-    if(written < 0 || written >= sizeof(outputPath)){
-        fprintf(stderr, "Error: Could not generate output path");
-        free(source);
-        freeChunk(vm, &chunk);
-        exit(70);
+int buildScript(VM* vm, const char* path, const char* outPath){
+    char* source = readScript(path);
+    vm->eagerCompile = true;
+
+    ObjectFunc* func = compile(vm, source, path);
+    free(source);
+    if(func == NULL){
+        return 65;
     }
 
-    printf("Compiling %s to %s...\n", path, outputPath);
+    char outputPath[1024];
+    if(outPath == NULL){
+        if(!defaultOutputPath(path, BYTECODE_EXT, outputPath, sizeof(outputPath))){
+            fprintf(stderr, "Error: Could not generate output path\n");
+            return 70;
+        }
+        outPath = outputPath;
+    }
 
-    // serializeChunk();
+    printf("Compiling %s to %s...\n", path, outPath);
+
+    if(!writeBytecodeFile(vm, func, vm->curGlobal, outPath)){
+        fprintf(stderr, "Error: Could not write %s\n", outPath);
+        return 74;
+    }
 
-    free(source);
-    freeChunk(vm, &chunk);
     printf("Compilation successful.\n");
+    return 0;
 }
 
-int dumpScript(VM* vm, const char* path){
-    char* source = readScript(path);
+int bundleScript(VM* vm, const char* path, const char* outPath){
+    vm->eagerCompile = true;
 
-    ObjectFunc* func = compile(vm, source, path);
+    char outputPath[1024];
+    if(outPath == NULL){
+        if(!defaultOutputPath(path, BUNDLE_EXT, outputPath, sizeof(outputPath))){
+            fprintf(stderr, "Error: Could not generate output path\n");
+            return 70;
+        }
+        outPath = outputPath;
+    }
 
-    free(source);
+    printf("Bundling %s to %s...\n", path, outPath);
+
+    if(!writeBundleFile(vm, path, outPath)){
+        fprintf(stderr, "Error: Could not write %s\n", outPath);
+        return 74;
+    }
+    return 0;
+}
+
+int dumpScript(VM* vm, const char* path){
+    ObjectFunc* func;
+    if(isBytecodePath(path)){
+        func = loadBytecodeFile(vm, path, vm->curGlobal);
+    }else{
+        char* source = readScript(path);
+        vm->eagerCompile = true;    // dump every function body, not lazy stubs
+        func = compile(vm, source, path);
+        free(source);
+    }
 
     if(func == NULL){
         return 65;
@@ -9,7 +9,10 @@
 
 char* readScript(const char* path);
 void runScript(VM* vm, const char* path);
-void buildScript(VM* vm, const char* path);
+void runBytecode(VM* vm, const char* path);
+void runBundle(VM* vm, const char* path);
+int buildScript(VM* vm, const char* path, const char* outPath);
+int bundleScript(VM* vm, const char* path, const char* outPath);
 int dumpScript(VM* vm, const char* path);
 
 #endif // FILE_H
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "gc_dedup.h"
+#include "object.h"
+#include "hashtable.h"
+
+#define DEDUP_MIN_CAPACITY 1024
+
+typedef struct{
+    ObjectString* str;
+    uint64_t hash;
+    int rank;           // -1 until two copies meet
+}DedupSlot;
+
+typedef struct{
+    DedupSlot* slots;
+    size_t mask;
+    size_t count;
+}DedupTable;
+
+static size_t stringFootprint(ObjectString* str){
+    if(str->chars == str->storage){
+        return sizeof(ObjectString) + str->length + 1;
+    }
+    // a view, or one that made its own copy of a view
+    return sizeof(ObjectString) + (str->owner == NULL ? str->length + 1 : 0);
+}
+
+// the copy to keep among equal strings has the highest rank
+static int stringRank(ObjectString* str){
+    if(str->chars != str->storage){
+        return str->owner == NULL ? 1 : 0;
+    }
+    return str->obj.isInterned ? 3 : 2;
+}
+
+static DedupSlot* findSlot(DedupTable* table, ObjectString* str, uint64_t hash){
+    size_t index = (size_t)hash & table->mask;
+    for(;;){
+        DedupSlot* slot = &table->slots[index];
+        if(slot->str == NULL || slot->str == str){
+            return slot;
+        }
+        if(slot->hash == hash && slot->str->length == str->length &&
+           memcmp(slot->str->chars, str->chars, str->length) == 0){
+            return slot;
+        }
+        index = (index + 1) & table->mask;
+    }
+}
+
+static bool growTable(DedupTable* table){
+    size_t capacity = table->slots == NULL ? DEDUP_MIN_CAPACITY : (table->mask + 1) * 2;
+    DedupSlot* slots = (DedupSlot*)calloc(capacity, sizeof(DedupSlot));
+    if(slots == NULL){
+        return false;
+    }
+
+    DedupTable grown = {slots, capacity - 1, table->count};
+    for(size_t i = 0; table->slots != NULL && i <= table->mask; i++){
+        DedupSlot* slot = &table->slots[i];
+        if(slot->str != NULL){
+            *findSlot(&grown, slot->str, slot->hash) = *slot;
+        }
+    }
+
+    free(table->slots);
+    *table = grown;
+    return true;
+}
+
+static bool isCandidate(Object* object){
+    return object->isMarked && object->type == OBJECT_STRING && ((ObjectString*)object)->length > 0;
+}
+
+static size_t redirectValue(VM* vm, DedupTable* table, Value* value){
+    if(!IS_STRING(*value)){
+        return 0;
+    }
+    ObjectString* str = AS_STRING(*value);
+    if(str->length == 0){
+        return 0;
+    }
+
+    ObjectString* kept = findSlot(table, str, stringHash(str, vm->hash_seed))->str;
+    if(kept == NULL || kept == str){
+        return 0;
+    }
+    *value = OBJECT_VAL(kept);
+    return 1;
+}
+
+static size_t redirectTable(VM* vm, DedupTable* table, HashTable* entries, bool keys){
+    // a key only changes to an equal string, so it keeps its slot
+    size_t count = 0;
+    for(int i = 0; i < entries->capacity; i++){
+        Entry* entry = &entries->entries[i];
+        if(keys){
+            count += redirectValue(vm, table, &entry->key);
+        }
+        count += redirectValue(vm, table, &entry->value);
+    }
+    return count;
+}
+
+static size_t redirectEnv(VM* vm, DedupTable* table, GlobalEnv* env){
+    size_t count = 0;
+    for(size_t i = 0; i < env->count; i++){
+        count += redirectValue(vm, table, &env->values[i]);
+    }
+    return count;
+}
+
+static size_t redirectObject(VM* vm, DedupTable* table, Object* object){
+    size_t count = 0;
+    switch(object->type){
+        case OBJECT_LIST:{
+            ObjectList* list = (ObjectList*)object;
+            for(int i = 0; i < list->count; i++){
+                count += redirectValue(vm, table, &list->items[i]);
+            }
+            break;
+        }
+        case OBJECT_MAP:
+            count += redirectTable(vm, table, &((ObjectMap*)object)->table, true);
+            break;
+        case OBJECT_INSTANCE:
+            count += redirectTable(vm, table, &((ObjectInstance*)object)->fields, false);
+            break;
+        case OBJECT_CLOSURE:{
+            ObjectClosure* closure = (ObjectClosure*)object;
+            for(int i = 0; i < closure->upvalueCnt; i++){
+                if(IS_FLAT_UPVALUE(closure->func, i)){
+                    count += redirectValue(vm, table, &closure->upvalues[i].value);
+                }
+            }
+            break;
+        }
+        case OBJECT_UPVALUE:
+            count += redirectValue(vm, table, &((ObjectUpvalue*)object)->closed);
+            break;
+        case OBJECT_MODULE:
+            count += redirectEnv(vm, table, &((ObjectModule*)object)->members);
+            break;
+        default:
+            break;
+    }
+    return count;
+}
+
+size_t gcDedupStrings(VM* vm, bool redirect){
+    vm->gcStats.dedupStrings = 0;
+    vm->gcStats.dedupBytes = 0;
+    vm->gcStats.dedupRefs = 0;
+
+    // outside the GC heap, it lives only for this pass
+    DedupTable table = {NULL, 0, 0};
+    if(!growTable(&table)){
+        return 0;
+    }
+
+    for(Object* object = vm->objects; object != NULL; object = object->next){
+        if(!isCandidate(object)) continue;
+
+        ObjectString* str = (ObjectString*)object;
+        uint64_t hash = stringHash(str, vm->hash_seed);
+        DedupSlot* slot = findSlot(&table, str, hash);
+        if(slot->str == NULL){
+            if(table.count * 2 >= table.mask){
+                if(!growTable(&table)){
+                    break;      // go on with what was found so far
+                }
+                slot = findSlot(&table, str, hash);
+            }
+            slot->str = str;
+            slot->hash = hash;
+            slot->rank = -1;
+            table.count++;
+            continue;
+        }
+
+        if(slot->rank < 0){
+            slot->rank = stringRank(slot->str);
+        }
+        int rank = stringRank(str);
+        ObjectString* dropped = str;
+        if(rank > slot->rank){
+            dropped = slot->str;
+            slot->str = str;
+            slot->rank = rank;
+        }
+
+        vm->gcStats.dedupStrings++;
+        vm->gcStats.dedupBytes += stringFootprint(dropped);
+    }
+
+    if(redirect && vm->gcStats.dedupStrings > 0){
+        size_t count = redirectEnv(vm, &table, &vm->globals);
+        for(Object* object = vm->objects; object != NULL; object = object->next){
+            if(object->isMarked){
+                count += redirectObject(vm, &table, object);
+            }
+        }
+        vm->gcStats.dedupRefs = count;
+    }
+
+    free(table.slots);
+    return vm->gcStats.dedupRefs;
+}
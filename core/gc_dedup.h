@@ -0,0 +1,23 @@
+#ifndef CIETO_GC_DEDUP_H
+#define CIETO_GC_DEDUP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "vm.h"
+
+/*
+ * Finds marked strings with the same contents, once marking is done, and
+ * records how many there are and the heap they take in vm->gcStats. With
+ * redirect set, lists, maps, instance fields, upvalues and globals that
+ * hold a duplicate are pointed at one copy, preferring the interned one,
+ * then one that owns its bytes over a view. Registers, constants and
+ * anything C code may hold are left alone, so a duplicate still in use
+ * there stays valid.
+ *
+ * Returns the number of references redirected; the caller marks again
+ * when it is not 0, so copies nothing else reaches are swept right away.
+*/
+size_t gcDedupStrings(VM* vm, bool redirect);
+
+#endif // CIETO_GC_DEDUP_H
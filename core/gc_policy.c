@@ -106,6 +106,7 @@ void initGC(VM* vm){
     vm->gcThreshold = 1024 * 1024 * 10; // 10MB
     vm->nextGC = vm->gcThreshold;
     vm->gcMode = GC_MODE_AUTO;
+    vm->gcDedup = GC_DEDUP_OFF;
     vm->gcPolicy = &AUTO_POLICY;
     vm->gcRunning = false;
     memset(&vm->gcStats, 0, sizeof(vm->gcStats));
@@ -160,6 +161,34 @@ bool gcModeFromString(const char* name, GCMode* mode){
     return false;
 }
 
+const char* gcDedupName(GCDedup dedup){
+    switch(dedup){
+        case GC_DEDUP_OFF:      return "off";
+        case GC_DEDUP_REPORT:   return "report";
+        case GC_DEDUP_ON:       return "on";
+    }
+    return "off";
+}
+
+bool gcDedupFromString(const char* name, GCDedup* dedup){
+    if(strcmp(name, "off") == 0){
+        *dedup = GC_DEDUP_OFF;
+        return true;
+    }
+
+    if(strcmp(name, "report") == 0){
+        *dedup = GC_DEDUP_REPORT;
+        return true;
+    }
+
+    if(strcmp(name, "on") == 0){
+        *dedup = GC_DEDUP_ON;
+        return true;
+    }
+
+    return false;
+}
+
 void gcSetMode(VM* vm, GCMode mode){
     const GCPolicy* oldPolicy = vm->gcPolicy;
     const GCPolicy* newPolicy = gcPolicyForMode(mode);
@@ -28,6 +28,9 @@ const char* gcModeName(GCMode mode);
 bool gcModeFromString(const char* str, GCMode* mode);
 void gcSetMode(VM* vm, GCMode mode);
 
+const char* gcDedupName(GCDedup dedup);
+bool gcDedupFromString(const char* str, GCDedup* dedup);
+
 void gcOnAlloc(VM* vm, void* ptr, size_t oldSize, size_t newSize);
 bool gcCollect(VM* vm, GCReason reason);
 void gcWriteBarrier(VM* vm, Object* owner, Value value);
@@ -14,4 +14,10 @@ typedef enum{
     GC_MODE_OFF
 }GCMode;
 
+typedef enum{
+    GC_DEDUP_OFF,
+    GC_DEDUP_REPORT,    // count duplicate strings, change nothing
+    GC_DEDUP_ON         // also point references at one copy
+}GCDedup;
+
 #endif // CIETO_GC_TYPES_H
\ No newline at end of file
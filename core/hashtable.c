@@ -23,7 +23,7 @@ void initHashTable(HashTable* table){
 
 static uint64_t hashValue(Value value, uint64_t seed){
     if(IS_STRING(value)){
-        return AS_STRING(value)->hash;
+        return stringHash(AS_STRING(value), seed);
     }
     if(IS_NUM(value)){
         double num = AS_NUM(value);
@@ -294,6 +294,14 @@ static void adjustCapacity(VM* vm, HashTable* table, int capacity){
     table->count = oldCount;
 }
 
+void tableReserve(VM* vm, HashTable* table, int count){
+    int capacity = capacityForCount(count);
+
+    if(capacity > table->capacity){
+        adjustCapacity(vm, table, capacity);
+    }
+}
+
 bool tableMerge(VM* vm, HashTable* from, HashTable* to){
     for(int i = 0; i < from->capacity; i++){
         Entry* entry = &from->entries[i];
@@ -304,6 +312,20 @@ bool tableMerge(VM* vm, HashTable* from, HashTable* to){
     return true;
 }
 
+void tableCopy(VM* vm, HashTable* from, HashTable* to){
+    // to must be empty; with the same seed every entry keeps its bucket
+    if(from->count == 0){
+        return;
+    }
+
+    Entry* entries = (Entry*)reallocate(vm, NULL, 0, sizeof(Entry) * from->capacity);
+    memcpy(entries, from->entries, sizeof(Entry) * from->capacity);
+
+    to->entries = entries;
+    to->capacity = from->capacity;
+    to->count = from->count;
+}
+
 ObjectString* tableGetInternedString(VM* vm, HashTable* table, const char* chars, int len, uint64_t hash){
     if(table->count == 0){
         return NULL;
@@ -25,6 +25,8 @@ bool tableGet(VM* vm, HashTable* table, Value key, Value* value);
 bool tableSet(VM* vm, HashTable* table, Value key, Value value);
 bool tableRemove(VM* vm, HashTable* table, Value key);
 bool tableMerge(VM* vm, HashTable* from, HashTable* to);
+void tableCopy(VM* vm, HashTable* from, HashTable* to);
+void tableReserve(VM* vm, HashTable* table, int count);    // room for count, no regrowing
 
 ObjectString* tableGetInternedString(VM* vm, HashTable* table, const char* chars, int len, uint64_t hash);
 void tableRemoveWhite(VM* vm, HashTable* table);
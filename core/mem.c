@@ -5,6 +5,7 @@
 #include "mem.h"
 #include "compiler.h"
 #include "gc_policy.h"
+#include "gc_dedup.h"
 
 #define GC_HEAP_GROW_FACTOR 2
 // #define GC_MIN_THRESHOLD 1024 * 1024 * 10
@@ -34,6 +35,17 @@ bool gcMarkSweep(VM* vm, GCReason reason){
     markRoots(vm);
     double markMs = nowMs() - phaseStart;
 
+    if(vm->gcDedup != GC_DEDUP_OFF){
+        phaseStart = nowMs();
+        bool redirect = vm->gcDedup == GC_DEDUP_ON && vm->nativeDepth == 0;
+        if(gcDedupStrings(vm, redirect) > 0){
+            // the copies given up may still be reached from registers
+            clearMarks(vm);
+            markRoots(vm);
+        }
+        vm->gcStats.dedupMs += nowMs() - phaseStart;
+    }
+
 #ifdef DEBUG_LOG_GC
     printf("Marked objects. Starting sweep...\n");
 #endif
@@ -101,6 +113,7 @@ static void traceRef(VM* vm, Object* object){
             ObjectFunc* func = (ObjectFunc*)object;
             markObject(vm, (Object*)func->name);
             markObject(vm, (Object*)func->srcName);
+            markObject(vm, (Object*)func->shared);
             markArray(vm, &func->chunk.constants);
             break;
         }
@@ -108,7 +121,11 @@ static void traceRef(VM* vm, Object* object){
             ObjectClosure* closure = (ObjectClosure*)object;
             markObject(vm, (Object*)closure->func);
             for(int i = 0; i < closure->upvalueCnt; i++){
-                markObject(vm, (Object*)closure->upvalues[i]);
+                if(IS_FLAT_UPVALUE(closure->func, i)){
+                    markValue(vm, closure->upvalues[i].value);
+                }else{
+                    markObject(vm, (Object*)closure->upvalues[i].ref);
+                }
             }
             break;
         }
@@ -147,7 +164,39 @@ static void traceRef(VM* vm, Object* object){
             markValue(vm, iterator->receiver);
             break;
         }
+        case OBJECT_ROPE:{
+            // recurse into the shorter half only, a long append chain is walked in place
+            ObjectRope* rope = (ObjectRope*)object;
+            for(;;){
+                markObject(vm, (Object*)rope->flat);
+                if(rope->left == NULL){
+                    break;
+                }
+
+                Object* shorter = rope->left;
+                Object* longer = rope->right;
+                if(ropePartLength(shorter) > ropePartLength(longer)){
+                    shorter = rope->right;
+                    longer = rope->left;
+                }
+                markObject(vm, shorter);
+
+                if(longer->type != OBJECT_ROPE){
+                    // a string view still has to mark its owner
+                    markObject(vm, longer);
+                    break;
+                }
+                if(longer->isMarked){
+                    break;
+                }
+                longer->isMarked = true;
+                rope = (ObjectRope*)longer;
+            }
+            break;
+        }
         case OBJECT_STRING:
+            markObject(vm, (Object*)((ObjectString*)object)->owner);
+            break;
         case OBJECT_CFUNC:  
         case OBJECT_FILE:
             break;
@@ -212,6 +261,19 @@ static void markRoots(VM* vm){
     }
 
     markObject(vm, (Object*)vm->initString);
+
+    for(int i = 0; i < 256; i++){
+        markObject(vm, (Object*)vm->charStrings[i]);
+    }
+    for(int i = 0; i < INT_STRING_CACHE; i++){
+        markObject(vm, (Object*)vm->intStrings[i]);
+    }
+}
+
+static void clearMarks(VM* vm){
+    for(Object* object = vm->objects; object != NULL; object = object->next){
+        object->isMarked = false;
+    }
 }
 
 static void sweep(VM* vm){
@@ -234,11 +296,7 @@ static void sweep(VM* vm){
         }
     }
     
-    object = vm->objects;
-    while(object != NULL){
-        object->isMarked = false;
-        object = object->next;
-    }
+    clearMarks(vm);
 }
 
 void* reallocate(VM* vm, void* ptr, size_t oldSize, size_t newSize){
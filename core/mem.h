@@ -21,6 +21,7 @@ void markValue(VM* vm, Value value);
 void markArray(VM* vm, ValueArray* array);
 void collectGarbage(VM* vm);
 static void sweep(VM* vm);
+static void clearMarks(VM* vm);
 
 void* reallocate(VM* vm, void* ptr, size_t oldSize, size_t newSize);
 
@@ -25,7 +25,13 @@ static uint64_t hashString(const char* key, int len){
 */
 
 static uint64_t hashString(const char* key, int len, uint64_t seed){
-    return XXH3_64bits_withSeed(key, (size_t)len, seed);
+    uint64_t hash = XXH3_64bits_withSeed(key, (size_t)len, seed);
+    return hash == STRING_HASH_UNSET ? hash + 1 : hash;
+}
+
+uint64_t computeStringHash(ObjectString* str, uint64_t seed){
+    str->hash = hashString(str->chars, (int)str->length, seed);
+    return str->hash;
 }
 
 static ObjectString* allocString(VM* vm, int len, uint64_t hash){
@@ -33,8 +39,12 @@ static ObjectString* allocString(VM* vm, int len, uint64_t hash){
     
     str->obj.type = OBJECT_STRING;
     str->obj.isMarked = false;
+    str->obj.isInterned = false;
+    str->obj.internAsKey = false;
     str->length = len;
     str->hash = hash;
+    str->chars = str->storage;
+    str->owner = NULL;
     str->obj.next = vm->objects;
     vm->objects = (Object*)str;
 
@@ -52,6 +62,7 @@ ObjectString* copyString(VM* vm, const char* chars, int len){
     ObjectString* str = allocString(vm, len, hash);
     memcpy(str->chars, chars, len);
     str->chars[len] = '\0';
+    str->obj.isInterned = true;
 
     push(vm, OBJECT_VAL(str));
     tableSet(vm, &vm->strings, OBJECT_VAL(str), NULL_VAL);
@@ -71,6 +82,7 @@ ObjectString* takeString(VM* vm, char* chars, int length){
     ObjectString* string = allocString(vm, length, hash);
     memcpy(string->chars, chars, length);
     string->chars[length] = '\0';
+    string->obj.isInterned = true;
 
     push(vm, OBJECT_VAL(string));
     tableSet(vm, &vm->strings, OBJECT_VAL(string), NULL_VAL);
@@ -81,20 +93,71 @@ ObjectString* takeString(VM* vm, char* chars, int length){
     return string;
 }
 
-ObjectString* copyStringRaw(VM* vm, const char* chars, int len){
-    uint64_t hash = hashString(chars, len, vm->hash_seed);
+// short and free of spaces and control bytes: a word, a number, a key
+static bool isTokenLike(const char* chars, int len){
+    if(len > STRING_INTERN_MAX){
+        return false;
+    }
+    for(int i = 0; i < len; i++){
+        unsigned char c = (unsigned char)chars[i];
+        if(c <= ' ' || c == 0x7f){
+            return false;
+        }
+    }
+    return true;
+}
 
-    ObjectString* str = allocString(vm, len, hash);
+ObjectString* copyStringAdaptive(VM* vm, const char* chars, int len){
+    if(isTokenLike(chars, len)){
+        return copyString(vm, chars, len);
+    }
+    ObjectString* str = copyStringRaw(vm, chars, len);
+    str->obj.internAsKey = true;
+    return str;
+}
+
+ObjectString* internString(VM* vm, ObjectString* str){
+    if(str->obj.isInterned){
+        return str;
+    }
+
+    uint64_t hash = stringHash(str, vm->hash_seed);
+    ObjectString* interned = tableGetInternedString(vm, &vm->strings, str->chars, (int)str->length, hash);
+    if(interned != NULL){
+        return interned;
+    }
+    if(str->chars != str->storage){
+        // a view, or one that made its own copy of a view
+        return copyString(vm, str->chars, (int)str->length);
+    }
+
+    // it owns its bytes, so it can be the table entry itself
+    str->obj.isInterned = true;
+    str->obj.internAsKey = false;
+    push(vm, OBJECT_VAL(str));
+    tableSet(vm, &vm->strings, OBJECT_VAL(str), NULL_VAL);
+    pop(vm);
+    return str;
+}
+
+ObjectString* copyStringRaw(VM* vm, const char* chars, int len){
+    ObjectString* str = allocString(vm, len, STRING_HASH_UNSET);
     memcpy(str->chars, chars, len);
     str->chars[len] = '\0';
 
     return str;
 }
 
-ObjectString* takeStringRaw(VM* vm, char* chars, int length){
-    uint64_t hash = hashString(chars, length, vm->hash_seed);
+ObjectString* newStringRaw(VM* vm, int len){
+    // the caller fills chars before anything can read them
+    ObjectString* str = allocString(vm, len, STRING_HASH_UNSET);
+    str->chars[len] = '\0';
 
-    ObjectString* string = allocString(vm, length, hash);
+    return str;
+}
+
+ObjectString* takeStringRaw(VM* vm, char* chars, int length){
+    ObjectString* string = allocString(vm, length, STRING_HASH_UNSET);
     memcpy(string->chars, chars, length);
     string->chars[length] = '\0';
 
@@ -105,19 +168,262 @@ ObjectString* takeStringRaw(VM* vm, char* chars, int length){
 
 ObjectString* concatStringRaw(VM* vm, ObjectString* left, ObjectString* right){
     int length = (int)(left->length + right->length);
-    uint64_t hash = 0;
-
-    ObjectString* str = allocString(vm, length, hash);
+    ObjectString* str = allocString(vm, length, STRING_HASH_UNSET);
 
     memcpy(str->chars, left->chars, left->length);
     memcpy(str->chars + left->length, right->chars, right->length);
     str->chars[length] = '\0';
 
-    str->hash = hashString(str->chars, length, vm->hash_seed);
+    return str;
+}
+
+ObjectString* concatStringsRaw(VM* vm, Value* strings, int count){
+    // every value must be a string; the result is sized once
+    size_t length = 0;
+    for(int i = 0; i < count; i++){
+        length += AS_STRING(strings[i])->length;
+    }
+
+    ObjectString* str = allocString(vm, (int)length, STRING_HASH_UNSET);
+
+    char* dest = str->chars;
+    for(int i = 0; i < count; i++){
+        ObjectString* part = AS_STRING(strings[i]);
+        memcpy(dest, part->chars, part->length);
+        dest += part->length;
+    }
+    *dest = '\0';
 
     return str;
 }
 
+// a flattened rope is just its string
+static Object* ropePart(Object* part){
+    if(part->type == OBJECT_ROPE && ((ObjectRope*)part)->flat != NULL){
+        return (Object*)((ObjectRope*)part)->flat;
+    }
+    return part;
+}
+
+static ObjectRope* newRope(VM* vm, Object* left, Object* right){
+    ObjectRope* rope = (ObjectRope*)reallocate(vm, NULL, 0, sizeof(ObjectRope));
+    rope->obj.type = OBJECT_ROPE;
+    rope->obj.isMarked = false;
+    rope->length = ropePartLength(left) + ropePartLength(right);
+    rope->left = left;
+    rope->right = right;
+    rope->flat = NULL;
+
+    rope->obj.next = vm->objects;
+    vm->objects = (Object*)rope;
+    return rope;
+}
+
+Object* concatStringParts(VM* vm, Object* left, Object* right){
+    left = ropePart(left);
+    right = ropePart(right);
+
+    size_t leftLen = ropePartLength(left);
+    size_t rightLen = ropePartLength(right);
+    if(leftLen == 0) return right;
+    if(rightLen == 0) return left;
+
+    if(leftLen + rightLen < ROPE_MIN_LENGTH){
+        // ropes are never this short, both are strings
+        return (Object*)concatStringRaw(vm, (ObjectString*)left, (ObjectString*)right);
+    }
+
+    if(left->type == OBJECT_ROPE && right->type == OBJECT_STRING){
+        ObjectRope* rope = (ObjectRope*)left;
+        if(rope->right->type == OBJECT_STRING && ropePartLength(rope->right) + rightLen <= ROPE_LEAF_MAX){
+            ObjectString* leaf = concatStringRaw(vm, (ObjectString*)rope->right, (ObjectString*)right);
+            push(vm, OBJECT_VAL(leaf));
+            ObjectRope* result = newRope(vm, rope->left, (Object*)leaf);
+            pop(vm);
+            return (Object*)result;
+        }
+    }
+
+    return (Object*)newRope(vm, left, right);
+}
+
+void ropeCopy(ObjectRope* rope, char* dest){
+    /*
+     * The shorter half is copied first and the longer one waits. Each
+     * waiting part was pushed from inside the shorter half of the one
+     * below it, so 64 slots cover any length.
+    */
+    struct{ Object* part; size_t at; } pending[64];
+    int count = 0;
+
+    Object* part = (Object*)rope;
+    size_t at = 0;
+    for(;;){
+        part = ropePart(part);
+        if(part->type == OBJECT_ROPE){
+            ObjectRope* node = (ObjectRope*)part;
+            size_t leftLen = ropePartLength(node->left);
+            if(leftLen <= ropePartLength(node->right)){
+                pending[count].part = node->right;
+                pending[count].at = at + leftLen;
+                part = node->left;
+            }else{
+                pending[count].part = node->left;
+                pending[count].at = at;
+                part = node->right;
+                at += leftLen;
+            }
+            count++;
+            continue;
+        }
+
+        ObjectString* str = (ObjectString*)part;
+        memcpy(dest + at, str->chars, str->length);
+        if(count == 0){
+            break;
+        }
+        count--;
+        part = pending[count].part;
+        at = pending[count].at;
+    }
+}
+
+ObjectString* flattenRope(VM* vm, ObjectRope* rope){
+    if(rope->flat != NULL){
+        return rope->flat;
+    }
+
+    ObjectString* str = allocString(vm, (int)rope->length, STRING_HASH_UNSET);
+    ropeCopy(rope, str->chars);
+    str->chars[rope->length] = '\0';
+
+    rope->flat = str;
+    rope->left = NULL;
+    rope->right = NULL;
+    return str;
+}
+
+ObjectString* newStringView(VM* vm, ObjectString* str, size_t start, size_t length){
+    if(start == 0 && length == str->length){
+        return str;
+    }
+    if(length < STRING_VIEW_MIN){
+        return copyStringRaw(vm, str->chars + start, (int)length);
+    }
+
+    // a view of a view points into the same owner
+    ObjectString* owner = str->owner != NULL ? str->owner : str;
+
+    ObjectString* view = (ObjectString*)reallocate(vm, NULL, 0, sizeof(ObjectString));
+    view->obj.type = OBJECT_STRING;
+    view->obj.isMarked = false;
+    view->obj.isInterned = false;
+    view->obj.internAsKey = false;
+    view->length = length;
+    view->hash = STRING_HASH_UNSET;
+    view->chars = str->chars + start;
+    view->owner = owner;
+
+    view->obj.next = vm->objects;
+    vm->objects = (Object*)view;
+    return view;
+}
+
+char* materializeView(ObjectString* str){
+    ObjectString* owner = str->owner;
+    if(str->chars + str->length == owner->chars + owner->length){
+        return str->chars;  // a suffix, the owner's NUL ends it too
+    }
+
+    // outside the GC heap, a native may hold unrooted objects right now
+    char* chars = (char*)malloc(str->length + 1);
+    if(chars == NULL){
+        exit(EXIT_FAILURE);
+    }
+    memcpy(chars, str->chars, str->length);
+    chars[str->length] = '\0';
+
+    str->chars = chars;
+    str->owner = NULL;
+    return chars;
+}
+
+#ifdef _WIN32
+    #define PATH_SEP '\\'
+    #define IS_SEP(c) ((c) == '\\' || (c) == '/')
+#else
+    #define PATH_SEP '/'
+    #define IS_SEP(c) ((c) == '/')
+#endif
+
+static bool isValidPath(ObjectString* str){
+    for(int i = 0; i < str->length; i++){
+        char c = str->chars[i];
+        if(c < 32) return false;
+        switch(c){
+            case '<': case '>': case '*': case '"': 
+            case '|': case '?': return false;
+            case ':': 
+                #ifdef _WIN32
+                if (!(i == 1 && ((str->chars[0] >= 'a' && str->chars[0] <= 'z') || 
+                                 (str->chars[0] >= 'A' && str->chars[0] <= 'Z')))) {
+                    return false;
+                }
+                #endif
+                break;
+        }
+    }
+    return true;
+}
+
+ObjectString* joinPathRaw(VM* vm, ObjectString* head, ObjectString* tail){
+    // NULL if either part contains characters not allowed in a path
+    if(!isValidPath(head) || !isValidPath(tail)){
+        return NULL;
+    }
+
+    bool resetPath = false;
+    #ifdef _WIN32
+        if(tail->length >= 2 && tail->chars[1] == ':' && 
+           ((tail->chars[0] >= 'a' && tail->chars[0] <= 'z') || 
+            (tail->chars[0] >= 'A' && tail->chars[0] <= 'Z')
+        )){
+            resetPath = true;
+        }
+    #endif
+    if(tail->length > 0 && IS_SEP(tail->chars[0])) resetPath = true;
+
+    if(resetPath || head->length == 0){
+        return tail;
+    }else if(tail->length == 0){
+        return head;
+    }
+
+    bool hasSepA = IS_SEP(head->chars[head->length - 1]);
+    bool hasSepB = IS_SEP(tail->chars[0]);
+
+    int length = head->length + tail->length - hasSepA - hasSepB + 1;
+    // add 1 for sep; it is the length of valid chars
+    ObjectString* str = allocString(vm, length, STRING_HASH_UNSET);
+
+    memcpy(str->chars, head->chars, head->length);
+
+    if(!hasSepA && !hasSepB){
+        str->chars[head->length] = PATH_SEP;
+        memcpy(str->chars + head->length + 1, tail->chars, tail->length);
+    }else if(hasSepA && hasSepB){
+        memcpy(str->chars + head->length, tail->chars + 1, tail->length - 1);
+    }else{
+        memcpy(str->chars + head->length, tail->chars, tail->length);
+    }
+    str->chars[length] = '\0';
+
+    return str;
+}
+
+#undef PATH_SEP
+#undef IS_SEP
+
 ObjectList* newList(VM* vm){
     ObjectList* list = (ObjectList*)reallocate(vm, NULL, 0, sizeof(ObjectList));
     list->obj.type = OBJECT_LIST;
@@ -167,6 +473,12 @@ ObjectFunc* newFunction(VM* vm){
     func->srcName = NULL;
     func->type = TYPE_SCRIPT;
     func->fieldOwner = NULL;
+    func->maxRegSlots = 0;
+    func->lazySrc = NULL;
+    func->lazyLen = 0;
+    func->lazyLine = 0;
+    func->flatUpvalues = 0;
+    func->shared = NULL;
     initChunk(&func->chunk);
 
     func->obj.next = vm->objects;
@@ -224,7 +536,7 @@ ObjectUpvalue* newUpvalue(VM* vm, Value* slot){
 }
 
 ObjectClosure* newClosure(VM* vm, ObjectFunc* func, GlobalEnv* globals){
-    size_t size = sizeof(ObjectClosure) + sizeof(ObjectUpvalue*) * func->upvalueCnt;
+    size_t size = sizeof(ObjectClosure) + sizeof(UpvalueSlot) * func->upvalueCnt;
     ObjectClosure* closure = (ObjectClosure*)reallocate(vm, NULL, 0, size);
 
     closure->obj.type = OBJECT_CLOSURE;
@@ -234,7 +546,11 @@ ObjectClosure* newClosure(VM* vm, ObjectFunc* func, GlobalEnv* globals){
     closure->upvalueCnt = func->upvalueCnt;
 
     for(int i = 0; i < func->upvalueCnt; i++){
-        closure->upvalues[i] = NULL;
+        if(IS_FLAT_UPVALUE(func, i)){
+            closure->upvalues[i].value = NULL_VAL;
+        }else{
+            closure->upvalues[i].ref = NULL;
+        }
     }
 
     closure->obj.next = vm->objects;
@@ -317,7 +633,14 @@ void freeObject(VM* vm, Object* object){
     switch(object->type){
         case OBJECT_STRING:{
             ObjectString* string = (ObjectString*)object;
-            reallocate(vm, object, sizeof(ObjectString) + string->length + 1, 0);
+            if(string->chars == string->storage){
+                reallocate(vm, object, sizeof(ObjectString) + string->length + 1, 0);
+                break;
+            }
+            if(string->owner == NULL){
+                free(string->chars);    // a materialized view
+            }
+            reallocate(vm, object, sizeof(ObjectString), 0);
             break;
         }
         case OBJECT_LIST:{
@@ -335,6 +658,9 @@ void freeObject(VM* vm, Object* object){
         case OBJECT_FUNC:{
             ObjectFunc* func = (ObjectFunc*)object;
             freeChunk(vm, &func->chunk);
+            if(func->lazySrc != NULL){
+                FREE_ARRAY(vm, char, func->lazySrc, func->lazyLen + 1);
+            }
             reallocate(vm, object, sizeof(ObjectFunc), 0);
             break;
         }
@@ -350,7 +676,7 @@ void freeObject(VM* vm, Object* object){
         }
         case OBJECT_CLOSURE:{
             ObjectClosure* closure = (ObjectClosure*)object;
-            size_t size = sizeof(ObjectClosure) + sizeof(ObjectUpvalue*) * closure->upvalueCnt;
+            size_t size = sizeof(ObjectClosure) + sizeof(UpvalueSlot) * closure->upvalueCnt;
             reallocate(vm, object, size, 0);
             break;
         }
@@ -387,6 +713,10 @@ void freeObject(VM* vm, Object* object){
             reallocate(vm, object, sizeof(ObjectIterator), 0);
             break;
         }
+        case OBJECT_ROPE:{
+            reallocate(vm, object, sizeof(ObjectRope), 0);
+            break;
+        }
     }
 }
 
@@ -482,5 +812,23 @@ void objectWrite(Value value, Writer* writer){
         case OBJECT_ITERATOR:
             writerWCString(writer, "<iterator>");
             break;
+
+        case OBJECT_ROPE:{
+            ObjectRope* rope = AS_ROPE(value);
+            if(rope->flat != NULL){
+                writerW(writer, rope->flat->chars, rope->flat->length);
+                break;
+            }
+
+            char* chars = (char*)malloc(rope->length);
+            if(chars == NULL){
+                writerWCString(writer, "<rope>");
+                break;
+            }
+            ropeCopy(rope, chars);
+            writerW(writer, chars, rope->length);
+            free(chars);
+            break;
+        }
     }
 }
\ No newline at end of file
@@ -21,7 +21,10 @@ typedef void (*HostCFunc)(CieCall* call, void* userData);
 
 #define IS_STRING(value)        (IS_OBJECT(value) && OBJECT_TYPE(value) == OBJECT_STRING)
 #define AS_STRING(value)        ((ObjectString*)AS_OBJECT(value))
-#define AS_CSTRING(value)       (((ObjectString*)AS_OBJECT(value))->chars)
+#define AS_CSTRING(value)       stringCString((ObjectString*)AS_OBJECT(value))
+
+#define IS_ROPE(value)          (IS_OBJECT(value) && OBJECT_TYPE(value) == OBJECT_ROPE)
+#define AS_ROPE(value)          ((ObjectRope*)AS_OBJECT(value))
 
 #define IS_LIST(value)          (IS_OBJECT(value) && OBJECT_TYPE(value) == OBJECT_LIST)
 #define AS_LIST(value)          ((ObjectList*)AS_OBJECT(value))
@@ -71,27 +74,106 @@ typedef enum{
     OBJECT_BOUND_METHOD,
     OBJECT_FILE,
     OBJECT_ITERATOR,
+    OBJECT_ROPE,
 }ObjectType;
 
 typedef struct Object{
     ObjectType type;
     bool isMarked;
+    bool isInterned;                // strings only: the entry in vm->strings
+    bool internAsKey;               // strings only: raw input, intern as a map key
     struct Object* next;
 }Object;
 
+/*
+ * Interned strings are hashed when they are made, the lookup needs it.
+ * The Raw constructors leave hash at STRING_HASH_UNSET and stringHash()
+ * fills it in the first time the string is used as a key.
+*/
+#define STRING_HASH_UNSET 0
+
+/*
+ * Strings read from outside the program (file contents, lines, command
+ * output, paths) go through copyStringAdaptive(): only short,
+ * token-like ones are interned, bulk data stays raw so it never enters
+ * vm->strings. Those raw strings are tagged internAsKey, and one that
+ * becomes a map key is interned then, by internString(). Other raw
+ * strings, like concatenation results, are left alone.
+*/
+#define STRING_INTERN_MAX 32
+
+/*
+ * A view is a string whose chars point into its owner's storage, made by
+ * slicing, sub(), trim() and split() instead of a copy. It keeps the
+ * owner alive and is not NUL-terminated, so code that hands chars to C
+ * goes through AS_CSTRING/stringCString(), which gives a view its own
+ * copy the first time. Shorter views than STRING_VIEW_MIN are copied.
+*/
+#define STRING_VIEW_MIN 32
+
 typedef struct ObjectString{
     Object obj;
     size_t length;
     uint64_t hash;
-    char chars[];   // Flexible array member
+    char* chars;                    // storage, or a window into owner's
+    struct ObjectString* owner;     // NULL unless a view
+    char storage[];                 // Flexible array member
 }ObjectString;
 
+char* materializeView(ObjectString* str);
+
+static inline char* stringCString(ObjectString* str){
+    return str->owner == NULL ? str->chars : materializeView(str);
+}
+
+uint64_t computeStringHash(ObjectString* str, uint64_t seed);
+
+static inline uint64_t stringHash(ObjectString* str, uint64_t seed){
+    return str->hash != STRING_HASH_UNSET ? str->hash : computeStringHash(str, seed);
+}
+
 ObjectString* copyString(VM* vm, const char* chars, int len);
 ObjectString* takeString(VM* vm, char* chars, int length);
+ObjectString* copyStringAdaptive(VM* vm, const char* chars, int len);
+ObjectString* internString(VM* vm, ObjectString* str);
 
 ObjectString* copyStringRaw(VM* vm, const char* chars, int len);
+ObjectString* newStringRaw(VM* vm, int len);
 ObjectString* takeStringRaw(VM* vm, char* chars, int length);
 ObjectString* concatStringRaw(VM* vm, ObjectString* left, ObjectString* right);
+ObjectString* concatStringsRaw(VM* vm, Value* strings, int count);
+ObjectString* joinPathRaw(VM* vm, ObjectString* head, ObjectString* tail);
+ObjectString* newStringView(VM* vm, ObjectString* str, size_t start, size_t length);
+
+/*
+ * A long string built by OP_ADD, kept as its two halves so that appending
+ * in a loop does not copy everything built so far. left and right are
+ * strings or ropes. The first flattenRope() copies them into flat and drops
+ * them; from then on the rope stands for flat.
+ *
+ * Ropes only live in registers, upvalues and globals. The VM flattens one
+ * before it reaches a native, a container, a map key or the host.
+*/
+#define ROPE_MIN_LENGTH 256     // shorter results are copied as before
+#define ROPE_LEAF_MAX   256     // short appends are merged into the last leaf
+
+typedef struct ObjectRope{
+    Object obj;
+    size_t length;
+    Object* left;
+    Object* right;
+    ObjectString* flat;
+}ObjectRope;
+
+static inline size_t ropePartLength(Object* part){
+    return part->type == OBJECT_STRING ? ((ObjectString*)part)->length : ((ObjectRope*)part)->length;
+}
+
+// left and right are strings or ropes, rooted by the caller
+Object* concatStringParts(VM* vm, Object* left, Object* right);
+// the rope must be rooted, the copy may collect
+ObjectString* flattenRope(VM* vm, ObjectRope* rope);
+void ropeCopy(ObjectRope* rope, char* dest);
 
 typedef struct ObjectList{
     Object obj;
@@ -128,6 +210,17 @@ typedef struct ObjectFunc{
     FuncType type;
     struct ObjectClass* fieldOwner;
     int maxRegSlots;
+
+    /*
+     * Lazily compiled functions keep a copy of their source span
+     * "(params) { body }" here until the first call compiles it.
+    */
+    char* lazySrc;
+    int lazyLen;
+    int lazyLine;
+
+    uint64_t flatUpvalues;          // bit i: upvalue i is held by value
+    struct ObjectClosure* shared;   // the closure of a function without upvalues
 }ObjectFunc;
 
 ObjectFunc* newFunction(VM* vm);
@@ -177,12 +270,26 @@ typedef struct ObjectUpvalue{
     struct ObjectUpvalue* next;
 }ObjectUpvalue;
 
+/*
+ * A captured variable that is never assigned after its initializer is
+ * copied into the closure, with no ObjectUpvalue and nothing to close.
+ * Only the first FLAT_UPVALUE_MAX upvalues of a function can be flat.
+*/
+#define FLAT_UPVALUE_MAX 64
+#define IS_FLAT_UPVALUE(func, i) \
+    ((i) < FLAT_UPVALUE_MAX && ((func)->flatUpvalues >> (i) & 1))
+
+typedef union{
+    ObjectUpvalue* ref;
+    Value value;    // flat
+}UpvalueSlot;
+
 typedef struct ObjectClosure{
     Object obj;
     ObjectFunc* func; // point to func template
     GlobalEnv* globals;   // point to defining module's global env for global access
     int upvalueCnt;
-    ObjectUpvalue* upvalues[]; // pointer array
+    UpvalueSlot upvalues[];
 }ObjectClosure;
 
 ObjectUpvalue* newUpvalue(VM* vm, Value* slot);
@@ -0,0 +1,52 @@
+#ifndef CIETO_SIMD_H
+#define CIETO_SIMD_H
+
+#include <stdint.h>
+
+/*
+ * One vector of bytes for the string kernels: 32 bytes with AVX2, 16 with
+ * SSE2, and BLOCK_SIZE left undefined on targets with neither, where the
+ * kernels keep a scalar loop. Loads are unaligned; callers keep them
+ * inside the bytes they own.
+*/
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX2__)
+typedef __m256i Block;
+#define BLOCK_SIZE          32
+#define blockLoad(p)        _mm256_loadu_si256((const __m256i*)(p))
+#define blockStore(p, a)    _mm256_storeu_si256((__m256i*)(p), (a))
+#define blockSplat(c)       _mm256_set1_epi8((char)(c))
+#define blockEq(a, b)       _mm256_cmpeq_epi8((a), (b))
+#define blockGt(a, b)       _mm256_cmpgt_epi8((a), (b))
+#define blockOr(a, b)       _mm256_or_si256((a), (b))
+#define blockAnd(a, b)      _mm256_and_si256((a), (b))
+#define blockXor(a, b)      _mm256_xor_si256((a), (b))
+#define blockMask(a)        ((uint32_t)_mm256_movemask_epi8(a))
+#elif defined(__SSE2__)
+typedef __m128i Block;
+#define BLOCK_SIZE          16
+#define blockLoad(p)        _mm_loadu_si128((const __m128i*)(p))
+#define blockStore(p, a)    _mm_storeu_si128((__m128i*)(p), (a))
+#define blockSplat(c)       _mm_set1_epi8((char)(c))
+#define blockEq(a, b)       _mm_cmpeq_epi8((a), (b))
+#define blockGt(a, b)       _mm_cmpgt_epi8((a), (b))
+#define blockOr(a, b)       _mm_or_si128((a), (b))
+#define blockAnd(a, b)      _mm_and_si128((a), (b))
+#define blockXor(a, b)      _mm_xor_si128((a), (b))
+#define blockMask(a)        ((uint32_t)_mm_movemask_epi8(a))
+#endif
+
+#ifdef BLOCK_SIZE
+#define BLOCK_ALL           ((uint32_t)((1ull << BLOCK_SIZE) - 1))
+
+static inline Block blockIn(Block bytes, char lo, char hi){
+    // lo <= byte <= hi, bytes above 0x7f are negative and never match
+    return blockAnd(blockGt(bytes, blockSplat(lo - 1)), blockGt(blockSplat(hi + 1), bytes));
+}
+#endif
+
+#endif // CIETO_SIMD_H
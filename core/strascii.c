@@ -0,0 +1,97 @@
+#include "strascii.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simd.h"
+
+static inline bool inClass(unsigned char c, AsciiClass cls){
+    switch(cls){
+        case ASCII_DIGIT:   return c >= '0' && c <= '9';
+        case ASCII_ALPHA:   return (unsigned char)((c | 0x20) - 'a') < 26;
+        case ASCII_SPACE:   return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+    return false;
+}
+
+#ifdef BLOCK_SIZE
+static inline Block blockClass(Block bytes, AsciiClass cls){
+    switch(cls){
+        case ASCII_DIGIT:
+            return blockIn(bytes, '0', '9');
+        case ASCII_ALPHA:
+            return blockIn(blockOr(bytes, blockSplat(0x20)), 'a', 'z');
+        case ASCII_SPACE:
+            return blockOr(blockEq(bytes, blockSplat(' ')), blockIn(bytes, '\t', '\r'));
+    }
+    return blockSplat(0);
+}
+
+static inline void blockCase(char* dst, const char* src, char lo, char hi){
+    // flip bit 5 of the letters in lo..hi
+    Block bytes = blockLoad(src);
+    Block flip = blockAnd(blockIn(bytes, lo, hi), blockSplat(0x20));
+    blockStore(dst, blockXor(bytes, flip));
+}
+#endif
+
+void asciiUpper(char* dst, const char* src, size_t length){
+    size_t i = 0;
+#ifdef BLOCK_SIZE
+    for(; i + BLOCK_SIZE <= length; i += BLOCK_SIZE){
+        blockCase(dst + i, src + i, 'a', 'z');
+    }
+#endif
+    for(; i < length; i++){
+        char c = src[i];
+        dst[i] = (c >= 'a' && c <= 'z') ? (char)(c ^ 0x20) : c;
+    }
+}
+
+void asciiLower(char* dst, const char* src, size_t length){
+    size_t i = 0;
+#ifdef BLOCK_SIZE
+    for(; i + BLOCK_SIZE <= length; i += BLOCK_SIZE){
+        blockCase(dst + i, src + i, 'A', 'Z');
+    }
+#endif
+    for(; i < length; i++){
+        char c = src[i];
+        dst[i] = (c >= 'A' && c <= 'Z') ? (char)(c ^ 0x20) : c;
+    }
+}
+
+size_t asciiSpan(const char* chars, size_t length, AsciiClass cls){
+    // most spans, like the spaces trim() meets, end at the first byte
+    if(length == 0 || !inClass((unsigned char)chars[0], cls)) return 0;
+
+    size_t i = 0;
+#ifdef BLOCK_SIZE
+    for(; i + BLOCK_SIZE <= length; i += BLOCK_SIZE){
+        uint32_t outside = ~blockMask(blockClass(blockLoad(chars + i), cls)) & BLOCK_ALL;
+        if(outside != 0){
+            return i + (size_t)__builtin_ctz(outside);
+        }
+    }
+#endif
+    while(i < length && inClass((unsigned char)chars[i], cls)) i++;
+    return i;
+}
+
+size_t asciiSpanBack(const char* chars, size_t length, AsciiClass cls){
+    if(length == 0 || !inClass((unsigned char)chars[length - 1], cls)) return 0;
+
+    size_t end = length;
+#ifdef BLOCK_SIZE
+    for(; end >= BLOCK_SIZE; end -= BLOCK_SIZE){
+        uint32_t outside = ~blockMask(blockClass(blockLoad(chars + end - BLOCK_SIZE), cls)) & BLOCK_ALL;
+        if(outside != 0){
+            // the highest byte outside the class is the last one kept
+            size_t keep = end - BLOCK_SIZE + (size_t)(31 - __builtin_clz(outside)) + 1;
+            return length - keep;
+        }
+    }
+#endif
+    while(end > 0 && inClass((unsigned char)chars[end - 1], cls)) end--;
+    return length - end;
+}
@@ -0,0 +1,27 @@
+#ifndef CIETO_STRASCII_H
+#define CIETO_STRASCII_H
+
+#include <stddef.h>
+
+/*
+ * ASCII kernels for case mapping, trimming and whole-string predicates.
+ * They work a block at a time where the target has SSE2 or AVX2 and byte
+ * by byte on the tail. Classes follow the C locale the VM runs in: bytes
+ * above 0x7f are never letters, digits or space and keep their case.
+*/
+
+typedef enum{
+    ASCII_DIGIT,        // 0-9
+    ASCII_ALPHA,        // A-Z a-z
+    ASCII_SPACE,        // ' ' \t \n \v \f \r, like isspace()
+}AsciiClass;
+
+// dst may be src
+void asciiUpper(char* dst, const char* src, size_t length);
+void asciiLower(char* dst, const char* src, size_t length);
+
+// how many bytes at the start, or the end, belong to the class
+size_t asciiSpan(const char* chars, size_t length, AsciiClass cls);
+size_t asciiSpanBack(const char* chars, size_t length, AsciiClass cls);
+
+#endif // CIETO_STRASCII_H
@@ -0,0 +1,233 @@
+#define _GNU_SOURCE     // memmem()
+
+#include "strsearch.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "simd.h"
+
+#define SEARCH_VERIFY_RATIO 4
+#define SEARCH_VERIFY_SLACK 1024
+
+#define BITS_PER_WORD       (8 * sizeof(size_t))
+#define byteIn(set, c)      ((set)[(c) / BITS_PER_WORD] & ((size_t)1 << ((c) % BITS_PER_WORD)))
+
+static const char* scanFirstByte(const unsigned char* hay, size_t hayLen,
+                                 const unsigned char* needle, size_t needleLen){
+    const unsigned char* last = hay + hayLen - needleLen;
+    for(const unsigned char* p = hay; p <= last; p++){
+        p = (const unsigned char*)memchr(p, needle[0], (size_t)(last - p) + 1);
+        if(p == NULL) return NULL;
+        if(memcmp(p + 1, needle + 1, needleLen - 1) == 0) return (const char*)p;
+    }
+    return NULL;
+}
+
+// maximal suffix of the needle under one byte order, returns its start - 1
+static size_t maximalSuffix(const unsigned char* needle, size_t length, bool reversed, size_t* period){
+    size_t ip = (size_t)-1;
+    size_t jp = 0;
+    size_t k = 1;
+    size_t p = 1;
+
+    while(jp + k < length){
+        unsigned char a = needle[ip + k];
+        unsigned char b = needle[jp + k];
+        if(a == b){
+            if(k == p){
+                jp += p;
+                k = 1;
+            }else{
+                k++;
+            }
+        }else if(reversed ? a < b : a > b){
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        }else{
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+
+    *period = p;
+    return ip;
+}
+
+void initSearcher(Searcher* searcher, const char* needle, size_t length){
+    const unsigned char* n = (const unsigned char*)needle;
+    searcher->needle = n;
+    searcher->length = length;
+
+    if(length <= SEARCH_SHORT_NEEDLE) return;
+
+    memset(searcher->byteset, 0, sizeof(searcher->byteset));
+    for(size_t i = 0; i < length; i++){
+        searcher->byteset[n[i] / BITS_PER_WORD] |= (size_t)1 << (n[i] % BITS_PER_WORD);
+        searcher->shift[n[i]] = i + 1;
+    }
+
+    // critical factorization: the later of the two maximal suffixes
+    size_t period;
+    size_t reversedPeriod;
+    size_t critical = maximalSuffix(n, length, false, &period);
+    size_t reversedCritical = maximalSuffix(n, length, true, &reversedPeriod);
+    if(reversedCritical + 1 > critical + 1){
+        critical = reversedCritical;
+        period = reversedPeriod;
+    }
+
+    if(memcmp(n, n + period, critical + 1) == 0){
+        // periodic needle, remember the matched prefix across shifts
+        searcher->memory = length - period;
+    }else{
+        searcher->memory = 0;
+        size_t right = length - critical - 1;
+        period = (critical > right ? critical : right) + 1;
+    }
+
+    searcher->critical = critical;
+    searcher->period = period;
+}
+
+static const char* searchLong(const Searcher* searcher, const unsigned char* hay, size_t hayLen){
+    const unsigned char* n = searcher->needle;
+    size_t length = searcher->length;
+    size_t critical = searcher->critical;
+    const unsigned char* end = hay + hayLen;
+    size_t mem = 0;
+
+    while((size_t)(end - hay) >= length){
+        // skip on the byte under the needle's end first
+        unsigned char c = hay[length - 1];
+        if(!byteIn(searcher->byteset, c)){
+            hay += length;
+            mem = 0;
+            continue;
+        }
+        size_t k = length - searcher->shift[c];
+        if(k != 0){
+            if(k < mem) k = mem;
+            hay += k;
+            mem = 0;
+            continue;
+        }
+
+        // right half, then left half
+        k = critical + 1 > mem ? critical + 1 : mem;
+        while(k < length && n[k] == hay[k]) k++;
+        if(k < length){
+            hay += k - critical;
+            mem = 0;
+            continue;
+        }
+
+        k = critical + 1;
+        while(k > mem && n[k - 1] == hay[k - 1]) k--;
+        if(k <= mem) return (const char*)hay;
+
+        hay += searcher->period;
+        mem = searcher->memory;
+    }
+    return NULL;
+}
+
+/*
+ * Candidates are filtered on the needle's first and last byte,
+ * SEARCH_STRIDE bytes of positions at a time while the haystack lasts and
+ * then a block at a time, and only the survivors are compared. Inputs
+ * that keep both bytes matching, like runs of one letter, make every
+ * position a candidate, so a long needle hands over to Two-Way once
+ * verifying has cost more than SEARCH_VERIFY_RATIO bytes per byte
+ * scanned, past a small allowance.
+*/
+#ifdef BLOCK_SIZE
+#define SEARCH_STRIDE       64  // bits in one candidate mask
+
+static inline uint64_t candidates(const unsigned char* at, size_t lastAt, Block first, Block last, size_t bytes){
+    Block hits[SEARCH_STRIDE / BLOCK_SIZE];
+    Block any = blockSplat(0);
+    for(size_t b = 0; b < bytes / BLOCK_SIZE; b++){
+        Block head = blockEq(blockLoad(at + b * BLOCK_SIZE), first);
+        Block tail = blockEq(blockLoad(at + b * BLOCK_SIZE + lastAt), last);
+        hits[b] = blockAnd(head, tail);
+        any = blockOr(any, hits[b]);
+    }
+    if(blockMask(any) == 0) return 0;   // most strides, one test for all their blocks
+
+    uint64_t mask = 0;
+    for(size_t b = 0; b < bytes / BLOCK_SIZE; b++){
+        mask |= (uint64_t)blockMask(hits[b]) << (b * BLOCK_SIZE);
+    }
+    return mask;
+}
+#endif
+
+static const char* searchFiltered(const Searcher* searcher, const unsigned char* hay, size_t hayLen){
+    const unsigned char* needle = searcher->needle;
+    size_t needleLen = searcher->length;
+    size_t i = 0;
+#ifdef BLOCK_SIZE
+    bool bounded = needleLen > SEARCH_SHORT_NEEDLE;
+    size_t verified = 0;
+    Block first = blockSplat(needle[0]);
+    Block last = blockSplat(needle[needleLen - 1]);
+
+    // loads stay inside the haystack, the tail goes to the scalar loop
+    while(i + needleLen - 1 + BLOCK_SIZE <= hayLen){
+        uint64_t mask;
+        size_t step;
+        if(i + needleLen - 1 + SEARCH_STRIDE <= hayLen){
+            mask = candidates(hay + i, needleLen - 1, first, last, SEARCH_STRIDE);
+            step = SEARCH_STRIDE;
+        }else{
+            mask = candidates(hay + i, needleLen - 1, first, last, BLOCK_SIZE);
+            step = BLOCK_SIZE;
+        }
+
+        while(mask != 0){
+            size_t at = i + (size_t)__builtin_ctzll(mask);
+            if(memcmp(hay + at + 1, needle + 1, needleLen - 2) == 0){
+                return (const char*)(hay + at);
+            }
+            if(bounded){
+                verified += needleLen;
+                if(verified > SEARCH_VERIFY_RATIO * i + SEARCH_VERIFY_SLACK){
+                    return searchLong(searcher, hay + i, hayLen - i);
+                }
+            }
+            mask &= mask - 1;
+        }
+        i += step;
+    }
+#elif defined(CIETO_HAVE_MEMMEM)
+    return (const char*)memmem(hay, hayLen, needle, needleLen);
+#else
+    if(needleLen > SEARCH_SHORT_NEEDLE){
+        return searchLong(searcher, hay, hayLen);
+    }
+#endif
+    return scanFirstByte(hay + i, hayLen - i, needle, needleLen);
+}
+
+const char* searchNext(const Searcher* searcher, const char* hay, size_t hayLen){
+    size_t length = searcher->length;
+    if(length == 0) return hay;
+    if(length > hayLen) return NULL;
+    if(length == 1) return (const char*)memchr(hay, searcher->needle[0], hayLen);
+
+    return searchFiltered(searcher, (const unsigned char*)hay, hayLen);
+}
+
+const char* searchBytes(const char* hay, size_t hayLen, const char* needle, size_t needleLen){
+    if(needleLen <= SEARCH_SHORT_NEEDLE || needleLen > hayLen){
+        // no preprocessing needed, skip filling the tables
+        Searcher searcher = {.needle = (const unsigned char*)needle, .length = needleLen};
+        return searchNext(&searcher, hay, hayLen);
+    }
+
+    Searcher searcher;
+    initSearcher(&searcher, needle, needleLen);
+    return searchNext(&searcher, hay, hayLen);
+}
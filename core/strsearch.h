@@ -0,0 +1,44 @@
+#ifndef CIETO_STRSEARCH_H
+#define CIETO_STRSEARCH_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Substring search over byte ranges. Lengths bound both sides, so views
+ * and strings with embedded '\0' are searched whole.
+ *
+ * A one-byte needle goes to memchr. Longer needles filter 64 candidate
+ * positions at a time on their first and last byte (SSE2 or AVX2) and
+ * verify the few survivors. Needles over SEARCH_SHORT_NEEDLE bytes fall
+ * back to Two-Way when too many candidates survive, so periodic inputs
+ * like "aaaa...ab" stay linear; its last-byte skip table lets mismatches
+ * jump ahead. Targets without either instruction set use libc's memmem
+ * where there is one.
+ *
+ * A Searcher holds the preprocessed needle, so split, replace and count
+ * prepare it once and then walk the haystack in a single pass.
+*/
+
+#define SEARCH_SHORT_NEEDLE 32
+
+typedef struct Searcher{
+    const unsigned char* needle;
+    size_t length;
+
+    // Two-Way state, only set up for needles over SEARCH_SHORT_NEEDLE
+    size_t critical;        // last index of the left half
+    size_t period;
+    size_t memory;          // bytes known to match after a periodic shift
+    size_t byteset[256 / (8 * sizeof(size_t))];
+    size_t shift[256];
+} Searcher;
+
+void initSearcher(Searcher* searcher, const char* needle, size_t length);
+
+// first match at or after hay, NULL if none; an empty needle matches at hay
+const char* searchNext(const Searcher* searcher, const char* hay, size_t hayLen);
+
+const char* searchBytes(const char* hay, size_t hayLen, const char* needle, size_t needleLen);
+
+#endif // CIETO_STRSEARCH_H
@@ -54,7 +54,7 @@ char* valueToString(Value value){
     }else if(IS_NULL(value)){
         return "null";
     }else if(IS_NUM(value)){
-        static char num_str[32];
+        static _Thread_local char num_str[32];
         numToString(AS_NUM(value), num_str, sizeof(num_str));
         return num_str;
     }else if(IS_STRING(value)){
@@ -74,11 +74,35 @@ static void appendString(VM* vm, char** buffer, int* length, int* capacity, cons
     (*buffer)[*length] = '\0';
 }
 
+static ObjectString* numString(VM* vm, double num){
+    char buffer[32];
+
+    if(num >= 0 && num < INT_STRING_CACHE && num == (int)num){
+        ObjectString** cached = &vm->intStrings[(int)num];
+        if(*cached == NULL){
+            int length = numToString(num, buffer, sizeof(buffer));
+            *cached = copyString(vm, buffer, length);
+        }
+        return *cached;
+    }
+
+    int length = numToString(num, buffer, sizeof(buffer));
+    return copyStringRaw(vm, buffer, length);
+}
+
 ObjectString* toString(VM* vm, Value value){
     if(IS_STRING(value)){
         return AS_STRING(value);
     }
 
+    if(IS_NUM(value)){
+        return numString(vm, AS_NUM(value));
+    }
+
+    if(IS_ROPE(value)){
+        return flattenRope(vm, AS_ROPE(value));
+    }
+
     if(IS_LIST(value)){
         ObjectList* list = AS_LIST(value);
         char* buffer = NULL;
@@ -187,8 +211,9 @@ bool isEqual(Value a, Value b){
             if(IS_STRING(a) && IS_STRING(b)){
                 ObjectString* strA = AS_STRING(a);
                 ObjectString* strB = AS_STRING(b);
-                if(strA->hash != strB->hash) return false;
                 if(strA->length != strB->length) return false;
+                if(strA->hash != STRING_HASH_UNSET && strB->hash != STRING_HASH_UNSET &&
+                   strA->hash != strB->hash) return false;
 
                 return memcmp(strA->chars, strB->chars, strA->length) == 0;
             }
@@ -62,7 +62,25 @@ CieValue cie_value_number(double value);
 CieVM* cie_vm_create(void);
 
 /*
- * Destroys a VM created by cie_vm_create().
+ * Creates a VM from a snapshot written by cie_vm_save_snapshot(), without
+ * running any script: globals, loaded modules and everything they refer to
+ * are restored as they were saved.
+ * Host native functions come back unlinked. Register them again with
+ * cie_vm_register_native() under the same names before scripts call them.
+ * Returns NULL when the file cannot be read, is damaged, or was written by
+ * another Cieto release.
+*/
+CieVM* cie_vm_create_from_snapshot(const char* path);
+
+/*
+ * Writes the heap of an idle VM to a snapshot file.
+ * Fails with CIE_STATUS_UNSUPPORTED_TYPE when the heap holds a value that cannot
+ * be saved, such as a file object; cie_vm_last_error() tells which.
+*/
+CieStatus cie_vm_save_snapshot(CieVM* vm, const char* path);
+
+/*
+ * Destroys a VM created by cie_vm_create() or cie_vm_create_from_snapshot().
  * Passing NULL is allowed and has no effect.
 */
 void cie_vm_destroy(CieVM* vm);
@@ -1,12 +1,13 @@
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 
 #include "vm.h"
 #include "object.h"
 #include "value.h"
 #include "string.h"
 #include "mem.h"
+#include "strsearch.h"
+#include "strascii.h"
 
 Value string_len(VM* vm, int argCount, Value* args){
     Value receiver = args[-1];
@@ -41,51 +42,38 @@ Value string_sub(VM* vm, int argCount, Value* args){
 
     if(st >= end) return OBJECT_VAL(copyString(vm, "", 0));
 
-    return OBJECT_VAL(copyStringRaw(vm, strObj->chars + st, end - st));
+    return OBJECT_VAL(newStringView(vm, strObj, st, end - st));
 }
 
 Value string_trim(VM* vm, int argCount, Value* args){
     Value receiver = args[-1];
     ObjectString* strObj = AS_STRING(receiver);
 
-    if(strObj->length == 0){
+    size_t lead = asciiSpan(strObj->chars, strObj->length, ASCII_SPACE);
+    if(lead == strObj->length){
         return OBJECT_VAL(copyString(vm, "", 0));
     }
-    
-    char* st = strObj->chars;
-    char* end = st + strObj->length - 1;
-
-    while(*st && isspace((unsigned char)*st)) st++;
-    while(end > st && isspace((unsigned char)*end)) end--;
+    size_t trail = asciiSpanBack(strObj->chars, strObj->length, ASCII_SPACE);
 
-    int len = (int)(end - st + 1);
-    if(len <= 0) return OBJECT_VAL(copyString(vm, "", 0));
-    
-    return OBJECT_VAL(copyStringRaw(vm, st, len));
+    return OBJECT_VAL(newStringView(vm, strObj, lead, strObj->length - lead - trail));
 }
 
 Value string_upper(VM* vm, int argCount, Value* args){
     Value receiver = args[-1];
     ObjectString* strObj = AS_STRING(receiver);
-    
-    char* chars = (char*)reallocate(vm, NULL, 0, strObj->length + 1);
-    for(int i = 0; i < strObj->length; i++){
-        chars[i] = toupper((unsigned char)strObj->chars[i]);
-    }
-    chars[strObj->length] = '\0';
-    return OBJECT_VAL(takeStringRaw(vm, chars, strObj->length));
+
+    ObjectString* result = newStringRaw(vm, (int)strObj->length);
+    asciiUpper(result->chars, strObj->chars, strObj->length);
+    return OBJECT_VAL(result);
 }
 
 Value string_lower(VM* vm, int argCount, Value* args){
     Value receiver = args[-1];
     ObjectString* strObj = AS_STRING(receiver);
-    
-    char* chars = (char*)reallocate(vm, NULL, 0, strObj->length + 1);
-    for(int i = 0; i < strObj->length; i++){
-        chars[i] = tolower((unsigned char)strObj->chars[i]);
-    }
-    chars[strObj->length] = '\0';
-    return OBJECT_VAL(takeStringRaw(vm, chars, strObj->length));
+
+    ObjectString* result = newStringRaw(vm, (int)strObj->length);
+    asciiLower(result->chars, strObj->chars, strObj->length);
+    return OBJECT_VAL(result);
 }
 
 Value string_find(VM* vm, int argCount, Value* args){
@@ -96,7 +84,7 @@ Value string_find(VM* vm, int argCount, Value* args){
     ObjectString* str = AS_STRING(receiver);
     ObjectString* sub = AS_STRING(args[0]);
 
-    char* pos = strstr(str->chars, sub->chars);
+    const char* pos = searchBytes(str->chars, str->length, sub->chars, sub->length);
     if(pos == NULL) return NUM_VAL(-1);
     return NUM_VAL((double)(pos - str->chars));
 }
@@ -114,29 +102,30 @@ Value string_split(VM* vm, int argCount, Value* args){
     char* str = strObj->chars;
     char* delim = delimObj->chars;
     int delimLen = (int)delimObj->length;
+    const char* end = str + strObj->length;
 
     ObjectList* list = newList(vm);
     push(vm, OBJECT_VAL(list));
 
     if(delimLen == 0){
         for(int i = 0; i < strObj->length; i++){
-            ObjectString* charStr = copyStringRaw(vm, str + i, 1);
-            push(vm, OBJECT_VAL(charStr));
-            appendToList(vm, list, OBJECT_VAL(charStr));
-            pop(vm);
+            appendToList(vm, list, OBJECT_VAL(vm->charStrings[(uint8_t)str[i]]));
         }
     }else{
-        char* ptr = str;
-        char* nextMatch;
-        while((nextMatch = strstr(ptr, delim)) != NULL){
-            int len = (int)(nextMatch - ptr);
-            ObjectString* segment = copyStringRaw(vm, ptr, len);
+        // the segments are views of the receiver
+        Searcher searcher;
+        initSearcher(&searcher, delim, delimLen);
+
+        const char* ptr = str;
+        const char* nextMatch;
+        while((nextMatch = searchNext(&searcher, ptr, end - ptr)) != NULL){
+            ObjectString* segment = newStringView(vm, strObj, ptr - str, nextMatch - ptr);
             push(vm, OBJECT_VAL(segment));
             appendToList(vm, list, OBJECT_VAL(segment));
             pop(vm);
             ptr = nextMatch + delimLen;
         }
-        ObjectString* last = copyStringRaw(vm, ptr, (int)strlen(ptr));
+        ObjectString* last = newStringView(vm, strObj, ptr - str, end - ptr);
         push(vm, OBJECT_VAL(last));
         appendToList(vm, list, OBJECT_VAL(last));
         pop(vm);
@@ -157,30 +146,118 @@ Value string_replace(VM* vm, int argCount, Value* args){
 
     if(oldStr->length == 0) return receiver;
 
-    int count = 0;
-    const char* tmp = str->chars;
-    while((tmp = strstr(tmp, oldStr->chars)) != NULL){
+    const char* end = str->chars + str->length;
+
+    Searcher searcher;
+    initSearcher(&searcher, oldStr->chars, oldStr->length);
+
+    const char* match = searchNext(&searcher, str->chars, str->length);
+    if(match == NULL) return receiver;
+
+    // one pass, the result grows in a scratch buffer and is copied once
+    size_t capacity = str->length + (newStr->length > oldStr->length ? 8 * newStr->length : 0);
+    char* result = (char*)malloc(capacity);
+    if(result == NULL){
+        runtimeError(vm, "Out of memory in .replace().\n");
+        return NULL_VAL;
+    }
+
+    size_t newLen = 0;
+    const char* src = str->chars;
+    while(true){
+        size_t len = (match != NULL ? match : end) - src;
+        size_t need = newLen + len + (match != NULL ? newStr->length : 0);
+        if(need > capacity){
+            while(capacity < need) capacity *= 2;
+            char* grown = (char*)realloc(result, capacity);
+            if(grown == NULL){
+                free(result);
+                runtimeError(vm, "Out of memory in .replace().\n");
+                return NULL_VAL;
+            }
+            result = grown;
+        }
+
+        memcpy(result + newLen, src, len);
+        newLen += len;
+        if(match == NULL) break;
+
+        memcpy(result + newLen, newStr->chars, newStr->length);
+        newLen += newStr->length;
+        src = match + oldStr->length;
+        match = searchNext(&searcher, src, end - src);
+    }
+
+    ObjectString* replaced = copyStringRaw(vm, result, (int)newLen);
+    free(result);
+    return OBJECT_VAL(replaced);
+}
+
+Value string_count(VM* vm, int argCount, Value* args){
+    Value receiver = args[-1];
+    if(argCount != 1 || !IS_STRING(args[0])){
+        runtimeError(vm, ".count() expects a substring.\n");
+        return NULL_VAL;
+    }
+
+    ObjectString* str = AS_STRING(receiver);
+    ObjectString* sub = AS_STRING(args[0]);
+    if(sub->length == 0) return NUM_VAL(0);
+
+    Searcher searcher;
+    initSearcher(&searcher, sub->chars, sub->length);
+
+    // non-overlapping, like replace
+    size_t count = 0;
+    const char* end = str->chars + str->length;
+    const char* p = str->chars;
+    while((p = searchNext(&searcher, p, end - p)) != NULL){
         count++;
-        tmp += oldStr->length;
+        p += sub->length;
+    }
+    return NUM_VAL((double)count);
+}
+
+Value string_startsWith(VM* vm, int argCount, Value* args){
+    Value receiver = args[-1];
+    if(argCount != 1 || !IS_STRING(args[0])){
+        runtimeError(vm, ".startsWith() expects a prefix string.\n");
+        return NULL_VAL;
     }
 
-    if(count == 0) return receiver;
+    ObjectString* str = AS_STRING(receiver);
+    ObjectString* prefix = AS_STRING(args[0]);
+    return BOOL_VAL(prefix->length <= str->length &&
+                    memcmp(str->chars, prefix->chars, prefix->length) == 0);
+}
 
-    size_t newLen = str->length + count * (newStr->length - oldStr->length);
-    char* result = (char*)reallocate(vm, NULL, 0, newLen + 1);
-    char* dst = result;
-    const char* src = str->chars;
-    const char* p;
-
-    while((p = strstr(src, oldStr->chars)) != NULL){
-        size_t len = p - src;
-        memcpy(dst, src, len);
-        dst += len;
-        memcpy(dst, newStr->chars, newStr->length);
-        dst += newStr->length;
-        src = p + oldStr->length;
+Value string_endsWith(VM* vm, int argCount, Value* args){
+    Value receiver = args[-1];
+    if(argCount != 1 || !IS_STRING(args[0])){
+        runtimeError(vm, ".endsWith() expects a suffix string.\n");
+        return NULL_VAL;
     }
-    strcpy(dst, src);
 
-    return OBJECT_VAL(takeStringRaw(vm, result, (int)newLen));
-}
\ No newline at end of file
+    ObjectString* str = AS_STRING(receiver);
+    ObjectString* suffix = AS_STRING(args[0]);
+    return BOOL_VAL(suffix->length <= str->length &&
+                    memcmp(str->chars + str->length - suffix->length, suffix->chars, suffix->length) == 0);
+}
+
+// true when the string is not empty and every byte is in the class
+static Value allInClass(Value receiver, AsciiClass cls){
+    ObjectString* str = AS_STRING(receiver);
+    return BOOL_VAL(str->length > 0 && asciiSpan(str->chars, str->length, cls) == str->length);
+}
+
+Value string_isDigit(VM* vm, int argCount, Value* args){
+    return allInClass(args[-1], ASCII_DIGIT);
+}
+
+Value string_isAlpha(VM* vm, int argCount, Value* args){
+    return allInClass(args[-1], ASCII_ALPHA);
+}
+
+Value string_isSpace(VM* vm, int argCount, Value* args){
+    return allInClass(args[-1], ASCII_SPACE);
+}
@@ -11,5 +11,11 @@ Value string_lower(VM* vm, int argCount, Value* args);
 Value string_split(VM* vm, int argCount, Value* args);
 Value string_replace(VM* vm, int argCount, Value* args);
 Value string_find(VM* vm, int argCount, Value* args);
+Value string_count(VM* vm, int argCount, Value* args);
+Value string_startsWith(VM* vm, int argCount, Value* args);
+Value string_endsWith(VM* vm, int argCount, Value* args);
+Value string_isDigit(VM* vm, int argCount, Value* args);
+Value string_isAlpha(VM* vm, int argCount, Value* args);
+Value string_isSpace(VM* vm, int argCount, Value* args);
 
 #endif  // CIETO_METHODS_STRING_H
\ No newline at end of file
@@ -61,7 +61,7 @@ Value file_read(VM* vm, int argCount, Value* args){
 
     size_t readBytes = fread(content, 1, size, fileObj->handle);
     content[readBytes] = '\0';
-    return OBJECT_VAL(copyString(vm, content, (int)readBytes));
+    return OBJECT_VAL(copyStringAdaptive(vm, content, (int)readBytes));
 }
 
 Value file_close(VM* vm, int argCount, Value* args){
@@ -109,7 +109,7 @@ Value file_readLine(VM* vm, int argCount, Value* args){
         return NULL_VAL;
     }
 
-    ObjectString* lineStr = copyString(vm, buffer, (int)length);
+    ObjectString* lineStr = copyStringAdaptive(vm, buffer, (int)length);
     reallocate(vm, buffer, capacity, 0);
     return OBJECT_VAL(lineStr);
 }
@@ -159,7 +159,7 @@ static Value fs_readFile(VM* vm, int argCount, Value* args){
     }
     content[fread(content, 1, size, file)] = '\0';
     fclose(file);
-    Value result = OBJECT_VAL(copyString(vm, content, size));
+    Value result = OBJECT_VAL(copyStringAdaptive(vm, content, (int)size));
     free(content);
     return result;
 }
@@ -189,7 +189,7 @@ static Value fs_readLines(VM* vm, int argCount, Value* args){
             len--;
         }
 
-        ObjectString* lineStr = copyString(vm, line, (int)len);
+        ObjectString* lineStr = copyStringAdaptive(vm, line, (int)len);
         push(vm, OBJECT_VAL(lineStr));
         appendToList(vm, list, OBJECT_VAL(lineStr));
         pop(vm);
@@ -412,7 +412,7 @@ static void scan_dir(VM* vm, const char* baseDir, const char* relDir, ObjectList
 
             if(glob_match_string(relPath, config->pattern, config->ignoreCase)){
                 if(!is_excluded(vm, relPath, config->excludeVal, config->ignoreCase)){
-                    ObjectString* str = copyString(vm, relPath, strlen(relPath));
+                    ObjectString* str = copyStringAdaptive(vm, relPath, (int)strlen(relPath));
                     push(vm, OBJECT_VAL(str));
                     appendToList(vm, list, OBJECT_VAL(str));
                     pop(vm);
@@ -459,7 +459,7 @@ static void scan_dir(VM* vm, const char* baseDir, const char* relDir, ObjectList
     #endif
         if(glob_match_string(relPath, config->pattern, config->ignoreCase)){
             if(!is_excluded(vm, relPath, config->excludeVal, config->ignoreCase)){
-                ObjectString* str = copyString(vm, relPath, strlen(relPath));
+                ObjectString* str = copyStringAdaptive(vm, relPath, (int)strlen(relPath));
                 push(vm, OBJECT_VAL(str));
                 appendToList(vm, list, OBJECT_VAL(str));
                 pop(vm);
@@ -474,15 +474,20 @@ static void scan_dir(VM* vm, const char* baseDir, const char* relDir, ObjectList
 #endif
 }
 
+const NativeFuncDef fsFuncs[] = {
+    {"read", fs_readFile},
+    {"write", fs_writeFile},
+    {"exists", fs_exists},
+    {"remove", fs_remove},
+    {"list", fs_listDir},
+    {"rlines", fs_readLines},
+    {"append", fs_appendFile},
+    {"open", fs_open},
+    {"mkdir", fs_mkdir},
+    {"isDir", fs_isDir},
+    {NULL, NULL}
+};
+
 void initFsModule(VM* vm, ObjectModule* module){
-    defineCFunc(vm, &module->members, "read", fs_readFile);
-    defineCFunc(vm, &module->members, "write", fs_writeFile);
-    defineCFunc(vm, &module->members, "exists", fs_exists);
-    defineCFunc(vm, &module->members, "remove", fs_remove);
-    defineCFunc(vm, &module->members, "list", fs_listDir);
-    defineCFunc(vm, &module->members, "rlines", fs_readLines);
-    defineCFunc(vm, &module->members, "append", fs_appendFile);
-    defineCFunc(vm, &module->members, "open", fs_open);
-    defineCFunc(vm, &module->members, "mkdir", fs_mkdir);
-    defineCFunc(vm, &module->members, "isDir", fs_isDir);
+    defineCFuncs(vm, &module->members, fsFuncs);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define CIETO_MODULES_FS_H
 
 #include "vm.h"
+#include "registry.h"
 
 typedef struct GlobConfig{
     const char* pattern;
@@ -11,6 +12,7 @@ typedef struct GlobConfig{
 }GlobConfig;
 
 void initFsModule(VM* vm, ObjectModule* module);
+extern const NativeFuncDef fsFuncs[];
 
 Value file_read(VM* vm, int argCount, Value* args);
 Value file_readLine(VM* vm, int argCount, Value* args);
@@ -37,7 +37,35 @@ static Value gc_collect(VM* vm, int argCount, Value* args){
         return NULL_VAL;
     }
 
-    return BOOL_VAL(gcCollect(vm, GC_REASON_MANUAL));
+    // nothing here holds a string, so dedup may redirect references
+    vm->nativeDepth--;
+    bool collected = gcCollect(vm, GC_REASON_MANUAL);
+    vm->nativeDepth++;
+
+    return BOOL_VAL(collected);
+}
+
+static Value gc_dedup(VM* vm, int argCount, Value* args){
+    if(argCount == 0){
+        const char* name = gcDedupName(vm->gcDedup);
+        return OBJECT_VAL(copyString(vm, name, (int)strlen(name)));
+    }
+
+    if(argCount != 1 || !IS_STRING(args[0])){
+        runtimeError(vm, "gc.dedup expects a single string argument.\n");
+        return NULL_VAL;
+    }
+
+    GCDedup dedup;
+    const char* name = AS_CSTRING(args[0]);
+
+    if(!gcDedupFromString(name, &dedup)){
+        runtimeError(vm, "Invalid dedup mode: %s. Valid modes are 'off', 'report', 'on'.\n", name);
+        return NULL_VAL;
+    }
+
+    vm->gcDedup = dedup;
+    return args[0];
 }
 
 static Value gc_threshold(VM* vm, int argCount, Value* args){
@@ -120,13 +148,26 @@ static Value gc_stats(VM* vm, int argCount, Value* args){
     mapCString(vm, statsMap, "gc_intern_ms", NUM_VAL(vm->gcStats.internMs));
     mapCString(vm, statsMap, "gc_sweep_ms", NUM_VAL(vm->gcStats.sweepMs));
 
+    const char* dedupName = gcDedupName(vm->gcDedup);
+    mapCString(vm, statsMap, "dedup", OBJECT_VAL(copyString(vm, dedupName, (int)strlen(dedupName))));
+    mapCString(vm, statsMap, "gc_dedup_strings", NUM_VAL((double)vm->gcStats.dedupStrings));
+    mapCString(vm, statsMap, "gc_dedup_bytes", NUM_VAL((double)vm->gcStats.dedupBytes));
+    mapCString(vm, statsMap, "gc_dedup_refs", NUM_VAL((double)vm->gcStats.dedupRefs));
+    mapCString(vm, statsMap, "gc_dedup_ms", NUM_VAL(vm->gcStats.dedupMs));
+
     pop(vm);
     return OBJECT_VAL(statsMap);
 }
 
+const NativeFuncDef gcFuncs[] = {
+    {"mode", gc_mode},
+    {"collect", gc_collect},
+    {"threshold", gc_threshold},
+    {"stats", gc_stats},
+    {"dedup", gc_dedup},
+    {NULL, NULL}
+};
+
 void initGcModule(VM* vm, ObjectModule* module){
-    defineCFunc(vm, &module->members, "mode", gc_mode);
-    defineCFunc(vm, &module->members, "collect", gc_collect);
-    defineCFunc(vm, &module->members, "threshold", gc_threshold);
-    defineCFunc(vm, &module->members, "stats", gc_stats);
+    defineCFuncs(vm, &module->members, gcFuncs);
 }
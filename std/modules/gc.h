@@ -2,7 +2,9 @@
 #define CIETO_MODULE_GC_H
 
 #include "vm.h"
+#include "registry.h"
 
 void initGcModule(VM* vm, ObjectModule* module);
+extern const NativeFuncDef gcFuncs[];
 
 #endif
\ No newline at end of file
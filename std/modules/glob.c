@@ -187,6 +187,11 @@ static void defineGlobField(VM* vm, ObjectClass* klass, const char* name, Value
     pop(vm);
 }
 
+const NativeFuncDef globFuncs[] = {
+    {"match", glob_match},
+    {NULL, NULL}
+};
+
 void initGlobModule(VM* vm, ObjectModule* module){
     ObjectString* className = copyString(vm, "Glob", 4);
     push(vm, OBJECT_VAL(className));
@@ -212,5 +217,5 @@ void initGlobModule(VM* vm, ObjectModule* module){
     pop(vm); // klass
     pop(vm); // className
 
-    defineCFunc(vm, &module->members, "match", glob_match);
+    defineCFuncs(vm, &module->members, globFuncs);
 }
\ No newline at end of file
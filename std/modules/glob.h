@@ -2,8 +2,10 @@
 #define CIETO_MODULES_GLOB_H
 
 #include "vm.h"
+#include "registry.h"
 
 void initGlobModule(VM* vm, ObjectModule* module);
+extern const NativeFuncDef globFuncs[];
 bool glob_match_string(const char* text, const char* pattern, bool ignoreCase);
 
 #endif
\ No newline at end of file
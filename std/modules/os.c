@@ -65,7 +65,7 @@ static Value os_exec(VM* vm, int argCount, Value* args){
         buffer[length] = '\0';
     }
 
-    ObjectString* result = copyString(vm, buffer, (int)length);
+    ObjectString* result = copyStringAdaptive(vm, buffer, (int)length);
     reallocate(vm, buffer, capacity, 0);
     return OBJECT_VAL(result);
 }
@@ -165,11 +165,16 @@ static void defineArgv(VM* vm, ObjectModule* module){
     pop(vm);    // argvKey
 }
 
+const NativeFuncDef osFuncs[] = {
+    {"exec", os_exec},
+    {"run", os_system},
+    {"getenv", os_getenv},
+    {"setenv", os_setenv},
+    {"exit", os_exit},
+    {NULL, NULL}
+};
+
 void initOsModule(VM* vm, ObjectModule* module){
     defineArgv(vm, module);
-    defineCFunc(vm, &module->members, "exec", os_exec);
-    defineCFunc(vm, &module->members, "run", os_system);
-    defineCFunc(vm, &module->members, "getenv", os_getenv);
-    defineCFunc(vm, &module->members, "setenv", os_setenv);
-    defineCFunc(vm, &module->members, "exit", os_exit);
+    defineCFuncs(vm, &module->members, osFuncs);
 }
\ No newline at end of file
@@ -2,7 +2,9 @@
 #define CIETO_MODULES_OS_H
 
 #include "vm.h"
+#include "registry.h"
 
 void initOsModule(VM* vm, ObjectModule* module);
+extern const NativeFuncDef osFuncs[];
 
 #endif
\ No newline at end of file
@@ -303,12 +303,17 @@ static Value path_sep(VM* vm, int argCount, Value* args){
     return OBJECT_VAL(copyString(vm, PATH_SEP_STR, 1));
 }
 
+const NativeFuncDef pathFuncs[] = {
+    {"join", path_join},
+    {"base", path_base},
+    {"dirname", path_dirname},
+    {"ext", path_ext},
+    {"isAbs", path_isAbs},
+    {"abs", path_abs},
+    {"sep", path_sep},
+    {NULL, NULL}
+};
+
 void initPathModule(VM* vm, ObjectModule* module){
-    defineCFunc(vm, &module->members, "join", path_join);
-    defineCFunc(vm, &module->members, "base", path_base);
-    defineCFunc(vm, &module->members, "dirname", path_dirname);
-    defineCFunc(vm, &module->members, "ext", path_ext);
-    defineCFunc(vm, &module->members, "isAbs", path_isAbs);
-    defineCFunc(vm, &module->members, "abs", path_abs);
-    defineCFunc(vm, &module->members, "sep", path_sep);
+    defineCFuncs(vm, &module->members, pathFuncs);
 }
\ No newline at end of file
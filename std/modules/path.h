@@ -2,7 +2,9 @@
 #define CIETO_MODULES_PATH_H
 
 #include "vm.h"
+#include "registry.h"
 
 void initPathModule(VM* vm, ObjectModule* module);
+extern const NativeFuncDef pathFuncs[];
 
 #endif
\ No newline at end of file
@@ -110,10 +110,15 @@ static Value time_fmt(VM* vm, int argCount, Value* args){
     return OBJECT_VAL(copyString(vm, buffer, (int)len));
 }
 
+const NativeFuncDef timeFuncs[] = {
+    {"steady", time_steady},
+    {"now", time_now},
+    {"clock", time_system},
+    {"sleep", time_sleep},
+    {"fmt", time_fmt},
+    {NULL, NULL}
+};
+
 void initTimeModule(VM* vm, ObjectModule* module){
-    defineCFunc(vm, &module->members, "steady", time_steady);
-    defineCFunc(vm, &module->members, "now", time_now);
-    defineCFunc(vm, &module->members, "clock", time_system);
-    defineCFunc(vm, &module->members, "sleep", time_sleep);
-    defineCFunc(vm, &module->members, "fmt", time_fmt);
+    defineCFuncs(vm, &module->members, timeFuncs);
 }
\ No newline at end of file
@@ -2,7 +2,9 @@
 #define CIETO_MODULE_TIME_H
 
 #include "vm.h"
+#include "registry.h"
 
 void initTimeModule(VM* vm, ObjectModule* module);
+extern const NativeFuncDef timeFuncs[];
 
 #endif
\ No newline at end of file
@@ -25,7 +25,7 @@ static Value iterFile(VM* vm, ObjectIterator* iter, ObjectFile* file){
             buffer[len-1] = '\0';
             len--;
         }
-        return OBJECT_VAL(copyString(vm, buffer, (int)len));
+        return OBJECT_VAL(copyStringAdaptive(vm, buffer, (int)len));
     }
     return NULL_VAL;
 }
@@ -24,13 +24,25 @@ void defineCFunc(VM* vm, GlobalEnv* env, const char* name, CFunc func){
     pop(vm);    // key
 }
 
+void defineCFuncs(VM* vm, GlobalEnv* env, const NativeFuncDef* funcs){
+    for(; funcs->name != NULL; funcs++){
+        defineCFunc(vm, env, funcs->name, funcs->func);
+    }
+}
+
 static NativeModuleDef nativeModules[] = {
-    {"fs", initFsModule},
-    {"time", initTimeModule},
-    {"os", initOsModule},
-    {"path", initPathModule},
-    {"glob", initGlobModule},
-    {"gc", initGcModule},
+    {"fs", initFsModule, fsFuncs},
+    {"time", initTimeModule, timeFuncs},
+    {"os", initOsModule, osFuncs},
+    {"path", initPathModule, pathFuncs},
+    {"glob", initGlobModule, globFuncs},
+    {"gc", initGcModule, gcFuncs},
+    {NULL, NULL, NULL}
+};
+
+static const NativeFuncDef preludeFuncs[] = {
+    {"iter", iterNative},
+    {"next", nextNative},
     {NULL, NULL}
 };
 
@@ -43,7 +55,14 @@ const NativeModuleDef* findNativeModule(const char* name){
     return NULL;
 }
 
-void registerPrelude(VM* vm){
-    defineCFunc(vm, &vm->globals, "iter", iterNative);
-    defineCFunc(vm, &vm->globals, "next", nextNative);
+const NativeModuleDef* listNativeModules(void){
+    return nativeModules;
+}
+
+void registerPrelude(VM* vm, GlobalEnv* env){
+    defineCFuncs(vm, env, preludeFuncs);
+}
+
+const NativeFuncDef* listPreludeFuncs(void){
+    return preludeFuncs;
 }
\ No newline at end of file
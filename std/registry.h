@@ -5,15 +5,24 @@
 
 typedef void (*NativeModuleInit)(VM* vm, ObjectModule* module);
 
+typedef struct NativeFuncDef{
+    const char* name;
+    CFunc func;
+}NativeFuncDef;     // tables of these end with a NULL name
+
 typedef struct NativeModuleDef{
     const char* name;
     NativeModuleInit initFunc;
+    const NativeFuncDef* funcs;     // the functions initFunc defines, snapshots link by them
 }NativeModuleDef;
 
 void defineCFunc(VM* vm, GlobalEnv* env, const char* name, CFunc func);
+void defineCFuncs(VM* vm, GlobalEnv* env, const NativeFuncDef* funcs);
 
 const NativeModuleDef* findNativeModule(const char* name);
+const NativeModuleDef* listNativeModules(void);   // terminated by a NULL name
 
-void registerPrelude(VM* vm);
+void registerPrelude(VM* vm, GlobalEnv* env);
+const NativeFuncDef* listPreludeFuncs(void);
 
 #endif // CIETO_MODULES_H
\ No newline at end of file
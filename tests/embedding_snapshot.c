@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <cieto.h>
+
+#define SNAPSHOT_PATH "embedding_snapshot.csnap"
+#define MODULE_PATH "embedding_snapshot_lib.cies"
+
+static void hostScale(CieCall* call, void* userData) {
+    double factor = *(double*)userData;
+    double value;
+
+    if(cie_call_arg_count(call) != 1 || !cie_call_get_number(call, 0, &value)){
+        cie_call_error(call, "hostScale() expects a number.");
+        return;
+    }
+
+    cie_call_return_number(call, value * factor);
+}
+
+static int reportFailure(CieVM* vm, const char* operation,
+                         CieStatus status) {
+    const char* error = cie_vm_last_error(vm);
+
+    fprintf(stderr, "%s failed: %s\n", operation,
+            error != NULL ? error : cie_status_string(status));
+
+    return 1;
+}
+
+static int expectNumber(CieVM* vm, const char* name, double expected) {
+    CieValue result;
+    CieStatus status = cie_vm_call(vm, name, 0, NULL, &result);
+
+    if(status != CIE_STATUS_OK){
+        return reportFailure(vm, name, status);
+    }
+
+    if(result.type != CIE_VALUE_NUMBER || result.as.number != expected){
+        fprintf(stderr, "Expected %s() to return %.14g.\n", name, expected);
+        return 1;
+    }
+
+    printf("%s() = %.14g\n", name, result.as.number);
+    return 0;
+}
+
+static int saveSnapshot(double* factor) {
+    FILE* module = fopen(MODULE_PATH, "w");
+
+    if(module == NULL){
+        fprintf(stderr, "Could not write %s.\n", MODULE_PATH);
+        return 1;
+    }
+
+    fputs("var base = 40;\n"
+          "func plus(n) { return base + n; }\n", module);
+    fclose(module);
+
+    CieVM* vm = cie_vm_create();
+
+    if(vm == NULL){
+        fprintf(stderr, "Could not create Cieto VM.\n");
+        return 1;
+    }
+
+    CieStatus status = cie_vm_register_native(vm, "hostScale", hostScale, factor);
+
+    if(status != CIE_STATUS_OK){
+        int exitCode = reportFailure(vm, "Registering hostScale", status);
+        cie_vm_destroy(vm);
+        return exitCode;
+    }
+
+    const char* source =
+        "import \"path\";\n"
+        "import \"" MODULE_PATH "\";\n"
+        "\n"
+        "class Point {\n"
+        "    X = 0;\n"
+        "    Y = 0;\n"
+        "}\n"
+        "\n"
+        "method (p Point) sum() {\n"
+        "    return p.X + p.Y;\n"
+        "}\n"
+        "\n"
+        "func makeCounter() {\n"
+        "    var n = 0;\n"
+        "    return func() { n++; return n; };\n"
+        "}\n"
+        "\n"
+        "func makeScale(k) {\n"
+        "    return func(x) { return x * k; };\n"
+        "}\n"
+        "\n"
+        "var counter = makeCounter();\n"
+        "var triple = makeScale(3);\n"
+        "counter();\n"
+        "counter();\n"
+        "\n"
+        "var origin = Point();\n"
+        "origin.X = 3;\n"
+        "origin.Y = 4;\n"
+        "var items = [1, 2, origin];\n"
+        "var table = {\"self\": items};\n"
+        "var sep = path.join(\"a\", \"b\");\n"
+        "var lib = embedding_snapshot_lib;\n"
+        "var log = \"\";\n"
+        "for (var i = 0; i < 100; i++) { log = log + i + \";\"; }\n"
+        "\n"
+        "func count() { return counter(); }\n"
+        "func pointSum() { return table[\"self\"][2].sum(); }\n"
+        "func shared() { return items[2] == origin ? 1 : 0; }\n"
+        "func joined() { return sep.len(); }\n"
+        "func fromModule() { return lib.plus(2); }\n"
+        "func scaled() { return hostScale(21); }\n"
+        "func tripled() { return triple(5); }\n"
+        "func logged() { return log.len() + log.find(\"99;\"); }\n";
+
+    status = cie_vm_eval(vm, source, "embedding_snapshot.cies");
+
+    if(status != CIE_STATUS_OK){
+        int exitCode = reportFailure(vm, "Loading the script", status);
+        cie_vm_destroy(vm);
+        return exitCode;
+    }
+
+    status = cie_vm_save_snapshot(vm, SNAPSHOT_PATH);
+
+    if(status != CIE_STATUS_OK){
+        int exitCode = reportFailure(vm, "Saving the snapshot", status);
+        cie_vm_destroy(vm);
+        return exitCode;
+    }
+
+    cie_vm_destroy(vm);
+    return 0;
+}
+
+static int restoreSnapshot(double* factor) {
+    CieVM* vm = cie_vm_create_from_snapshot(SNAPSHOT_PATH);
+
+    if(vm == NULL){
+        fprintf(stderr, "Could not restore the snapshot.\n");
+        return 1;
+    }
+
+    /*
+     * The host function is still unlinked, calling it is an error.
+    */
+    CieValue result;
+    CieStatus status = cie_vm_call(vm, "scaled", 0, NULL, &result);
+
+    if(status != CIE_STATUS_RUNTIME_ERROR){
+        fprintf(stderr, "Expected an unlinked host function to fail.\n");
+        cie_vm_destroy(vm);
+        return 1;
+    }
+
+    status = cie_vm_register_native(vm, "hostScale", hostScale, factor);
+
+    if(status != CIE_STATUS_OK){
+        int exitCode = reportFailure(vm, "Linking hostScale", status);
+        cie_vm_destroy(vm);
+        return exitCode;
+    }
+
+    int failed = 0;
+
+    // the counter carries on from the two calls made before saving
+    failed |= expectNumber(vm, "count", 3);
+    failed |= expectNumber(vm, "count", 4);
+    failed |= expectNumber(vm, "pointSum", 7);
+    failed |= expectNumber(vm, "shared", 1);
+    failed |= expectNumber(vm, "joined", 3);
+    failed |= expectNumber(vm, "fromModule", 42);
+    failed |= expectNumber(vm, "scaled", 42);
+    failed |= expectNumber(vm, "tripled", 15);
+    failed |= expectNumber(vm, "logged", 577);
+
+    cie_vm_destroy(vm);
+    return failed;
+}
+
+int main(void) {
+    double factor = 2;
+
+    int exitCode = saveSnapshot(&factor);
+
+    if(exitCode == 0){
+        exitCode = restoreSnapshot(&factor);
+    }
+
+    if(cie_vm_create_from_snapshot(MODULE_PATH) != NULL){
+        fprintf(stderr, "Expected a non-snapshot file to be rejected.\n");
+        exitCode = 1;
+    }
+
+    remove(SNAPSHOT_PATH);
+    remove(MODULE_PATH);
+    return exitCode;
+}
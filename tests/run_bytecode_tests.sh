@@ -0,0 +1,148 @@
+#!/usr/bin/env bash
+
+# Compiles every script test to .pco with `cieto build` and runs the result,
+# so each test also covers the bytecode writer and loader. Then runs them
+# twice against an empty module cache, the second time importing cached
+# modules, and runs a bundle away from the module sources.
+
+set -u
+
+CIETO_EXEC="${1:-${CIETO_EXEC:-}}"
+TIMEOUT_SEC="${2:-${TIMEOUT_SEC:-5}}"
+
+if [ -z "$CIETO_EXEC" ] || [ ! -f "$CIETO_EXEC" ]; then
+    echo "Usage: bash run_bytecode_tests.sh /path/to/cieto [timeout_seconds]"
+    exit 1
+fi
+
+CIETO_EXEC="$(cd "$(dirname "$CIETO_EXEC")" && pwd)/$(basename "$CIETO_EXEC")"
+
+OUT_DIR="$(mktemp -d)"
+trap 'rm -rf "$OUT_DIR"' EXIT
+
+PASSED=0
+FAILED=0
+
+for file in test_*.cies; do
+    if [ ! -f "$file" ]; then
+        continue
+    fi
+
+    printf "Running %-35s " "${file%.cies}.pco"
+    output="$OUT_DIR/${file%.cies}.pco"
+
+    if ! "$CIETO_EXEC" build "$file" -o "$output" > "$OUT_DIR/log" 2>&1; then
+        echo "[BUILD FAIL]"
+        head -40 "$OUT_DIR/log"
+        FAILED=$((FAILED + 1))
+        continue
+    fi
+
+    if timeout "$TIMEOUT_SEC" "$CIETO_EXEC" run "$output" > "$OUT_DIR/log" 2>&1; then
+        echo "[PASS]"
+        PASSED=$((PASSED + 1))
+    else
+        echo "[FAIL]"
+        head -80 "$OUT_DIR/log"
+        FAILED=$((FAILED + 1))
+    fi
+done
+
+export CIETO_CACHE_DIR="$OUT_DIR/cache"
+
+for pass in fill hit; do
+    for file in test_*.cies; do
+        if [ ! -f "$file" ]; then
+            continue
+        fi
+
+        printf "Running %-35s " "$file ($pass cache)"
+
+        if timeout "$TIMEOUT_SEC" "$CIETO_EXEC" "$file" > "$OUT_DIR/log" 2>&1; then
+            echo "[PASS]"
+            PASSED=$((PASSED + 1))
+        else
+            echo "[FAIL]"
+            head -80 "$OUT_DIR/log"
+            FAILED=$((FAILED + 1))
+        fi
+    done
+done
+
+printf "Running %-35s " "module cache entries"
+if ls "$CIETO_CACHE_DIR"/*.pco > /dev/null 2>&1; then
+    echo "[PASS]"
+    PASSED=$((PASSED + 1))
+else
+    echo "[FAIL]"
+    FAILED=$((FAILED + 1))
+fi
+
+# an edited module must not come from its stale entry
+printf "Running %-35s " "module cache invalidation"
+mkdir -p "$OUT_DIR/stale"
+echo 'import "mod.cies"; print mod.value;' > "$OUT_DIR/stale/main.cies"
+echo 'var value = 1;' > "$OUT_DIR/stale/mod.cies"
+first="$("$CIETO_EXEC" "$OUT_DIR/stale/main.cies" 2>&1)"
+echo 'var value = 2;' > "$OUT_DIR/stale/mod.cies"
+second="$("$CIETO_EXEC" "$OUT_DIR/stale/main.cies" 2>&1)"
+if [ "$first" = "1" ] && [ "$second" = "2" ]; then
+    echo "[PASS]"
+    PASSED=$((PASSED + 1))
+else
+    echo "[FAIL] got '$first' then '$second'"
+    FAILED=$((FAILED + 1))
+fi
+
+# an uncalled body is only bracket-matched, --eager and build check it
+printf "Running %-35s " "uncalled syntax error"
+printf 'func never() {\n    var x = ;\n}\nprint "ran";\n' > "$OUT_DIR/uncalled.cies"
+lazy="$(timeout "$TIMEOUT_SEC" "$CIETO_EXEC" --no-cache "$OUT_DIR/uncalled.cies" 2>&1)"
+timeout "$TIMEOUT_SEC" "$CIETO_EXEC" --no-cache --eager "$OUT_DIR/uncalled.cies" > "$OUT_DIR/log" 2>&1
+status=$?
+if [ "$lazy" = "ran" ] && [ "$status" -ne 0 ] && grep -q "Expect expression" "$OUT_DIR/log" &&
+   ! grep -q "ran" "$OUT_DIR/log" &&
+   ! "$CIETO_EXEC" build "$OUT_DIR/uncalled.cies" -o "$OUT_DIR/uncalled.pco" > /dev/null 2>&1; then
+    echo "[PASS]"
+    PASSED=$((PASSED + 1))
+else
+    echo "[FAIL] lazy '$lazy', eager exit $status"
+    head -20 "$OUT_DIR/log"
+    FAILED=$((FAILED + 1))
+fi
+
+# operands are checked on load, a corrupt file is refused instead of run
+printf "Running %-35s " "corrupt bytecode rejected"
+echo 'var x = 1; print x;' > "$OUT_DIR/corrupt.cies"
+"$CIETO_EXEC" build "$OUT_DIR/corrupt.cies" -o "$OUT_DIR/corrupt.pco" > /dev/null 2>&1
+# point A of the closing OP_RETURN (38, A, 2, 0) far past the frame
+offset="$(od -An -v -tu1 -w1 "$OUT_DIR/corrupt.pco" |
+    awk '{b[NR-1] = $1} END{for(i = 0; i + 3 < NR; i++) if(b[i] == 38 && b[i+2] == 2 && b[i+3] == 0) last = i; print last + 1}')"
+printf '\377' | dd of="$OUT_DIR/corrupt.pco" bs=1 seek="$offset" conv=notrunc 2> /dev/null
+timeout "$TIMEOUT_SEC" "$CIETO_EXEC" run "$OUT_DIR/corrupt.pco" > "$OUT_DIR/log" 2>&1
+status=$?
+if [ "$status" -eq 1 ] && grep -q "Could not load bytecode" "$OUT_DIR/log"; then
+    echo "[PASS]"
+    PASSED=$((PASSED + 1))
+else
+    echo "[FAIL] exit $status"
+    head -20 "$OUT_DIR/log"
+    FAILED=$((FAILED + 1))
+fi
+
+# every module must come from the bundle, none of them is reachable from there
+printf "Running %-35s " "test_modules.cbundle"
+if "$CIETO_EXEC" bundle test_modules.cies -o "$OUT_DIR/app.cbundle" > "$OUT_DIR/log" 2>&1 &&
+   (cd "$OUT_DIR" && timeout "$TIMEOUT_SEC" "$CIETO_EXEC" --no-cache run app.cbundle) > "$OUT_DIR/log" 2>&1; then
+    echo "[PASS]"
+    PASSED=$((PASSED + 1))
+else
+    echo "[FAIL]"
+    head -80 "$OUT_DIR/log"
+    FAILED=$((FAILED + 1))
+fi
+
+echo
+echo "Summary: $PASSED Passed, $FAILED Failed"
+
+[ "$FAILED" -eq 0 ]
@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bundle.h"
+#include "bytecode.h"
+#include "compiler.h"
+#include "file.h"
+#include "module_loader.h"
+#include "version.h"
+
+typedef struct{
+    const char* path;   // inside the mapped file, not terminated
+    uint32_t pathLen;
+    uint32_t offset;
+    uint32_t size;
+}BundleEntry;
+
+typedef struct Bundle{
+    BytecodeImage image;
+    BundleEntry* entries;
+    uint32_t count;
+}Bundle;
+
+typedef struct{
+    char** paths;
+    int count;
+    int capacity;
+}ModuleList;
+
+typedef struct{
+    const uint8_t* cur;
+    const uint8_t* end;
+    bool failed;
+}BundleReader;
+
+bool isBundlePath(const char* path){
+    size_t len = strlen(path);
+    size_t extLen = strlen(BUNDLE_EXT);
+    return len > extLen && strcmp(path + len - extLen, BUNDLE_EXT) == 0;
+}
+
+static void addModule(void* userData, char* path){
+    ModuleList* list = (ModuleList*)userData;
+    for(int i = 0; i < list->count; i++){
+        if(strcmp(list->paths[i], path) == 0){
+            free(path);
+            return;
+        }
+    }
+
+    if(list->count == list->capacity){
+        int capacity = list->capacity < 8 ? 8 : list->capacity * 2;
+        char** paths = (char**)realloc(list->paths, sizeof(char*) * capacity);
+        if(paths == NULL){
+            free(path);
+            return;
+        }
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    list->paths[list->count++] = path;
+}
+
+static ObjectFunc* compileModule(VM* vm, const char* path, bool isEntry, BytecodeBuffer* out, ModuleList* list){
+    char* source = readScript(path);
+
+    // every module gets its own globals, as importModule() would give it
+    GlobalEnv members;
+    initGlobalEnv(&members);
+    GlobalEnv* globals = isEntry ? vm->curGlobal : &members;
+    GlobalEnv* prevGlobal = vm->curGlobal;
+    vm->curGlobal = globals;
+
+    ObjectFunc* func = compile(vm, source, path);
+    if(func != NULL){
+        if(!isEntry){
+            func->type = TYPE_MODULE;
+        }
+        push(vm, OBJECT_VAL(func));
+        if(!serializeFunc(vm, func, globals, out)){
+            func = NULL;
+        }
+        pop(vm);
+    }
+
+    vm->curGlobal = prevGlobal;
+    freeGlobalEnv(vm, &members);
+
+    if(func != NULL){
+        scanImports(source, path, addModule, list);
+    }
+    free(source);
+    return func;
+}
+
+static void putU16(uint8_t* bytes, uint16_t value){
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+static void putU32(uint8_t* bytes, uint32_t value){
+    for(int i = 0; i < 4; i++){
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static bool writeHeader(FILE* file, ModuleList* list, BytecodeBuffer* images){
+    size_t versionLen = strlen(CIETO_VERSION);
+    size_t offset = 4 + 2 + 2 + 4 + versionLen + 4;
+    for(int i = 0; i < list->count; i++){
+        offset += 4 + strlen(list->paths[i]) + 4 + 4;
+    }
+
+    uint8_t bytes[8];
+    memcpy(bytes, BUNDLE_MAGIC, 4);
+    putU16(bytes + 4, BUNDLE_FORMAT);
+    putU16(bytes + 6, 0);
+    bool ok = fwrite(bytes, 1, 8, file) == 8;
+
+    putU32(bytes, (uint32_t)versionLen);
+    ok = ok && fwrite(bytes, 1, 4, file) == 4 && fwrite(CIETO_VERSION, 1, versionLen, file) == versionLen;
+
+    putU32(bytes, (uint32_t)list->count);
+    ok = ok && fwrite(bytes, 1, 4, file) == 4;
+
+    for(int i = 0; i < list->count && ok; i++){
+        size_t pathLen = strlen(list->paths[i]);
+        if(offset + images[i].count > UINT32_MAX){
+            return false;
+        }
+
+        putU32(bytes, (uint32_t)pathLen);
+        ok = fwrite(bytes, 1, 4, file) == 4 && fwrite(list->paths[i], 1, pathLen, file) == pathLen;
+
+        putU32(bytes, (uint32_t)offset);
+        putU32(bytes + 4, (uint32_t)images[i].count);
+        ok = ok && fwrite(bytes, 1, 8, file) == 8;
+        offset += images[i].count;
+    }
+    return ok;
+}
+
+bool writeBundleFile(VM* vm, const char* path, const char* outPath){
+    ModuleList list = {NULL, 0, 0};
+    char* entry = (char*)malloc(strlen(path) + 1);
+    if(entry == NULL){
+        return false;
+    }
+    strcpy(entry, path);
+    addModule(&list, entry);
+
+    BytecodeBuffer* images = NULL;
+    int imageCnt = 0;
+    bool ok = true;
+
+    // breadth first over the import graph, the list grows as modules are scanned
+    while(ok && imageCnt < list.count){
+        BytecodeBuffer* grown = (BytecodeBuffer*)realloc(images, sizeof(BytecodeBuffer) * (imageCnt + 1));
+        if(grown == NULL){
+            ok = false;
+            break;
+        }
+        images = grown;
+
+        BytecodeBuffer* image = &images[imageCnt++];
+        initBytecodeBuffer(image);
+        if(compileModule(vm, list.paths[imageCnt - 1], imageCnt == 1, image, &list) == NULL){
+            fprintf(stderr, "Error: Could not compile %s\n", list.paths[imageCnt - 1]);
+            ok = false;
+        }
+    }
+
+    if(ok){
+        FILE* file = fopen(outPath, "wb");
+        ok = file != NULL && writeHeader(file, &list, images);
+        for(int i = 0; i < list.count && ok; i++){
+            ok = fwrite(images[i].data, 1, images[i].count, file) == images[i].count;
+        }
+        if(file != NULL){
+            ok = fclose(file) == 0 && ok;
+        }
+        if(ok){
+            printf("Bundled %d module%s.\n", list.count, list.count == 1 ? "" : "s");
+        }
+    }
+
+    for(int i = 0; i < imageCnt; i++){
+        freeBytecodeBuffer(&images[i]);
+    }
+    for(int i = 0; i < list.count; i++){
+        free(list.paths[i]);
+    }
+    free(images);
+    free(list.paths);
+    return ok;
+}
+
+static const uint8_t* readBytes(BundleReader* reader, size_t len){
+    if(reader->failed || (size_t)(reader->end - reader->cur) < len){
+        reader->failed = true;
+        return NULL;
+    }
+    const uint8_t* bytes = reader->cur;
+    reader->cur += len;
+    return bytes;
+}
+
+static uint32_t readU32(BundleReader* reader){
+    const uint8_t* bytes = readBytes(reader, 4);
+    if(bytes == NULL){
+        return 0;
+    }
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+           ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+bool openBundle(VM* vm, const char* path){
+    Bundle* bundle = (Bundle*)calloc(1, sizeof(Bundle));
+    if(bundle == NULL){
+        return false;
+    }
+    if(!mapBytecodeFile(path, &bundle->image)){
+        free(bundle);
+        return false;
+    }
+
+    BundleReader reader = {bundle->image.data, bundle->image.data + bundle->image.size, false};
+    const uint8_t* magic = readBytes(&reader, 4);
+    const uint8_t* format = readBytes(&reader, 4);
+    uint32_t versionLen = readU32(&reader);
+    const uint8_t* version = readBytes(&reader, versionLen);
+    uint32_t count = readU32(&reader);
+
+    bool ok = !reader.failed &&
+              memcmp(magic, BUNDLE_MAGIC, 4) == 0 &&
+              format[0] == BUNDLE_FORMAT && format[1] == 0 &&
+              versionLen == strlen(CIETO_VERSION) &&
+              memcmp(version, CIETO_VERSION, versionLen) == 0 &&
+              count > 0 && count <= bundle->image.size;
+
+    if(ok){
+        bundle->entries = (BundleEntry*)malloc(sizeof(BundleEntry) * count);
+        ok = bundle->entries != NULL;
+    }
+
+    for(uint32_t i = 0; ok && i < count; i++){
+        BundleEntry* entry = &bundle->entries[i];
+        entry->pathLen = readU32(&reader);
+        entry->path = (const char*)readBytes(&reader, entry->pathLen);
+        entry->offset = readU32(&reader);
+        entry->size = readU32(&reader);
+        ok = !reader.failed &&
+             entry->offset <= bundle->image.size &&
+             entry->size <= bundle->image.size - entry->offset;
+    }
+
+    if(!ok){
+        free(bundle->entries);
+        unmapBytecodeFile(&bundle->image);
+        free(bundle);
+        return false;
+    }
+
+    bundle->count = count;
+    closeBundle(vm);
+    vm->bundle = bundle;
+    return true;
+}
+
+void closeBundle(VM* vm){
+    Bundle* bundle = vm->bundle;
+    if(bundle == NULL){
+        return;
+    }
+    free(bundle->entries);
+    unmapBytecodeFile(&bundle->image);
+    free(bundle);
+    vm->bundle = NULL;
+}
+
+ObjectFunc* loadBundleEntry(VM* vm){
+    Bundle* bundle = vm->bundle;
+    if(bundle == NULL){
+        return NULL;
+    }
+    BundleEntry* entry = &bundle->entries[0];
+    return deserializeFunc(vm, bundle->image.data + entry->offset, entry->size, vm->curGlobal);
+}
+
+bool findBundledModule(VM* vm, const char* path, const uint8_t** data, size_t* size){
+    Bundle* bundle = vm->bundle;
+    if(bundle == NULL){
+        return false;
+    }
+
+    size_t pathLen = strlen(path);
+    for(uint32_t i = 1; i < bundle->count; i++){
+        BundleEntry* entry = &bundle->entries[i];
+        if(entry->pathLen == pathLen && memcmp(entry->path, path, pathLen) == 0){
+            *data = bundle->image.data + entry->offset;
+            *size = entry->size;
+            return true;
+        }
+    }
+    return false;
+}
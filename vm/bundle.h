@@ -0,0 +1,34 @@
+#ifndef CIETO_BUNDLE_H
+#define CIETO_BUNDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+/*
+ * A script and every module it imports by literal path, in one file:
+ *
+ * | magic "CBDL" | u16 format | u16 0 | str version |
+ * | u32 n | n * (str path, u32 offset, u32 size) |   the entry script first
+ * | n * .pco image |
+ *
+ * Paths are the normalized import paths seen when bundling. They are
+ * resolved from the srcName of the importing code, which the images
+ * keep, so lookups match no matter where the bundle is run from.
+*/
+
+#define BUNDLE_MAGIC    "CBDL"
+#define BUNDLE_FORMAT   1
+#define BUNDLE_EXT      ".cbundle"
+
+bool writeBundleFile(VM* vm, const char* path, const char* outPath);
+
+bool openBundle(VM* vm, const char* path);
+void closeBundle(VM* vm);
+ObjectFunc* loadBundleEntry(VM* vm);
+bool findBundledModule(VM* vm, const char* path, const uint8_t** data, size_t* size);
+
+bool isBundlePath(const char* path);
+
+#endif // CIETO_BUNDLE_H
@@ -0,0 +1,923 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#include "bytecode.h"
+#include "chunk.h"
+#include "mem.h"
+#include "object.h"
+#include "version.h"
+
+#define BYTECODE_DEPTH_MAX 200  // nesting of function and collection constants
+
+typedef enum{
+    BC_NULL,
+    BC_TRUE,
+    BC_FALSE,
+    BC_NUM,
+    BC_STRING,
+    BC_FUNC,
+    BC_LIST,
+    BC_MAP,
+}BytecodeTag;
+
+#define BC_HAS_NAME     1
+#define BC_HAS_SRC_NAME 2
+#define BC_LAZY         4   // not compiled yet, carries its source instead of code
+
+typedef struct{
+    VM* vm;
+    BytecodeBuffer* out;
+    GlobalEnv* globals;
+    ObjectString** slotNames;   // slot -> name, for the slots of globals
+    bool* usedSlots;
+    bool failed;
+}BytecodeWriter;
+
+typedef struct{
+    VM* vm;
+    const uint8_t* cur;
+    const uint8_t* end;
+    GlobalEnv* globals;
+    uint32_t* slotMap;  // slot in the file -> slot in globals
+    bool* mapped;
+    uint32_t slotCnt;
+    bool failed;
+}BytecodeReader;
+
+static bool isLittleEndian(void){
+    uint16_t probe = 1;
+    return *(uint8_t*)&probe == 1;
+}
+
+void initBytecodeBuffer(BytecodeBuffer* buffer){
+    buffer->data = NULL;
+    buffer->count = 0;
+    buffer->capacity = 0;
+}
+
+void freeBytecodeBuffer(BytecodeBuffer* buffer){
+    free(buffer->data);
+    initBytecodeBuffer(buffer);
+}
+
+bool isBytecodePath(const char* path){
+    size_t len = strlen(path);
+    size_t extLen = strlen(BYTECODE_EXT);
+    return len > extLen && strcmp(path + len - extLen, BYTECODE_EXT) == 0;
+}
+
+static void writeBytes(BytecodeWriter* writer, const void* bytes, size_t len){
+    BytecodeBuffer* out = writer->out;
+    if(writer->failed){
+        return;
+    }
+
+    if(out->count + len > out->capacity){
+        size_t capacity = out->capacity < 256 ? 256 : out->capacity;
+        while(capacity < out->count + len){
+            capacity *= 2;
+        }
+
+        uint8_t* data = (uint8_t*)realloc(out->data, capacity);
+        if(data == NULL){
+            writer->failed = true;
+            return;
+        }
+        out->data = data;
+        out->capacity = capacity;
+    }
+
+    memcpy(out->data + out->count, bytes, len);
+    out->count += len;
+}
+
+static void writeU8(BytecodeWriter* writer, uint8_t value){
+    writeBytes(writer, &value, 1);
+}
+
+static void writeU16(BytecodeWriter* writer, uint16_t value){
+    uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+    writeBytes(writer, bytes, sizeof(bytes));
+}
+
+static void writeU32(BytecodeWriter* writer, uint32_t value){
+    uint8_t bytes[4];
+    for(int i = 0; i < 4; i++){
+        bytes[i] = (uint8_t)(value >> (i * 8));
+    }
+    writeBytes(writer, bytes, sizeof(bytes));
+}
+
+static void writeU64(BytecodeWriter* writer, uint64_t value){
+    uint8_t bytes[8];
+    for(int i = 0; i < 8; i++){
+        bytes[i] = (uint8_t)(value >> (i * 8));
+    }
+    writeBytes(writer, bytes, sizeof(bytes));
+}
+
+static void writeStr(BytecodeWriter* writer, const char* chars, size_t len){
+    writeU32(writer, (uint32_t)len);
+    writeBytes(writer, chars, len);
+}
+
+static bool collectSlots(BytecodeWriter* writer, ObjectFunc* func, int depth){
+    if(depth > BYTECODE_DEPTH_MAX){
+        return false;
+    }
+
+    for(size_t i = 0; i < func->chunk.count; i++){
+        Instruction instruction = func->chunk.code[i];
+        OpCode op = GET_OPCODE(instruction);
+        if(op == OP_GET_GLOBAL || op == OP_SET_GLOBAL){
+            uint32_t slot = (uint32_t)GET_ARG_Bx(instruction);
+            if(slot >= writer->globals->count || writer->slotNames[slot] == NULL){
+                return false;
+            }
+            writer->usedSlots[slot] = true;
+        }
+    }
+
+    for(size_t i = 0; i < func->chunk.constants.count; i++){
+        Value value = func->chunk.constants.values[i];
+        if(IS_FUNC(value) && !collectSlots(writer, AS_FUNC(value), depth + 1)){
+            return false;
+        }
+    }
+    return true;
+}
+
+static void writeFunc(BytecodeWriter* writer, ObjectFunc* func);
+
+static void writeValue(BytecodeWriter* writer, Value value){
+    if(IS_NULL(value)){
+        writeU8(writer, BC_NULL);
+    }else if(IS_BOOL(value)){
+        writeU8(writer, AS_BOOL(value) ? BC_TRUE : BC_FALSE);
+    }else if(IS_NUM(value)){
+        writeU8(writer, BC_NUM);
+        writeU64(writer, (uint64_t)value);
+    }else if(IS_STRING(value)){
+        writeU8(writer, BC_STRING);
+        writeStr(writer, AS_STRING(value)->chars, AS_STRING(value)->length);
+    }else if(IS_FUNC(value)){
+        writeU8(writer, BC_FUNC);
+        writeFunc(writer, AS_FUNC(value));
+    }else if(IS_LIST(value)){
+        ObjectList* list = AS_LIST(value);
+        writeU8(writer, BC_LIST);
+        writeU32(writer, (uint32_t)list->count);
+        for(int i = 0; i < list->count; i++){
+            writeValue(writer, list->items[i]);
+        }
+    }else if(IS_MAP(value)){
+        HashTable* table = &AS_MAP(value)->table;
+        writeU8(writer, BC_MAP);
+        writeU32(writer, (uint32_t)table->count);
+        for(int i = 0; i < table->capacity; i++){
+            Entry* entry = &table->entries[i];
+            if(IS_EMPTY(entry->key)){
+                continue;
+            }
+            writeValue(writer, entry->key);
+            writeValue(writer, entry->value);
+        }
+    }else{
+        writer->failed = true;  // no constant of another type is ever emitted
+    }
+}
+
+static void writeFunc(BytecodeWriter* writer, ObjectFunc* func){
+    uint8_t flags = (func->name != NULL ? BC_HAS_NAME : 0) |
+                    (func->srcName != NULL ? BC_HAS_SRC_NAME : 0) |
+                    (func->lazySrc != NULL ? BC_LAZY : 0);
+    writeU8(writer, (uint8_t)func->type);
+    writeU8(writer, flags);
+    if(func->name != NULL){
+        writeStr(writer, func->name->chars, func->name->length);
+    }
+    if(func->srcName != NULL){
+        writeStr(writer, func->srcName->chars, func->srcName->length);
+    }
+    writeU32(writer, (uint32_t)func->arity);
+    writeU32(writer, (uint32_t)func->upvalueCnt);
+    writeU64(writer, func->flatUpvalues);
+    writeU32(writer, (uint32_t)func->maxRegSlots);
+    if(func->lazySrc != NULL){
+        // a stub keeps its source and is compiled on the first call, as before
+        writeU32(writer, (uint32_t)func->lazyLine);
+        writeStr(writer, func->lazySrc, func->lazyLen);
+    }
+
+    writeU32(writer, (uint32_t)func->chunk.count);
+    for(size_t i = 0; i < func->chunk.count; i++){
+        writeU32(writer, func->chunk.code[i]);
+    }
+    writeU32(writer, (uint32_t)func->chunk.lineCount);
+    for(int i = 0; i < func->chunk.lineCount; i++){
+        writeU32(writer, (uint32_t)func->chunk.lines[i].offset);
+        writeU32(writer, (uint32_t)func->chunk.lines[i].line);
+    }
+
+    writeU32(writer, (uint32_t)func->chunk.constants.count);
+    for(size_t i = 0; i < func->chunk.constants.count; i++){
+        writeValue(writer, func->chunk.constants.values[i]);
+    }
+}
+
+bool serializeFunc(VM* vm, ObjectFunc* func, GlobalEnv* globals, BytecodeBuffer* out){
+    BytecodeWriter writer = {
+        .vm = vm,
+        .out = out,
+        .globals = globals,
+        .slotNames = NULL,
+        .usedSlots = NULL,
+        .failed = false
+    };
+
+    if(globals->count > 0){
+        writer.slotNames = (ObjectString**)calloc(globals->count, sizeof(ObjectString*));
+        writer.usedSlots = (bool*)calloc(globals->count, sizeof(bool));
+        if(writer.slotNames == NULL || writer.usedSlots == NULL){
+            free(writer.slotNames);
+            free(writer.usedSlots);
+            return false;
+        }
+    }
+
+    for(size_t i = 0; i < globals->names.capacity; i++){
+        GlobalNameEntry* entry = &globals->names.entries[i];
+        if(entry->name != NULL && entry->slot < globals->count){
+            writer.slotNames[entry->slot] = entry->name;
+        }
+    }
+
+    bool ok = collectSlots(&writer, func, 0);
+
+    if(ok){
+        writeBytes(&writer, BYTECODE_MAGIC, 4);
+        writeU16(&writer, BYTECODE_FORMAT);
+        writeU16(&writer, 0);
+        writeStr(&writer, CIETO_VERSION, strlen(CIETO_VERSION));
+
+        uint32_t usedCnt = 0;
+        for(size_t i = 0; i < globals->count; i++){
+            usedCnt += writer.usedSlots[i] ? 1 : 0;
+        }
+        writeU32(&writer, usedCnt);
+        for(size_t i = 0; i < globals->count; i++){
+            if(writer.usedSlots[i]){
+                writeU32(&writer, (uint32_t)i);
+                writeStr(&writer, writer.slotNames[i]->chars, writer.slotNames[i]->length);
+            }
+        }
+
+        writeFunc(&writer, func);
+        ok = !writer.failed;
+    }
+
+    free(writer.slotNames);
+    free(writer.usedSlots);
+    return ok;
+}
+
+static const uint8_t* readBytes(BytecodeReader* reader, size_t len){
+    if(reader->failed || (size_t)(reader->end - reader->cur) < len){
+        reader->failed = true;
+        return NULL;
+    }
+    const uint8_t* bytes = reader->cur;
+    reader->cur += len;
+    return bytes;
+}
+
+static uint8_t readU8(BytecodeReader* reader){
+    const uint8_t* bytes = readBytes(reader, 1);
+    return bytes != NULL ? bytes[0] : 0;
+}
+
+static uint16_t readU16(BytecodeReader* reader){
+    const uint8_t* bytes = readBytes(reader, 2);
+    return bytes != NULL ? (uint16_t)(bytes[0] | (bytes[1] << 8)) : 0;
+}
+
+static uint32_t readU32(BytecodeReader* reader){
+    const uint8_t* bytes = readBytes(reader, 4);
+    if(bytes == NULL){
+        return 0;
+    }
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+           ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint64_t readU64(BytecodeReader* reader){
+    const uint8_t* bytes = readBytes(reader, 8);
+    uint64_t value = 0;
+    if(bytes != NULL){
+        for(int i = 7; i >= 0; i--){
+            value = (value << 8) | bytes[i];
+        }
+    }
+    return value;
+}
+
+static ObjectString* readString(BytecodeReader* reader){
+    uint32_t len = readU32(reader);
+    const uint8_t* chars = readBytes(reader, len);
+    if(chars == NULL || len > INT32_MAX){
+        reader->failed = true;
+        return NULL;
+    }
+    return copyString(reader->vm, (const char*)chars, (int)len);
+}
+
+static ObjectFunc* readFunc(BytecodeReader* reader, int depth);
+
+static Value readValue(BytecodeReader* reader, int depth){
+    VM* vm = reader->vm;
+    if(depth > BYTECODE_DEPTH_MAX){
+        reader->failed = true;
+        return NULL_VAL;
+    }
+
+    switch(readU8(reader)){
+        case BC_NULL:   return NULL_VAL;
+        case BC_TRUE:   return BOOL_VAL(true);
+        case BC_FALSE:  return BOOL_VAL(false);
+        case BC_NUM:{
+            Value num = (Value)readU64(reader);
+            if(!IS_NUM(num)){
+                reader->failed = true;  // other bit patterns would pose as objects
+                return NULL_VAL;
+            }
+            return num;
+        }
+        case BC_STRING:{
+            ObjectString* str = readString(reader);
+            return str != NULL ? OBJECT_VAL(str) : NULL_VAL;
+        }
+        case BC_FUNC:{
+            ObjectFunc* func = readFunc(reader, depth + 1);
+            return func != NULL ? OBJECT_VAL(func) : NULL_VAL;
+        }
+        case BC_LIST:{
+            uint32_t count = readU32(reader);
+            ObjectList* list = newList(vm);
+            push(vm, OBJECT_VAL(list));
+            for(uint32_t i = 0; i < count && !reader->failed; i++){
+                Value item = readValue(reader, depth + 1);
+                push(vm, item);
+                appendToList(vm, list, item);
+                pop(vm);
+            }
+            pop(vm);
+            return OBJECT_VAL(list);
+        }
+        case BC_MAP:{
+            uint32_t count = readU32(reader);
+            ObjectMap* map = newMap(vm);
+            push(vm, OBJECT_VAL(map));
+            for(uint32_t i = 0; i < count && !reader->failed; i++){
+                Value key = readValue(reader, depth + 1);
+                push(vm, key);
+                Value value = readValue(reader, depth + 1);
+                push(vm, value);
+                tableSet(vm, &map->table, key, value);
+                pop(vm);
+                pop(vm);
+            }
+            pop(vm);
+            return OBJECT_VAL(map);
+        }
+        default:
+            reader->failed = true;
+            return NULL_VAL;
+    }
+}
+
+static ObjectFunc* readFunc(BytecodeReader* reader, int depth){
+    VM* vm = reader->vm;
+    ObjectFunc* func = newFunction(vm);
+    push(vm, OBJECT_VAL(func));
+
+    func->type = (FuncType)readU8(reader);
+    uint8_t flags = readU8(reader);
+    if(flags & BC_HAS_NAME){
+        func->name = readString(reader);
+    }
+    if(flags & BC_HAS_SRC_NAME){
+        func->srcName = readString(reader);
+    }
+    func->arity = (int)readU32(reader);
+    func->upvalueCnt = (int)readU32(reader);
+    func->flatUpvalues = readU64(reader);
+    func->maxRegSlots = (int)readU32(reader);
+
+    if(flags & BC_LAZY){
+        func->lazyLine = (int)readU32(reader);
+        uint32_t len = readU32(reader);
+        const uint8_t* src = readBytes(reader, len);
+        if(src == NULL || len > INT32_MAX - 1){
+            reader->failed = true;
+            pop(vm);
+            return NULL;
+        }
+
+        func->lazySrc = GROW_ARRAY(vm, char, NULL, 0, len + 1);
+        memcpy(func->lazySrc, src, len);
+        func->lazySrc[len] = '\0';
+        func->lazyLen = (int)len;
+    }
+
+    uint32_t codeCnt = readU32(reader);
+    const uint8_t* code = readBytes(reader, (size_t)codeCnt * sizeof(Instruction));
+    uint32_t lineCnt = readU32(reader);
+    const uint8_t* lines = readBytes(reader, (size_t)lineCnt * 2 * sizeof(uint32_t));
+    if(reader->failed || (codeCnt == 0 && func->lazySrc == NULL) ||
+       (lineCnt == 0) != (codeCnt == 0) || lineCnt > codeCnt){
+        reader->failed = true;
+        pop(vm);
+        return NULL;
+    }
+
+    // sized exactly, as shrinkChunk() leaves a compiled chunk
+    Chunk* chunk = &func->chunk;
+    if(codeCnt > 0){
+        chunk->code = GROW_ARRAY(vm, Instruction, NULL, 0, codeCnt);
+        chunk->lines = GROW_ARRAY(vm, LineStart, NULL, 0, lineCnt);
+        chunk->count = codeCnt;
+        chunk->capacity = codeCnt;
+        chunk->lineCapacity = (int)lineCnt;
+
+        if(isLittleEndian()){
+            memcpy(chunk->code, code, (size_t)codeCnt * sizeof(Instruction));
+        }else{
+            BytecodeReader block = {.cur = code, .end = code + (size_t)codeCnt * sizeof(Instruction)};
+            for(uint32_t i = 0; i < codeCnt; i++){
+                chunk->code[i] = readU32(&block);
+            }
+        }
+
+        // runs start at 0 and strictly increase, or getLine() could not search them
+        BytecodeReader block = {.cur = lines, .end = lines + (size_t)lineCnt * 2 * sizeof(uint32_t)};
+        for(uint32_t i = 0; i < lineCnt; i++){
+            uint32_t offset = readU32(&block);
+            uint32_t line = readU32(&block);
+            if(offset >= codeCnt || line > INT32_MAX ||
+               (i == 0 ? offset != 0 : offset <= (uint32_t)chunk->lines[i - 1].offset)){
+                reader->failed = true;
+                break;
+            }
+            chunk->lines[i].offset = (int)offset;
+            chunk->lines[i].line = (int)line;
+            chunk->lineCount++;
+        }
+
+        for(uint32_t i = 0; i < codeCnt; i++){
+            Instruction instruction = chunk->code[i];
+            OpCode op = GET_OPCODE(instruction);
+            if(op == OP_GET_GLOBAL || op == OP_SET_GLOBAL){
+                uint32_t slot = (uint32_t)GET_ARG_Bx(instruction);
+                if(slot >= reader->slotCnt || !reader->mapped[slot]){
+                    reader->failed = true;
+                    break;
+                }
+                chunk->code[i] = CREATE_ABx(op, GET_ARG_A(instruction), reader->slotMap[slot]);
+            }
+        }
+    }
+
+    uint32_t constCnt = readU32(reader);
+    for(uint32_t i = 0; i < constCnt && !reader->failed; i++){
+        Value value = readValue(reader, depth);
+        push(vm, value);
+        writeValueArray(vm, &chunk->constants, value);
+        pop(vm);
+    }
+    if(!reader->failed && !verifyFunc(func)){
+        reader->failed = true;
+    }
+
+    pop(vm);
+    return reader->failed ? NULL : func;
+}
+
+// a jump or skip target: inside the chunk and not one of the captures
+static bool targetOk(const bool* capture, int target, int codeCnt){
+    return target >= 0 && target < codeCnt && !capture[target];
+}
+
+static bool constOk(ValueArray* constants, int index){
+    return (size_t)index < constants->count;
+}
+
+static bool offsetOk(const bool* capture, Value offset, int at, int codeCnt){
+    if(!IS_NUM(offset)){
+        return false;
+    }
+    double value = AS_NUM(offset);
+    if(!(value >= -codeCnt && value <= codeCnt) || value != (int)value){
+        return false;
+    }
+    return targetOk(capture, at + 1 + (int)value, codeCnt);
+}
+
+// a dense list [base, off0, off1, ...] or a map from case value to offset
+static bool switchTableOk(const bool* capture, Value table, int at, int codeCnt){
+    if(IS_LIST(table)){
+        ObjectList* list = AS_LIST(table);
+        if(list->count < 1 || !IS_NUM(list->items[0])){
+            return false;
+        }
+        for(int i = 1; i < list->count; i++){
+            if(!offsetOk(capture, list->items[i], at, codeCnt)){
+                return false;
+            }
+        }
+        return true;
+    }
+    if(IS_MAP(table)){
+        HashTable* cases = &AS_MAP(table)->table;
+        for(int i = 0; i < cases->capacity; i++){
+            if(!IS_EMPTY(cases->entries[i].key) && !offsetOk(capture, cases->entries[i].value, at, codeCnt)){
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+// the instructions after an OP_CLOSURE, one per upvalue of the new closure
+static bool capturesOk(ObjectFunc* outer, ObjectFunc* inner, int at){
+    const Instruction* code = outer->chunk.code;
+    if(at + inner->upvalueCnt >= outer->chunk.count){
+        return false;
+    }
+
+    for(int i = 0; i < inner->upvalueCnt; i++){
+        Instruction capture = code[at + 1 + i];
+        int index = GET_ARG_C(capture);
+        bool flat = IS_FLAT_UPVALUE(inner, i);
+        bool ok;
+        switch(GET_ARG_B(capture)){
+            case CAPTURE_UPVAL:
+            case CAPTURE_FLAT_UPVAL:
+                // a ref upvalue and a flat one share storage, so the kinds must agree
+                ok = index < outer->upvalueCnt && IS_FLAT_UPVALUE(outer, index) == flat &&
+                     (GET_ARG_B(capture) == CAPTURE_FLAT_UPVAL) == flat;
+                break;
+            case CAPTURE_LOCAL:
+            case CAPTURE_FLAT_LOCAL:
+                ok = index < outer->maxRegSlots && (GET_ARG_B(capture) == CAPTURE_FLAT_LOCAL) == flat;
+                break;
+            default:
+                ok = false;
+                break;
+        }
+        if(GET_OPCODE(capture) != OP_LOADNULL || !ok){
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * run() trusts its operands, so code read from a file is checked once
+ * when it is loaded: registers fall inside maxRegSlots, constants inside
+ * the pool and of the type the instruction reads, upvalues inside the
+ * closure and of the right kind, and every jump or skip lands on an
+ * instruction of the same chunk that is not a capture. The last
+ * instruction must be a return, so execution never runs off the end.
+ * Global slots are left to globalGetSlot(), which checks them anyway.
+*/
+bool verifyFunc(ObjectFunc* func){
+    Chunk* chunk = &func->chunk;
+    int codeCnt = (int)chunk->count;
+    int regs = func->maxRegSlots;
+    int upvalues = func->upvalueCnt;
+    ValueArray* constants = &chunk->constants;
+
+    if(func->type > TYPE_INITIALIZER || func->arity < 0 || upvalues < 0 || regs < 0 ||
+       chunk->count > INT32_MAX){
+        return false;
+    }
+    if(codeCnt == 0){
+        return func->lazySrc != NULL;   // compiled from its source on the first call
+    }
+    if(func->arity >= regs || GET_OPCODE(chunk->code[codeCnt - 1]) != OP_RETURN){
+        return false;
+    }
+
+    // captures are operands of their OP_CLOSURE, nothing may jump onto them
+    bool* capture = (bool*)calloc((size_t)codeCnt, sizeof(bool));
+    if(capture == NULL){
+        return false;
+    }
+    bool ok = true;
+    for(int i = 0; i < codeCnt && ok; i++){
+        Instruction instruction = chunk->code[i];
+        if(GET_OPCODE(instruction) != OP_CLOSURE){
+            continue;
+        }
+        int bx = GET_ARG_Bx(instruction);
+        ok = constOk(constants, bx) && IS_FUNC(constants->values[bx]) &&
+             capturesOk(func, AS_FUNC(constants->values[bx]), i);
+        for(int k = 0; ok && k < AS_FUNC(constants->values[bx])->upvalueCnt; k++){
+            capture[++i] = true;
+        }
+    }
+
+    for(int i = 0; i < codeCnt && ok; i++){
+        if(capture[i]){
+            continue;
+        }
+        Instruction instruction = chunk->code[i];
+        int a = GET_ARG_A(instruction);
+        int b = GET_ARG_B(instruction);
+        int c = GET_ARG_C(instruction);
+        int bx = GET_ARG_Bx(instruction);
+        int sBx = GET_ARG_sBx(instruction);
+        int target = -1;    // set for jumps and skips
+
+        switch(GET_OPCODE(instruction)){
+            case OP_MOVE:
+            case OP_NOT:
+            case OP_NEG:
+            case OP_TO_STRING:
+            case OP_SYSTEM:
+                ok = a < regs && b < regs;
+                break;
+            case OP_LOADK:
+            case OP_GET_MODULE:
+                ok = a < regs && constOk(constants, bx);
+                break;
+            case OP_LOADBOOL:
+                ok = a < regs;
+                if(c != 0){
+                    target = i + 2;
+                }
+                break;
+            case OP_LOADNULL:
+                ok = a + b < regs;      // R[A] through R[A+B]
+                break;
+            case OP_GET_GLOBAL:
+            case OP_SET_GLOBAL:
+            case OP_CLOSE_UPVAL:
+            case OP_BUILD_LIST:
+            case OP_BUILD_MAP:
+            case OP_DEFER:
+            case OP_PRINT:
+                ok = a < regs;
+                break;
+            case OP_GET_UPVAL:
+            case OP_SET_UPVAL:
+                ok = a < regs && b < upvalues && !IS_FLAT_UPVALUE(func, b);
+                break;
+            case OP_GET_UPVAL_FLAT:
+                ok = a < regs && b < upvalues && IS_FLAT_UPVALUE(func, b);
+                break;
+            case OP_GET_INDEX:
+            case OP_SET_INDEX:
+            case OP_GET_PROPERTY:
+            case OP_SET_PROPERTY:
+            case OP_FIELD:
+            case OP_METHOD:
+            case OP_FILL_LIST:
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+            case OP_ADD_NN: case OP_SUB_NN: case OP_MUL_NN:
+                ok = a < regs && b < regs && c < regs;
+                break;
+            case OP_EQ:
+            case OP_LT:
+            case OP_LE:
+            case OP_LT_NN:
+            case OP_LE_NN:
+                // A is the expected result, a mismatch skips the next instruction
+                ok = b < regs && c < regs;
+                target = i + 2;
+                break;
+            case OP_JMP:
+                target = i + 1 + sBx;
+                break;
+            case OP_JMP_IF_FALSE:
+            case OP_JMP_IF_TRUE:
+                ok = a < regs;
+                target = i + 1 + sBx;
+                break;
+            case OP_FOREACH:
+                ok = a + 2 < regs;      // iterable, state and the loop variable
+                target = i + 1 + sBx;
+                break;
+            case OP_SWITCH:
+                ok = a < regs && constOk(constants, bx) &&
+                     switchTableOk(capture, constants->values[bx], i, codeCnt);
+                break;
+            case OP_CALL:
+                ok = b >= 1 && a + b <= regs;   // callee, then b - 1 arguments
+                break;
+            case OP_RETURN:
+                ok = b <= 1 || a < regs;
+                break;
+            case OP_CLOSURE:
+                ok = a < regs;          // the constant and captures were checked above
+                break;
+            case OP_CLASS:
+            case OP_IMPORT:
+                ok = a < regs && constOk(constants, bx) && IS_STRING(constants->values[bx]);
+                break;
+            case OP_CLONE_K:
+                ok = a < regs && constOk(constants, bx) &&
+                     (IS_LIST(constants->values[bx]) || IS_MAP(constants->values[bx]));
+                break;
+            case OP_INIT_LIST:
+            case OP_CONCAT:
+                ok = a < regs && b + c <= regs;
+                break;
+            case OP_SLICE:
+                ok = a < regs && b < regs && c + 2 < regs;  // start, end and step
+                break;
+            default:
+                ok = false;     // OP_TAILCALL is never emitted, and unknown opcodes
+                break;
+        }
+
+        if(ok && target != -1){
+            ok = targetOk(capture, target, codeCnt);
+        }
+    }
+
+    free(capture);
+    return ok;
+}
+
+ObjectFunc* deserializeFunc(VM* vm, const uint8_t* data, size_t size, GlobalEnv* globals){
+    BytecodeReader reader = {
+        .vm = vm,
+        .cur = data,
+        .end = data + size,
+        .globals = globals,
+        .slotMap = NULL,
+        .mapped = NULL,
+        .slotCnt = 0,
+        .failed = false
+    };
+
+    const uint8_t* magic = readBytes(&reader, 4);
+    if(magic == NULL || memcmp(magic, BYTECODE_MAGIC, 4) != 0){
+        return NULL;
+    }
+    if(readU16(&reader) != BYTECODE_FORMAT){
+        return NULL;
+    }
+    readU16(&reader);
+
+    uint32_t versionLen = readU32(&reader);
+    const uint8_t* version = readBytes(&reader, versionLen);
+    if(version == NULL || versionLen != strlen(CIETO_VERSION) ||
+       memcmp(version, CIETO_VERSION, versionLen) != 0){
+        return NULL;
+    }   // the instruction set is only stable within a release
+
+    uint32_t globalCnt = readU32(&reader);
+    const uint8_t* globalTable = reader.cur;
+    for(uint32_t i = 0; i < globalCnt && !reader.failed; i++){
+        uint32_t slot = readU32(&reader);
+        readBytes(&reader, readU32(&reader));
+        if(slot >= reader.slotCnt){
+            reader.slotCnt = slot + 1;
+        }
+    }
+    if(reader.failed){
+        return NULL;
+    }
+
+    if(reader.slotCnt > 0){
+        reader.slotMap = (uint32_t*)calloc(reader.slotCnt, sizeof(uint32_t));
+        reader.mapped = (bool*)calloc(reader.slotCnt, sizeof(bool));
+        if(reader.slotMap == NULL || reader.mapped == NULL){
+            free(reader.slotMap);
+            free(reader.mapped);
+            return NULL;
+        }
+    }
+
+    reader.cur = globalTable;
+    for(uint32_t i = 0; i < globalCnt; i++){
+        uint32_t slot = readU32(&reader);
+        ObjectString* name = readString(&reader);
+        push(vm, OBJECT_VAL(name));
+        reader.mapped[slot] = globalEnsureSlot(vm, globals, name, &reader.slotMap[slot]);
+        pop(vm);
+    }
+
+    ObjectFunc* func = readFunc(&reader, 0);
+    if(reader.cur != reader.end){
+        func = NULL;
+    }
+
+    free(reader.slotMap);
+    free(reader.mapped);
+    return func;
+}
+
+bool writeBytecodeFile(VM* vm, ObjectFunc* func, GlobalEnv* globals, const char* path){
+    BytecodeBuffer buffer;
+    initBytecodeBuffer(&buffer);
+
+    if(!serializeFunc(vm, func, globals, &buffer)){
+        freeBytecodeBuffer(&buffer);
+        return false;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if(file == NULL){
+        freeBytecodeBuffer(&buffer);
+        return false;
+    }
+
+    bool ok = fwrite(buffer.data, 1, buffer.count, file) == buffer.count;
+    ok = fclose(file) == 0 && ok;
+
+    freeBytecodeBuffer(&buffer);
+    return ok;
+}
+
+bool mapBytecodeFile(const char* path, BytecodeImage* image){
+    image->data = NULL;
+    image->size = 0;
+#ifdef _WIN32
+    FILE* file = fopen(path, "rb");
+    if(file == NULL){
+        return false;
+    }
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+
+    uint8_t* data = size > 0 ? (uint8_t*)malloc((size_t)size) : NULL;
+    if(data == NULL || fread(data, 1, (size_t)size, file) != (size_t)size){
+        free(data);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+
+    image->data = data;
+    image->size = (size_t)size;
+    return true;
+#else
+    // map the file and build functions straight from the mapping
+    FILE* file = fopen(path, "rb");
+    if(file == NULL){
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fileno(file), &st) != 0 || st.st_size <= 0){
+        fclose(file);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    fclose(file);
+    if(data == MAP_FAILED){
+        return false;
+    }
+
+    image->data = (const uint8_t*)data;
+    image->size = size;
+    return true;
+#endif
+}
+
+void unmapBytecodeFile(BytecodeImage* image){
+    if(image->data == NULL){
+        return;
+    }
+#ifdef _WIN32
+    free((void*)image->data);
+#else
+    munmap((void*)image->data, image->size);
+#endif
+    image->data = NULL;
+    image->size = 0;
+}
+
+ObjectFunc* loadBytecodeFile(VM* vm, const char* path, GlobalEnv* globals){
+    BytecodeImage image;
+    if(!mapBytecodeFile(path, &image)){
+        return NULL;
+    }
+
+    ObjectFunc* func = deserializeFunc(vm, image.data, image.size, globals);
+    unmapBytecodeFile(&image);
+    return func;
+}
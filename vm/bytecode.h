@@ -0,0 +1,56 @@
+#ifndef CIETO_BYTECODE_H
+#define CIETO_BYTECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+/*
+ * Compiled functions in the .pco format:
+ *
+ * | magic "CPCO" | u16 format | u16 0 | str version |
+ * | u32 n | n * (u32 slot, str name) |    global slots used by the code
+ * | function |                           the script, constants nested inside
+ *
+ * Integers are little-endian, str is a u32 length followed by the bytes.
+ * Global slots are resolved by name again on load, so a file does not
+ * depend on the slot layout of the VM that wrote it. Function bodies
+ * that were never compiled are stored with their source and compiled on
+ * the first call, like any lazy stub.
+*/
+
+#define BYTECODE_MAGIC      "CPCO"
+#define BYTECODE_FORMAT     6   // bump on any change to the layout or the instruction set
+#define BYTECODE_EXT        ".pco"
+
+typedef struct{
+    uint8_t* data;
+    size_t count;
+    size_t capacity;
+}BytecodeBuffer;
+
+// a file mapped read-only, or read into memory where mmap is unavailable
+typedef struct{
+    const uint8_t* data;
+    size_t size;
+}BytecodeImage;
+
+void initBytecodeBuffer(BytecodeBuffer* buffer);
+void freeBytecodeBuffer(BytecodeBuffer* buffer);
+
+bool serializeFunc(VM* vm, ObjectFunc* func, GlobalEnv* globals, BytecodeBuffer* out);
+ObjectFunc* deserializeFunc(VM* vm, const uint8_t* data, size_t size, GlobalEnv* globals);
+
+// operands of loaded code are in range, see bytecode.c; nested functions are checked on their own
+bool verifyFunc(ObjectFunc* func);
+
+bool writeBytecodeFile(VM* vm, ObjectFunc* func, GlobalEnv* globals, const char* path);
+ObjectFunc* loadBytecodeFile(VM* vm, const char* path, GlobalEnv* globals);
+
+bool mapBytecodeFile(const char* path, BytecodeImage* image);
+void unmapBytecodeFile(BytecodeImage* image);
+
+bool isBytecodePath(const char* path);
+
+#endif // CIETO_BYTECODE_H
@@ -0,0 +1,240 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <direct.h>
+    #include <process.h>
+    #define PATH_SEP_STR "\\"
+#else
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define PATH_SEP_STR "/"
+#endif
+
+#include "compile_cache.h"
+#include "bytecode.h"
+#include "version.h"
+#include "xxhash.h"
+
+#define CACHE_HEADER_SIZE (8 + 4)   // u64 source hash, u32 path length
+
+// tells apart the temporary files of VMs in one process, like prefetch workers
+static atomic_uint tmpCounter;
+
+static char* dupString(const char* str){
+    size_t len = strlen(str);
+    char* copy = (char*)malloc(len + 1);
+    if(copy != NULL){
+        memcpy(copy, str, len + 1);
+    }
+    return copy;
+}
+
+static char* joinString(const char* head, const char* tail){
+    size_t headLen = strlen(head);
+    size_t tailLen = strlen(tail);
+    char* joined = (char*)malloc(headLen + tailLen + 1);
+    if(joined != NULL){
+        memcpy(joined, head, headLen);
+        memcpy(joined + headLen, tail, tailLen + 1);
+    }
+    return joined;
+}
+
+void setCacheDir(VM* vm, const char* dir){
+    free(vm->cacheDir);
+    vm->cacheDir = dir != NULL && dir[0] != '\0' ? dupString(dir) : NULL;
+}
+
+char* defaultCacheDir(void){
+    const char* dir = getenv("CIETO_CACHE_DIR");
+    if(dir != NULL && dir[0] != '\0'){
+        return dupString(dir);
+    }
+
+#ifdef _WIN32
+    const char* base = getenv("LOCALAPPDATA");
+    if(base != NULL && base[0] != '\0'){
+        return joinString(base, "\\cieto\\cache");
+    }
+#else
+    const char* base = getenv("XDG_CACHE_HOME");
+    if(base != NULL && base[0] != '\0'){
+        return joinString(base, "/cieto");
+    }
+    base = getenv("HOME");
+    if(base != NULL && base[0] != '\0'){
+        return joinString(base, "/.cache/cieto");
+    }
+#endif
+    return NULL;
+}
+
+static char* absolutePath(const char* path){
+#ifdef _WIN32
+    char* abs = _fullpath(NULL, path, 0);
+#else
+    char* abs = realpath(path, NULL);
+#endif
+    return abs != NULL ? abs : dupString(path);
+}
+
+static char* entryPath(VM* vm, const char* absPath){
+    // one entry per module, release and compile mode
+    uint8_t mode[2] = {BYTECODE_FORMAT, vm->eagerCompile ? 1 : 0};
+    uint64_t seed = XXH3_64bits_withSeed(CIETO_VERSION, sizeof(CIETO_VERSION) - 1,
+                                         XXH3_64bits(mode, sizeof(mode)));
+    uint64_t key = XXH3_64bits_withSeed(absPath, strlen(absPath), seed);
+
+    char name[32];
+    snprintf(name, sizeof(name), PATH_SEP_STR "%016llx" BYTECODE_EXT, (unsigned long long)key);
+    return joinString(vm->cacheDir, name);
+}
+
+static void makeDirs(const char* dir){
+    char* path = dupString(dir);
+    if(path == NULL){
+        return;
+    }
+
+    // create every missing parent, existing ones just fail
+    for(char* p = path + 1; ; p++){
+        if(*p == '/' || *p == '\\' || *p == '\0'){
+            char saved = *p;
+            *p = '\0';
+#ifdef _WIN32
+            _mkdir(path);
+#else
+            mkdir(path, 0755);
+#endif
+            *p = saved;
+            if(saved == '\0'){
+                break;
+            }
+        }
+    }
+    free(path);
+}
+
+static uint64_t readLE(const uint8_t* bytes, int size){
+    uint64_t value = 0;
+    for(int i = size - 1; i >= 0; i--){
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+static void writeLE(uint8_t* bytes, uint64_t value, int size){
+    for(int i = 0; i < size; i++){
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static bool mapEntry(VM* vm, const char* path, const char* source, size_t len, BytecodeImage* image, size_t* offset){
+    if(vm->cacheDir == NULL){
+        return false;
+    }
+
+    char* absPath = absolutePath(path);
+    char* cachePath = absPath != NULL ? entryPath(vm, absPath) : NULL;
+    bool ok = cachePath != NULL && mapBytecodeFile(cachePath, image);
+
+    if(ok){
+        size_t pathLen = strlen(absPath);
+        ok = image->size > CACHE_HEADER_SIZE &&
+             readLE(image->data, 8) == XXH3_64bits(source, len) &&
+             readLE(image->data + 8, 4) == pathLen &&
+             image->size - CACHE_HEADER_SIZE > pathLen &&
+             memcmp(image->data + CACHE_HEADER_SIZE, absPath, pathLen) == 0;
+        *offset = CACHE_HEADER_SIZE + pathLen;
+        if(!ok){
+            unmapBytecodeFile(image);
+        }
+    }
+
+    free(cachePath);
+    free(absPath);
+    return ok;
+}
+
+ObjectFunc* loadCachedModule(VM* vm, const char* path, const char* source, size_t len, GlobalEnv* globals){
+    BytecodeImage image;
+    size_t offset;
+    if(!mapEntry(vm, path, source, len, &image, &offset)){
+        return NULL;
+    }
+
+    ObjectFunc* func = deserializeFunc(vm, image.data + offset, image.size - offset, globals);
+    unmapBytecodeFile(&image);
+    return func;
+}
+
+bool hasCachedModule(VM* vm, const char* path, const char* source, size_t len){
+    BytecodeImage image;
+    size_t offset;
+    if(!mapEntry(vm, path, source, len, &image, &offset)){
+        return false;
+    }
+    unmapBytecodeFile(&image);
+    return true;
+}
+
+void storeCachedModule(VM* vm, const char* path, const char* source, size_t len, ObjectFunc* func, GlobalEnv* globals){
+    if(vm->cacheDir == NULL){
+        return;
+    }
+
+    BytecodeBuffer buffer;
+    initBytecodeBuffer(&buffer);
+    if(!serializeFunc(vm, func, globals, &buffer)){
+        freeBytecodeBuffer(&buffer);
+        return;
+    }
+
+    char* absPath = absolutePath(path);
+    char* cachePath = absPath != NULL ? entryPath(vm, absPath) : NULL;
+    char* tmpPath = NULL;
+    if(cachePath != NULL){
+        char suffix[48];
+        unsigned int serial = atomic_fetch_add(&tmpCounter, 1);
+#ifdef _WIN32
+        snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", (int)_getpid(), serial);
+#else
+        snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", (int)getpid(), serial);
+#endif
+        tmpPath = joinString(cachePath, suffix);
+    }
+
+    if(tmpPath != NULL){
+        makeDirs(vm->cacheDir);
+
+        size_t pathLen = strlen(absPath);
+        uint8_t header[CACHE_HEADER_SIZE];
+        writeLE(header, XXH3_64bits(source, len), 8);
+        writeLE(header + 8, pathLen, 4);
+
+        // written aside and renamed, so readers never see half an entry
+        FILE* file = fopen(tmpPath, "wb");
+        if(file != NULL){
+            bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+                      fwrite(absPath, 1, pathLen, file) == pathLen &&
+                      fwrite(buffer.data, 1, buffer.count, file) == buffer.count;
+            ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+            if(ok){
+                remove(cachePath);
+            }
+#endif
+            if(!ok || rename(tmpPath, cachePath) != 0){
+                remove(tmpPath);
+            }
+        }
+    }
+
+    free(tmpPath);
+    free(cachePath);
+    free(absPath);
+    freeBytecodeBuffer(&buffer);
+}
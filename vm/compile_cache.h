@@ -0,0 +1,28 @@
+#ifndef CIETO_COMPILE_CACHE_H
+#define CIETO_COMPILE_CACHE_H
+
+#include <stddef.h>
+
+#include "vm.h"
+
+/*
+ * On-disk cache of compiled script modules, kept in vm->cacheDir.
+ *
+ * An entry is named after the module's absolute path, the release and
+ * the compile mode, and holds:
+ *
+ * | u64 source hash | str path | .pco image |
+ *
+ * An entry whose source hash no longer matches is stale and gets
+ * replaced by the next compile. Failing to read or write the cache is
+ * never an error, the module is simply compiled from source.
+*/
+
+ObjectFunc* loadCachedModule(VM* vm, const char* path, const char* source, size_t len, GlobalEnv* globals);
+bool hasCachedModule(VM* vm, const char* path, const char* source, size_t len);
+void storeCachedModule(VM* vm, const char* path, const char* source, size_t len, ObjectFunc* func, GlobalEnv* globals);
+
+void setCacheDir(VM* vm, const char* dir);
+char* defaultCacheDir(void);
+
+#endif // CIETO_COMPILE_CACHE_H
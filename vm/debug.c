@@ -37,6 +37,7 @@ static const char* opNames[] = {
 
     "OP_GET_UPVAL",  // R[A] <= Upv[B]
     "OP_SET_UPVAL",  // Upv[B] <= R[A]
+    "OP_GET_UPVAL_FLAT",
     "OP_CLOSE_UPVAL",
 
     "OP_GET_INDEX", // R[A] <= R[B][R[C]]
@@ -52,6 +53,9 @@ static const char* opNames[] = {
     "OP_MUL", 
     "OP_DIV", 
     "OP_MOD",
+    "OP_ADD_NN",
+    "OP_SUB_NN",
+    "OP_MUL_NN",
 
     "OP_NOT", 
     "OP_NEG",
@@ -59,10 +63,13 @@ static const char* opNames[] = {
     "OP_EQ", 
     "OP_LT", 
     "OP_LE",
+    "OP_LT_NN",
+    "OP_LE_NN",
 
     "OP_JMP",
     "OP_JMP_IF_FALSE",  // R[A] is condition
     "OP_JMP_IF_TRUE",   // R[A] is condition
+    "OP_SWITCH",
     "OP_CALL",
     "OP_TAILCALL",
     "OP_DEFER",
@@ -78,21 +85,19 @@ static const char* opNames[] = {
     "OP_BUILD_MAP",
     "OP_INIT_LIST",
     "OP_FILL_LIST",
+    "OP_CLONE_K",
     "OP_SLICE",
     "OP_TO_STRING",
+    "OP_CONCAT",
 
     "OP_IMPORT",
+    "OP_GET_MODULE",
 
     "OP_FOREACH",
 
     "OP_PRINT",
 };
 
-int getLine(const Chunk* chunk, int offset){
-    if(offset < 0 || offset >= (int)chunk->count) return -1;
-    return chunk->lines[offset];
-}
-
 static ObjectString* getGlobalSlot(GlobalEnv* globals, uint32_t slot){
     if(globals == NULL)  return NULL;
 
@@ -267,9 +272,9 @@ static void dasmField(const char* name, const Chunk* chunk, Instruction instruct
 
 void dasmInstruction(Chunk* chunk, int offset, GlobalEnv* globals){
     printf("offset: %04d ", offset);
-    int line = chunk->lines[offset];
+    int line = getLine(chunk, offset);
 
-    if(offset > 0 && line == chunk->lines[offset - 1]){
+    if(offset > 0 && line == getLine(chunk, offset - 1)){
         printf(CLR_GRAY "   ~ | " CLR_RESET);
     }else{
         printf(CLR_GREEN "%4d | " CLR_RESET, line);
@@ -288,6 +293,7 @@ void dasmInstruction(Chunk* chunk, int offset, GlobalEnv* globals){
         case OP_LOADNULL:
         case OP_GET_UPVAL:
         case OP_SET_UPVAL:
+        case OP_GET_UPVAL_FLAT:
         case OP_CLOSE_UPVAL:
 
         case OP_GET_INDEX:
@@ -298,10 +304,15 @@ void dasmInstruction(Chunk* chunk, int offset, GlobalEnv* globals){
         case OP_MUL:
         case OP_DIV:
         case OP_MOD: 
+        case OP_ADD_NN:
+        case OP_SUB_NN:
+        case OP_MUL_NN:
 
         case OP_EQ: 
         case OP_LT: 
         case OP_LE:
+        case OP_LT_NN:
+        case OP_LE_NN:
 
         case OP_CALL: 
         case OP_TAILCALL: 
@@ -315,6 +326,7 @@ void dasmInstruction(Chunk* chunk, int offset, GlobalEnv* globals){
         case OP_FILL_LIST:
         case OP_SLICE:
         case OP_TO_STRING:
+        case OP_CONCAT:
         case OP_DEFER:
         case OP_SYSTEM:
         case OP_PRINT:
@@ -331,7 +343,10 @@ void dasmInstruction(Chunk* chunk, int offset, GlobalEnv* globals){
         case OP_LOADK:
         case OP_CLOSURE:
         case OP_IMPORT:
+        case OP_GET_MODULE:
         case OP_CLASS:
+        case OP_SWITCH:
+        case OP_CLONE_K:
             dasmLoadK(opName, chunk, instruction);
             break;
 
@@ -10,7 +10,6 @@ void dasmChunk(Chunk* chunk, const char* name, GlobalEnv* globals);
 void dasmInstruction(Chunk* chunk, int offset, GlobalEnv* globals);
 
 void dasmFunction(ObjectFunc* func, GlobalEnv* globals);
-int getLine(const Chunk* chunk, int offset);
 
 static void dasmABC(const char* name, Instruction instruction);
 static void dasmABx(const char* name, Instruction instruction);
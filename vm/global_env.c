@@ -70,7 +70,7 @@ static void adjustNameMap(VM* vm, GlobalNameMap* map, size_t newCapacity){
 }
 
 static bool ensureValueCapacity(VM* vm, GlobalEnv* env, size_t minCapacity){
-    if(env->count >= minCapacity){
+    if(env->capacity >= minCapacity){
         return true;
     }
 
@@ -127,14 +127,16 @@ bool globalEnsureSlot(VM* vm, GlobalEnv* env, ObjectString* name, uint32_t* slot
         return false;
     }
 
+    // the name may be a fresh string, root it while the map grows
+    push(vm, OBJECT_VAL(name));
+
     if(env->names.count + 1 > env->names.capacity * GLOBAL_NAME_MAX_LOAD){
         size_t newCapacity = GROW_CAPACITY(env->names.capacity);
         adjustNameMap(vm, &env->names, newCapacity);
     }
 
-    if(!ensureValueCapacity(vm, env, env->count + 1)){
-        return false;
-    }
+    ensureValueCapacity(vm, env, env->count + 1);
+    pop(vm);
 
     uint32_t newSlot = (uint32_t)env->count;
     GlobalNameEntry* entry = findNameEntry(env->names.entries, env->names.capacity, name);
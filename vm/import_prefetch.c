@@ -0,0 +1,323 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "import_prefetch.h"
+#include "compile_cache.h"
+#include "compiler.h"
+#include "module_loader.h"
+
+typedef enum{
+    PREFETCH_QUEUED,
+    PREFETCH_RUNNING,
+    PREFETCH_DONE,
+    PREFETCH_TAKEN,     // claimed by OP_IMPORT
+}PrefetchState;
+
+typedef struct PrefetchJob{
+    char* path;             // normalized, the same key as vm->modCache
+    PrefetchState state;
+    char* source;           // NULL if the file could not be read
+    size_t sourceLen;
+    BytecodeBuffer image;   // empty if the compile failed or the disk cache has it
+    struct PrefetchJob* next;
+}PrefetchJob;
+
+typedef struct ImportPrefetch{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    PrefetchJob* jobs;      // in the order the imports were found
+    PrefetchJob* lastJob;
+    int jobCnt;
+    int queuedCnt;
+    int runningCnt;
+    bool stopping;
+
+    pthread_t workers[PREFETCH_WORKERS_MAX];
+    int workerCnt;
+
+    // settings the worker VMs copy from the main VM
+    bool eagerCompile;
+    char* cacheDir;
+}ImportPrefetch;
+
+static char* readSource(const char* path, size_t* len){
+    // unlike readScript(), failing is not fatal here
+    FILE* file = fopen(path, "rb");
+    if(file == NULL){
+        return NULL;
+    }
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+
+    char* content = size >= 0 ? (char*)malloc((size_t)size + 1) : NULL;
+    if(content == NULL){
+        fclose(file);
+        return NULL;
+    }
+    *len = fread(content, 1, (size_t)size, file);
+    content[*len] = '\0';
+    fclose(file);
+    return content;
+}
+
+static int onlineCpus(void){
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+#endif
+}
+
+static PrefetchJob* findJob(ImportPrefetch* prefetch, const char* path){
+    for(PrefetchJob* job = prefetch->jobs; job != NULL; job = job->next){
+        if(strcmp(job->path, path) == 0){
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static void enqueue(ImportPrefetch* prefetch, char* path){
+    // takes ownership of path, caller holds the lock
+    if(prefetch->jobCnt >= PREFETCH_JOBS_MAX || findJob(prefetch, path) != NULL){
+        free(path);
+        return;
+    }
+
+    PrefetchJob* job = (PrefetchJob*)malloc(sizeof(PrefetchJob));
+    if(job == NULL){
+        free(path);
+        return;
+    }
+    job->path = path;
+    job->state = PREFETCH_QUEUED;
+    job->source = NULL;
+    job->sourceLen = 0;
+    initBytecodeBuffer(&job->image);
+    job->next = NULL;
+    if(prefetch->lastJob != NULL){
+        prefetch->lastJob->next = job;
+    }else{
+        prefetch->jobs = job;
+    }
+    prefetch->lastJob = job;
+    prefetch->jobCnt++;
+    prefetch->queuedCnt++;
+}
+
+static void enqueueFound(void* userData, char* path){
+    ImportPrefetch* prefetch = (ImportPrefetch*)userData;
+    pthread_mutex_lock(&prefetch->lock);
+    enqueue(prefetch, path);
+    pthread_mutex_unlock(&prefetch->lock);
+}
+
+static void compileJob(VM* vm, PrefetchJob* job){
+    job->source = readSource(job->path, &job->sourceLen);
+    if(job->source == NULL){
+        return;
+    }
+
+    // a fresh disk cache entry loads faster than the image would
+    if(hasCachedModule(vm, job->path, job->source, job->sourceLen)){
+        return;
+    }
+
+    GlobalEnv members;
+    initGlobalEnv(&members);
+    vm->curGlobal = &members;
+
+    ObjectFunc* func = compile(vm, job->source, job->path);
+    if(func != NULL){
+        func->type = TYPE_MODULE;
+        push(vm, OBJECT_VAL(func));
+        if(!serializeFunc(vm, func, &members, &job->image)){
+            freeBytecodeBuffer(&job->image);
+        }
+        storeCachedModule(vm, job->path, job->source, job->sourceLen, func, &members);
+        pop(vm);
+    }
+
+    vm->curGlobal = &vm->globals;
+    freeGlobalEnv(vm, &members);
+}
+
+static void* prefetchWorker(void* arg){
+    ImportPrefetch* prefetch = (ImportPrefetch*)arg;
+
+    // the VM is large, keep it off the thread stack
+    VM* vm = (VM*)malloc(sizeof(VM));
+    if(vm == NULL){
+        return NULL;
+    }
+    initVM(vm, 0, NULL);
+    vm->quietCompile = true;
+    vm->eagerCompile = prefetch->eagerCompile;
+    setCacheDir(vm, prefetch->cacheDir);
+
+    pthread_mutex_lock(&prefetch->lock);
+    for(;;){
+        // a running job may still queue the imports it finds
+        while(!prefetch->stopping && prefetch->queuedCnt == 0 && prefetch->runningCnt > 0){
+            pthread_cond_wait(&prefetch->changed, &prefetch->lock);
+        }
+        if(prefetch->stopping || prefetch->queuedCnt == 0){
+            break;
+        }
+
+        // the oldest queued job, the script reaches its import first
+        PrefetchJob* job = prefetch->jobs;
+        while(job->state != PREFETCH_QUEUED){
+            job = job->next;
+        }
+        job->state = PREFETCH_RUNNING;
+        prefetch->queuedCnt--;
+        prefetch->runningCnt++;
+        pthread_mutex_unlock(&prefetch->lock);
+
+        compileJob(vm, job);
+        if(job->source != NULL){
+            scanImports(job->source, job->path, enqueueFound, prefetch);
+        }
+
+        pthread_mutex_lock(&prefetch->lock);
+        job->state = PREFETCH_DONE;
+        prefetch->runningCnt--;
+        pthread_cond_broadcast(&prefetch->changed);
+    }
+    pthread_cond_broadcast(&prefetch->changed);
+    pthread_mutex_unlock(&prefetch->lock);
+
+    freeVM(vm);
+    free(vm);
+    return NULL;
+}
+
+void startImportPrefetch(VM* vm, const char* source, const char* path){
+    if(vm->prefetch != NULL || !vm->importPrefetch){
+        return;
+    }
+
+    // a worker only pays for its VM when it runs beside the main thread
+    int cpus = onlineCpus();
+    if(cpus <= 1){
+        return;
+    }
+
+    ImportPrefetch* prefetch = (ImportPrefetch*)calloc(1, sizeof(ImportPrefetch));
+    if(prefetch == NULL){
+        return;
+    }
+    pthread_mutex_init(&prefetch->lock, NULL);
+    pthread_cond_init(&prefetch->changed, NULL);
+    prefetch->eagerCompile = vm->eagerCompile;
+    if(vm->cacheDir != NULL){
+        prefetch->cacheDir = (char*)malloc(strlen(vm->cacheDir) + 1);
+        if(prefetch->cacheDir != NULL){
+            strcpy(prefetch->cacheDir, vm->cacheDir);
+        }
+    }
+    vm->prefetch = prefetch;
+
+    scanImports(source, path, enqueueFound, prefetch);
+
+    // the queue only grows from here, one worker per module found so far
+    int workerCnt = prefetch->queuedCnt < PREFETCH_WORKERS_MAX ? prefetch->queuedCnt : PREFETCH_WORKERS_MAX;
+    if(workerCnt > cpus - 1){
+        workerCnt = cpus - 1;   // leave one for the main thread
+    }
+    for(int i = 0; i < workerCnt; i++){
+        if(pthread_create(&prefetch->workers[prefetch->workerCnt], NULL, prefetchWorker, prefetch) != 0){
+            break;
+        }
+        prefetch->workerCnt++;
+    }
+
+    if(prefetch->workerCnt == 0){
+        stopImportPrefetch(vm);
+    }
+}
+
+void stopImportPrefetch(VM* vm){
+    ImportPrefetch* prefetch = vm->prefetch;
+    if(prefetch == NULL){
+        return;
+    }
+
+    pthread_mutex_lock(&prefetch->lock);
+    prefetch->stopping = true;
+    pthread_cond_broadcast(&prefetch->changed);
+    pthread_mutex_unlock(&prefetch->lock);
+
+    for(int i = 0; i < prefetch->workerCnt; i++){
+        pthread_join(prefetch->workers[i], NULL);
+    }
+
+    PrefetchJob* job = prefetch->jobs;
+    while(job != NULL){
+        PrefetchJob* next = job->next;
+        free(job->path);
+        free(job->source);
+        freeBytecodeBuffer(&job->image);
+        free(job);
+        job = next;
+    }
+
+    pthread_cond_destroy(&prefetch->changed);
+    pthread_mutex_destroy(&prefetch->lock);
+    free(prefetch->cacheDir);
+    free(prefetch);
+    vm->prefetch = NULL;
+}
+
+bool takePrefetchedModule(VM* vm, const char* path, char** source, size_t* len, BytecodeBuffer* image){
+    ImportPrefetch* prefetch = vm->prefetch;
+    if(prefetch == NULL){
+        return false;
+    }
+
+    pthread_mutex_lock(&prefetch->lock);
+    PrefetchJob* job = findJob(prefetch, path);
+    if(job == NULL || job->state == PREFETCH_TAKEN){
+        pthread_mutex_unlock(&prefetch->lock);
+        return false;
+    }
+
+    if(job->state == PREFETCH_QUEUED){
+        // not started yet, compiling it here is no slower
+        job->state = PREFETCH_TAKEN;
+        prefetch->queuedCnt--;
+        pthread_cond_broadcast(&prefetch->changed);
+        pthread_mutex_unlock(&prefetch->lock);
+        return false;
+    }
+
+    while(job->state == PREFETCH_RUNNING){
+        pthread_cond_wait(&prefetch->changed, &prefetch->lock);
+    }
+    job->state = PREFETCH_TAKEN;
+    pthread_mutex_unlock(&prefetch->lock);
+
+    if(job->source == NULL){
+        return false;
+    }
+
+    *source = job->source;
+    *len = job->sourceLen;
+    *image = job->image;
+    job->source = NULL;
+    initBytecodeBuffer(&job->image);
+    return true;
+}
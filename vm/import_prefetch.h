@@ -0,0 +1,30 @@
+#ifndef CIETO_IMPORT_PREFETCH_H
+#define CIETO_IMPORT_PREFETCH_H
+
+#include <stddef.h>
+
+#include "vm.h"
+#include "bytecode.h"
+
+#define PREFETCH_WORKERS_MAX 4
+#define PREFETCH_JOBS_MAX 256   // modules past this are left to OP_IMPORT
+
+/*
+ * Compiles the static import graph of a script ahead of OP_IMPORT.
+ *
+ * The script is scanned for `import "<literal>"`, and every script module
+ * found is read and compiled on a worker thread, whose imports are then
+ * scanned in turn. Each worker owns a private VM, so nothing touches the
+ * main heap: a compiled module is handed over as a .pco image and
+ * deserialized by the main thread when OP_IMPORT reaches it.
+ *
+ * Nothing starts on a single CPU, where the workers would only take
+ * turns with the main thread, or when vm->importPrefetch is off.
+*/
+
+void startImportPrefetch(VM* vm, const char* source, const char* path);
+void stopImportPrefetch(VM* vm);
+
+bool takePrefetchedModule(VM* vm, const char* path, char** source, size_t* len, BytecodeBuffer* image);
+
+#endif // CIETO_IMPORT_PREFETCH_H
@@ -83,6 +83,7 @@ typedef enum{
 
     OP_GET_UPVAL,  // R[A] <= Upv[B]
     OP_SET_UPVAL,  // Upv[B] <= R[A]
+    OP_GET_UPVAL_FLAT,  // R[A] <= Upv[B], held by value in the closure
     OP_CLOSE_UPVAL,
 
     OP_GET_INDEX, // R[A] <= R[B][R[C]]
@@ -94,21 +95,24 @@ typedef enum{
     OP_FIELD,
 
     OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+    OP_ADD_NN, OP_SUB_NN, OP_MUL_NN,    // operands proven numbers by the compiler
 
     OP_NOT, OP_NEG,
 
     OP_EQ, OP_LT, OP_LE,
+    OP_LT_NN, OP_LE_NN,
 
     OP_JMP,
     OP_JMP_IF_FALSE,  // R[A] is condition
     OP_JMP_IF_TRUE,   // R[A] is condition
+    OP_SWITCH,        // pc += K[Bx][R[A]], falls through to a JMP when absent
     OP_CALL,
     OP_TAILCALL,
     OP_DEFER,
     OP_SYSTEM,
     OP_RETURN,
 
-    OP_CLOSURE,
+    OP_CLOSURE,     // R[A] <= closure of K[Bx], then one capture per upvalue
 
     OP_CLASS,
     OP_METHOD,
@@ -117,16 +121,30 @@ typedef enum{
     OP_BUILD_MAP,
     OP_INIT_LIST,
     OP_FILL_LIST,
+    OP_CLONE_K,     // R[A] <= a fresh copy of the template list or map K[Bx]
     OP_SLICE,
     OP_TO_STRING,
+    OP_CONCAT,      // R[A] <= tostring(R[B]) .. ... .. tostring(R[B+C-1])
 
     OP_IMPORT,
+    OP_GET_MODULE,  // R[A] <= K[Bx], an OP_IMPORT after its first run
 
     OP_FOREACH,
 
     OP_PRINT,
 } OpCode;
 
+/*
+ * Each upvalue of an OP_CLOSURE is described by the instruction after
+ * it, an OP_LOADNULL that never runs: B is one of these, C the index.
+*/
+typedef enum{
+    CAPTURE_UPVAL,      // share the enclosing closure's Upv[C]
+    CAPTURE_LOCAL,      // share R[C] through an open upvalue
+    CAPTURE_FLAT_UPVAL, // copy the enclosing closure's flat Upv[C]
+    CAPTURE_FLAT_LOCAL, // copy R[C]
+}CaptureKind;
+
 #define SIZE_OP     8
 #define SIZE_A      8
 #define SIZE_B      8
@@ -1,12 +1,16 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <time.h>
 
 #include "module_loader.h"
 #include "object.h"
 #include "value.h"
 #include "registry.h"
 #include "compiler.h"
+#include "compile_cache.h"
+#include "import_prefetch.h"
+#include "bundle.h"
 #include "file.h"
 
 #ifdef _WIN32
@@ -17,6 +21,12 @@
     #define PATH_SEP_STR "/"
 #endif
 
+static double nowMs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
 static bool isPathSep(char c){
     return c == '/' || c == '\\';
 }
@@ -298,9 +308,92 @@ static InterpreterStatus loadNativeModule(
     return VM_OK;
 }
 
+static int addImportStat(VM* vm, const char* path){
+    ImportStats* stats = &vm->importStats;
+    if(stats->count == stats->capacity){
+        int capacity = stats->capacity < 8 ? 8 : stats->capacity * 2;
+        ImportStat* entries = (ImportStat*)realloc(stats->entries, sizeof(ImportStat) * capacity);
+        if(entries == NULL){
+            return -1;
+        }
+        stats->entries = entries;
+
+        // every module body runs at most once, so this bounds the nesting
+        int* running = (int*)realloc(stats->running, sizeof(int) * capacity);
+        if(running == NULL){
+            return -1;
+        }
+        stats->running = running;
+        stats->capacity = capacity;
+    }
+
+    char* copy = (char*)malloc(strlen(path) + 1);
+    if(copy == NULL){
+        return -1;
+    }
+    strcpy(copy, path);
+
+    ImportStat* stat = &stats->entries[stats->count];
+    memset(stat, 0, sizeof(ImportStat));
+    stat->path = copy;
+    return stats->count++;
+}
+
+void beginModuleRun(VM* vm, int statIndex){
+    ImportStats* stats = &vm->importStats;
+    if(statIndex < 0){
+        return;
+    }
+    stats->entries[statIndex].runStart = nowMs();
+    stats->running[stats->runningCnt++] = statIndex;
+}
+
+void endModuleRun(VM* vm){
+    ImportStats* stats = &vm->importStats;
+    if(stats->runningCnt == 0){
+        return;
+    }
+    ImportStat* stat = &stats->entries[stats->running[--stats->runningCnt]];
+    stat->executeMs = nowMs() - stat->runStart;
+}
+
+void printImportStats(VM* vm){
+    ImportStats* stats = &vm->importStats;
+    ImportStat total = {0};
+
+    writerWFormat(&vm->errOutput, "%10s %10s %10s %10s  %-8s  %s\n",
+                  "resolve", "read", "compile", "execute", "origin", "module (ms)");
+    for(int i = 0; i < stats->count; i++){
+        ImportStat* stat = &stats->entries[i];
+        writerWFormat(&vm->errOutput, "%10.3f %10.3f %10.3f %10.3f  %-8s  %s\n",
+                      stat->resolveMs, stat->readMs, stat->compileMs, stat->executeMs,
+                      stat->origin, stat->path);
+        total.resolveMs += stat->resolveMs;
+        total.readMs += stat->readMs;
+        total.compileMs += stat->compileMs;
+    }
+    // execute times nest, the outermost ones already include the rest
+    writerWFormat(&vm->errOutput, "%10.3f %10.3f %10.3f %10s  %-8s  %d modules\n",
+                  total.resolveMs, total.readMs, total.compileMs, "-", "", stats->count);
+}
+
+void freeImportStats(ImportStats* stats){
+    for(int i = 0; i < stats->count; i++){
+        free(stats->entries[i].path);
+    }
+    free(stats->entries);
+    free(stats->running);
+    stats->entries = NULL;
+    stats->running = NULL;
+    stats->count = 0;
+    stats->capacity = 0;
+    stats->runningCnt = 0;
+}
+
 static InterpreterStatus loadScriptModule(
     VM* vm,
     ObjectString* spec,
+    double resolveMs,
     ImportResult* result
 ){
     push(vm, OBJECT_VAL(spec));
@@ -313,11 +406,26 @@ static InterpreterStatus loadScriptModule(
         return VM_OK;
     }
 
-    char* source = readScript(spec->chars);
-    if(source == NULL){
-        runtimeError(vm, "Failed to read module file '%s'.", spec->chars);
-        pop(vm);    // spec
-        return VM_COMPILE_ERROR;
+    bool timed = vm->importStats.enabled;
+    double startMs = timed ? nowMs() : 0.0;
+
+    char* source = NULL;
+    size_t sourceLen = 0;
+    BytecodeBuffer image;
+    initBytecodeBuffer(&image);
+    const uint8_t* bundled = NULL;
+    size_t bundledSize = 0;
+
+    if(findBundledModule(vm, spec->chars, &bundled, &bundledSize)){
+        // shipped precompiled, the file system is not consulted
+    }else if(!takePrefetchedModule(vm, spec->chars, &source, &sourceLen, &image)){
+        source = readScript(spec->chars);
+        if(source == NULL){
+            runtimeError(vm, "Failed to read module file '%s'.", spec->chars);
+            pop(vm);    // spec
+            return VM_COMPILE_ERROR;
+        }
+        sourceLen = strlen(source);
     }
 
     ObjectString* moduleName = getModuleName(vm, spec->chars);
@@ -329,12 +437,37 @@ static InterpreterStatus loadScriptModule(
     GlobalEnv* prevGlobal = vm->curGlobal;
     vm->curGlobal = &module->members;
 
-    ObjectFunc* func = compile(vm, source, spec->chars);
+    double readMs = timed ? nowMs() - startMs : 0.0;
+    startMs = timed ? nowMs() : 0.0;
+
+    // from the bundle, compiled on a worker already, else from the disk cache, else here
+    const char* origin = "prefetch";
+    ObjectFunc* func = NULL;
+    if(bundled != NULL){
+        origin = "bundle";
+        func = deserializeFunc(vm, bundled, bundledSize, &module->members);
+    }else if(image.count > 0){
+        func = deserializeFunc(vm, image.data, image.count, &module->members);
+    }
+    freeBytecodeBuffer(&image);
+
+    bool compiled = false;
+    if(func == NULL && source != NULL){
+        origin = "cache";
+        func = loadCachedModule(vm, spec->chars, source, sourceLen, &module->members);
+    }
+    if(func == NULL && source != NULL){
+        origin = "source";
+        func = compile(vm, source, spec->chars);
+        compiled = true;
+    }
+
+    double compileMs = timed ? nowMs() - startMs : 0.0;
 
     vm->curGlobal = prevGlobal;
-    free(source);
 
     if(func == NULL){
+        free(source);
         runtimeError(vm, "Failed to compile module '%s'.", spec->chars);
         pop(vm);    // module
         pop(vm);    // moduleName
@@ -345,6 +478,11 @@ static InterpreterStatus loadScriptModule(
     func->type = TYPE_MODULE;
     push(vm, OBJECT_VAL(func));
 
+    if(compiled){
+        storeCachedModule(vm, spec->chars, source, sourceLen, func, &module->members);
+    }
+    free(source);
+
     tableSet(vm, &vm->modCache, OBJECT_VAL(spec), OBJECT_VAL(module));
     // cache module after compilation to avoid infinite recursion on circular imports
 
@@ -361,6 +499,17 @@ static InterpreterStatus loadScriptModule(
     result->module = module;
     result->closure = closure;
 
+    if(timed){
+        result->statIndex = addImportStat(vm, spec->chars);
+        if(result->statIndex >= 0){
+            ImportStat* stat = &vm->importStats.entries[result->statIndex];
+            stat->origin = origin;
+            stat->resolveMs = resolveMs;
+            stat->readMs = readMs;
+            stat->compileMs = compileMs;
+        }
+    }
+
     pop(vm);    // func
     pop(vm);    // module
     pop(vm);    // moduleName
@@ -369,6 +518,58 @@ static InterpreterStatus loadScriptModule(
     return VM_OK;
 }
 
+char* resolveModulePath(const char* spec, const char* requester){
+    // normalized path of a script import, NULL for native modules
+    if(!isScriptModule(spec)){
+        return NULL;
+    }
+
+    char* resolvedPath = resolveScriptPath(spec, requester);
+    if(resolvedPath == NULL){
+        return NULL;
+    }
+
+    char* normalizedPath = normalizeScriptPath(resolvedPath);
+    free(resolvedPath);
+    return normalizedPath;
+}
+
+void scanImports(const char* source, const char* requester, ImportVisitor visit, void* userData){
+    // only `import "<literal>"` is known before the code runs
+    initScanner(source);
+    setScannerQuiet(true);
+
+    Token token = scan();
+    while(token.type != TOKEN_EOF && token.type != TOKEN_ERROR){
+        if(token.type != TOKEN_IMPORT){
+            token = scan();
+            continue;
+        }
+
+        token = scan();
+        if(token.type != TOKEN_STRING_START){
+            continue;
+        }
+        Token text = scan();
+        token = scan();
+        if(text.type != TOKEN_INTERPOLATION_CONTENT || token.type != TOKEN_STRING_END){
+            continue;
+        }
+
+        char spec[1024];
+        if(text.len >= (int)sizeof(spec)){
+            continue;
+        }
+        memcpy(spec, text.head, (size_t)text.len);
+        spec[text.len] = '\0';
+
+        char* path = resolveModulePath(spec, requester);
+        if(path != NULL){
+            visit(userData, path);
+        }
+    }
+}
+
 InterpreterStatus importModule(
     VM* vm,
     ObjectString* spec,
@@ -377,6 +578,9 @@ InterpreterStatus importModule(
 ){
     result->module = NULL;
     result->closure = NULL;
+    result->statIndex = -1;
+
+    double startMs = vm->importStats.enabled ? nowMs() : 0.0;
 
     if(!isScriptModule(spec->chars)){
         const NativeModuleDef* nativeDef = findNativeModule(spec->chars);
@@ -406,6 +610,7 @@ InterpreterStatus importModule(
     ObjectString* resolvedSpec = copyString(vm, normalizedPath, (int)strlen(normalizedPath));
     free(normalizedPath);
 
-    return loadScriptModule(vm, resolvedSpec, result);
+    double resolveMs = vm->importStats.enabled ? nowMs() - startMs : 0.0;
+    return loadScriptModule(vm, resolvedSpec, resolveMs, result);
 }
 
@@ -6,8 +6,14 @@
 typedef struct ImportResult{
     ObjectModule* module;
     ObjectClosure* closure;
+    int statIndex;  // entry in vm->importStats, -1 if not recorded
 }ImportResult;
 
+typedef void (*ImportVisitor)(void* userData, char* path);   // path is the visitor's to free
+
+char* resolveModulePath(const char* spec, const char* requester);
+void scanImports(const char* source, const char* requester, ImportVisitor visit, void* userData);
+
 InterpreterStatus importModule(
     VM* vm,
     ObjectString* spec,
@@ -15,4 +21,9 @@ InterpreterStatus importModule(
     ImportResult* result
 );
 
+void beginModuleRun(VM* vm, int statIndex);
+void endModuleRun(VM* vm);
+void printImportStats(VM* vm);
+void freeImportStats(ImportStats* stats);
+
 #endif // CIETO_MODULE_LOADER_H
\ No newline at end of file
@@ -0,0 +1,1180 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "bytecode.h"
+#include "gc_policy.h"
+#include "mem.h"
+#include "object.h"
+#include "registry.h"
+#include "version.h"
+
+#define SNAPSHOT_NO_OBJECT  UINT32_MAX
+#define NATIVE_NAME_MAX     64
+
+typedef enum{
+    SN_NULL,
+    SN_TRUE,
+    SN_FALSE,
+    SN_NUM,
+    SN_OBJECT,
+    SN_EMPTY,   // a declared global that was never assigned
+}SnapshotTag;
+
+// how a string was made, so raw ones stay out of vm->strings
+typedef enum{
+    STRING_RAW,
+    STRING_INTERNED,
+    STRING_RAW_KEY,     // internAsKey
+}StringKind;
+
+typedef struct{
+    VM* vm;
+    BytecodeBuffer out;
+
+    Object** objects;       // index in the file -> object
+    uint32_t count;
+    uint32_t capacity;
+
+    Object** keys;          // object -> index, open addressing
+    uint32_t* ids;
+    size_t mapCapacity;
+
+    bool failed;
+}SnapshotWriter;
+
+typedef struct{
+    VM* vm;
+    const uint8_t* cur;
+    const uint8_t* end;
+    bool failed;
+}SnapshotReader;
+
+typedef struct{
+    VM* vm;
+    CFunc hostAdapter;
+
+    uint32_t count;
+    Object** objects;
+    uint8_t* types;
+    const uint8_t** bodies;
+    uint32_t* sizes;
+}SnapshotLoader;
+
+static void snapshotError(VM* vm, const char* format, ...){
+    va_list args;
+    va_start(args, format);
+    vsnprintf(vm->lastError, sizeof(vm->lastError), format, args);
+    va_end(args);
+}
+
+/*
+ * Natives are keyed by the C function they run and named after the static
+ * tables defineCFuncs() registers them from, "iter" or "fs.read", so
+ * neither side has to build the prelude or a native module to link them.
+*/
+
+static bool nativeName(CFunc func, char* name, size_t size){
+    for(const NativeFuncDef* def = listPreludeFuncs(); def->name != NULL; def++){
+        if(def->func == func){
+            snprintf(name, size, "%s", def->name);
+            return true;
+        }
+    }
+
+    for(const NativeModuleDef* module = listNativeModules(); module->name != NULL; module++){
+        for(const NativeFuncDef* def = module->funcs; def->name != NULL; def++){
+            if(def->func == func){
+                snprintf(name, size, "%s.%s", module->name, def->name);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static CFunc findFunc(const NativeFuncDef* defs, const char* name, size_t len){
+    for(; defs->name != NULL; defs++){
+        if(strlen(defs->name) == len && memcmp(defs->name, name, len) == 0){
+            return defs->func;
+        }
+    }
+    return NULL;
+}
+
+static CFunc nativeFunc(const char* name, size_t len){
+    const char* dot = (const char*)memchr(name, '.', len);
+    if(dot == NULL){
+        return findFunc(listPreludeFuncs(), name, len);
+    }
+
+    size_t moduleLen = (size_t)(dot - name);
+    for(const NativeModuleDef* module = listNativeModules(); module->name != NULL; module++){
+        if(strlen(module->name) == moduleLen && memcmp(module->name, name, moduleLen) == 0){
+            return findFunc(module->funcs, dot + 1, len - moduleLen - 1);
+        }
+    }
+    return NULL;
+}
+
+static ObjectString* globalNameOf(GlobalEnv* env, Object* object){
+    for(size_t i = 0; i < env->names.capacity; i++){
+        GlobalNameEntry* entry = &env->names.entries[i];
+        if(entry->name != NULL && entry->slot < env->count &&
+           env->values[entry->slot] == OBJECT_VAL(object)){
+            return entry->name;
+        }
+    }
+    return NULL;
+}
+
+static void writeBytes(SnapshotWriter* writer, const void* bytes, size_t len){
+    BytecodeBuffer* out = &writer->out;
+    if(writer->failed){
+        return;
+    }
+
+    if(out->count + len > out->capacity){
+        size_t capacity = out->capacity < 4096 ? 4096 : out->capacity;
+        while(capacity < out->count + len){
+            capacity *= 2;
+        }
+
+        uint8_t* data = (uint8_t*)realloc(out->data, capacity);
+        if(data == NULL){
+            snapshotError(writer->vm, "Out of memory while writing the snapshot.");
+            writer->failed = true;
+            return;
+        }
+        out->data = data;
+        out->capacity = capacity;
+    }
+
+    memcpy(out->data + out->count, bytes, len);
+    out->count += len;
+}
+
+static void writeU8(SnapshotWriter* writer, uint8_t value){
+    writeBytes(writer, &value, 1);
+}
+
+static void writeU32(SnapshotWriter* writer, uint32_t value){
+    uint8_t bytes[4];
+    for(int i = 0; i < 4; i++){
+        bytes[i] = (uint8_t)(value >> (i * 8));
+    }
+    writeBytes(writer, bytes, sizeof(bytes));
+}
+
+static void writeU64(SnapshotWriter* writer, uint64_t value){
+    uint8_t bytes[8];
+    for(int i = 0; i < 8; i++){
+        bytes[i] = (uint8_t)(value >> (i * 8));
+    }
+    writeBytes(writer, bytes, sizeof(bytes));
+}
+
+static void writeStr(SnapshotWriter* writer, const char* chars, size_t len){
+    writeU32(writer, (uint32_t)len);
+    writeBytes(writer, chars, len);
+}
+
+static size_t objectSlot(Object** keys, size_t capacity, Object* object){
+    size_t index = (size_t)(((uintptr_t)object >> 4) * 0x9E3779B97F4A7C15ull) & (capacity - 1);
+    while(keys[index] != NULL && keys[index] != object){
+        index = (index + 1) & (capacity - 1);
+    }
+    return index;
+}
+
+static uint32_t objectId(SnapshotWriter* writer, Object* object){
+    if(object == NULL || writer->mapCapacity == 0){
+        return SNAPSHOT_NO_OBJECT;
+    }
+    size_t index = objectSlot(writer->keys, writer->mapCapacity, object);
+    return writer->keys[index] == object ? writer->ids[index] : SNAPSHOT_NO_OBJECT;
+}
+
+static bool growObjectMap(SnapshotWriter* writer){
+    size_t capacity = writer->mapCapacity < 1024 ? 1024 : writer->mapCapacity * 2;
+    Object** keys = (Object**)calloc(capacity, sizeof(Object*));
+    uint32_t* ids = (uint32_t*)malloc(sizeof(uint32_t) * capacity);
+    if(keys == NULL || ids == NULL){
+        free(keys);
+        free(ids);
+        return false;
+    }
+
+    for(size_t i = 0; i < writer->mapCapacity; i++){
+        if(writer->keys[i] != NULL){
+            size_t index = objectSlot(keys, capacity, writer->keys[i]);
+            keys[index] = writer->keys[i];
+            ids[index] = writer->ids[i];
+        }
+    }
+
+    free(writer->keys);
+    free(writer->ids);
+    writer->keys = keys;
+    writer->ids = ids;
+    writer->mapCapacity = capacity;
+    return true;
+}
+
+static void visitObject(SnapshotWriter* writer, Object* object){
+    if(object == NULL || writer->failed || objectId(writer, object) != SNAPSHOT_NO_OBJECT){
+        return;
+    }
+
+    if(writer->count == SNAPSHOT_NO_OBJECT - 1 ||
+       (((size_t)writer->count + 1) * 2 > writer->mapCapacity && !growObjectMap(writer))){
+        snapshotError(writer->vm, "Out of memory while writing the snapshot.");
+        writer->failed = true;
+        return;
+    }
+
+    if(writer->count == writer->capacity){
+        uint32_t capacity = writer->capacity < 1024 ? 1024 : writer->capacity * 2;
+        Object** objects = (Object**)realloc(writer->objects, sizeof(Object*) * capacity);
+        if(objects == NULL){
+            snapshotError(writer->vm, "Out of memory while writing the snapshot.");
+            writer->failed = true;
+            return;
+        }
+        writer->objects = objects;
+        writer->capacity = capacity;
+    }
+
+    size_t index = objectSlot(writer->keys, writer->mapCapacity, object);
+    writer->keys[index] = object;
+    writer->ids[index] = writer->count;
+    writer->objects[writer->count++] = object;
+}
+
+static void visitValue(SnapshotWriter* writer, Value value){
+    if(IS_OBJECT(value)){
+        visitObject(writer, AS_OBJECT(value));
+    }
+}
+
+static void visitTable(SnapshotWriter* writer, HashTable* table){
+    for(int i = 0; i < table->capacity; i++){
+        Entry* entry = &table->entries[i];
+        if(!IS_EMPTY(entry->key)){
+            visitValue(writer, entry->key);
+            visitValue(writer, entry->value);
+        }
+    }
+}
+
+static void visitEnv(SnapshotWriter* writer, GlobalEnv* env){
+    for(size_t i = 0; i < env->names.capacity; i++){
+        visitObject(writer, (Object*)env->names.entries[i].name);
+    }
+    for(size_t i = 0; i < env->count; i++){
+        visitValue(writer, env->values[i]);
+    }
+}
+
+static void traceObject(SnapshotWriter* writer, Object* object){
+    switch(object->type){
+        case OBJECT_STRING:
+        case OBJECT_CFUNC:
+        case OBJECT_ROPE:   // written out as its string
+            break;
+        case OBJECT_LIST:{
+            ObjectList* list = (ObjectList*)object;
+            for(int i = 0; i < list->count; i++){
+                visitValue(writer, list->items[i]);
+            }
+            break;
+        }
+        case OBJECT_MAP:
+            visitTable(writer, &((ObjectMap*)object)->table);
+            break;
+        case OBJECT_FUNC:{
+            ObjectFunc* func = (ObjectFunc*)object;
+            visitObject(writer, (Object*)func->name);
+            visitObject(writer, (Object*)func->srcName);
+            visitObject(writer, (Object*)func->fieldOwner);
+            for(size_t i = 0; i < func->chunk.constants.count; i++){
+                visitValue(writer, func->chunk.constants.values[i]);
+            }
+            break;
+        }
+        case OBJECT_MODULE:{
+            ObjectModule* module = (ObjectModule*)object;
+            visitObject(writer, (Object*)module->name);
+            visitObject(writer, (Object*)module->path);
+            visitEnv(writer, &module->members);
+            break;
+        }
+        case OBJECT_CLOSURE:{
+            ObjectClosure* closure = (ObjectClosure*)object;
+            visitObject(writer, (Object*)closure->func);
+            for(int i = 0; i < closure->upvalueCnt; i++){
+                if(IS_FLAT_UPVALUE(closure->func, i)){
+                    visitValue(writer, closure->upvalues[i].value);
+                }else{
+                    visitObject(writer, (Object*)closure->upvalues[i].ref);
+                }
+            }
+            break;
+        }
+        case OBJECT_UPVALUE:{
+            ObjectUpvalue* upvalue = (ObjectUpvalue*)object;
+            if(upvalue->location != &upvalue->closed){
+                snapshotError(writer->vm, "Cannot save a snapshot while a variable is still captured on the stack.");
+                writer->failed = true;
+                break;
+            }
+            visitValue(writer, upvalue->closed);
+            break;
+        }
+        case OBJECT_CLASS:{
+            ObjectClass* klass = (ObjectClass*)object;
+            visitObject(writer, (Object*)klass->name);
+            visitTable(writer, &klass->methods);
+            visitTable(writer, &klass->fields);
+            break;
+        }
+        case OBJECT_INSTANCE:{
+            ObjectInstance* instance = (ObjectInstance*)object;
+            visitObject(writer, (Object*)instance->klass);
+            visitTable(writer, &instance->fields);
+            break;
+        }
+        case OBJECT_BOUND_METHOD:{
+            ObjectBoundMethod* bound = (ObjectBoundMethod*)object;
+            visitValue(writer, bound->receiver);
+            visitObject(writer, bound->method);
+            break;
+        }
+        case OBJECT_ITERATOR:
+            visitValue(writer, ((ObjectIterator*)object)->receiver);
+            break;
+        case OBJECT_FILE:
+            snapshotError(writer->vm, "Cannot save file objects in a snapshot.");
+            writer->failed = true;
+            break;
+    }
+}
+
+static void writeValue(SnapshotWriter* writer, Value value){
+    if(IS_NULL(value)){
+        writeU8(writer, SN_NULL);
+    }else if(IS_BOOL(value)){
+        writeU8(writer, AS_BOOL(value) ? SN_TRUE : SN_FALSE);
+    }else if(IS_NUM(value)){
+        writeU8(writer, SN_NUM);
+        writeU64(writer, (uint64_t)value);
+    }else if(IS_EMPTY(value)){
+        writeU8(writer, SN_EMPTY);
+    }else{
+        writeU8(writer, SN_OBJECT);
+        writeU32(writer, objectId(writer, AS_OBJECT(value)));
+    }
+}
+
+static void writeRef(SnapshotWriter* writer, Object* object){
+    writeU32(writer, objectId(writer, object));     // SNAPSHOT_NO_OBJECT for NULL
+}
+
+static void writeTable(SnapshotWriter* writer, HashTable* table){
+    uint32_t count = 0;
+    for(int i = 0; i < table->capacity; i++){
+        count += IS_EMPTY(table->entries[i].key) ? 0 : 1;
+    }
+
+    writeU32(writer, count);
+    for(int i = 0; i < table->capacity; i++){
+        Entry* entry = &table->entries[i];
+        if(!IS_EMPTY(entry->key)){
+            writeValue(writer, entry->key);
+            writeValue(writer, entry->value);
+        }
+    }
+}
+
+static void writeEnv(SnapshotWriter* writer, GlobalEnv* env){
+    ObjectString** names = env->count > 0 ? (ObjectString**)calloc(env->count, sizeof(ObjectString*)) : NULL;
+    if(env->count > 0 && names == NULL){
+        snapshotError(writer->vm, "Out of memory while writing the snapshot.");
+        writer->failed = true;
+        return;
+    }
+
+    for(size_t i = 0; i < env->names.capacity; i++){
+        GlobalNameEntry* entry = &env->names.entries[i];
+        if(entry->name != NULL && entry->slot < env->count){
+            names[entry->slot] = entry->name;
+        }
+    }
+
+    writeU32(writer, (uint32_t)env->count);
+    for(size_t i = 0; i < env->count; i++){
+        writeRef(writer, (Object*)names[i]);
+        writeValue(writer, env->values[i]);
+    }
+    free(names);
+}
+
+static ObjectModule* envOwner(SnapshotWriter* writer, GlobalEnv* env){
+    for(uint32_t i = 0; i < writer->count; i++){
+        Object* object = writer->objects[i];
+        if(object->type == OBJECT_MODULE && &((ObjectModule*)object)->members == env){
+            return (ObjectModule*)object;
+        }
+    }
+    return NULL;
+}
+
+static void writeCFunc(SnapshotWriter* writer, ObjectCFunc* cfunc){
+    char name[NATIVE_NAME_MAX];
+    if(nativeName(cfunc->func, name, sizeof(name))){
+        writeU8(writer, 0);
+        writeStr(writer, name, strlen(name));
+        return;
+    }
+
+    // a host function is found again by the global the host bound it to
+    ObjectString* global = globalNameOf(&writer->vm->globals, (Object*)cfunc);
+    if(global == NULL){
+        snapshotError(writer->vm, "Cannot save a native function that is not a registered global.");
+        writer->failed = true;
+        return;
+    }
+    writeU8(writer, 1);
+    writeStr(writer, global->chars, global->length);
+}
+
+static void writeObject(SnapshotWriter* writer, Object* object){
+    switch(object->type){
+        case OBJECT_STRING:{
+            ObjectString* string = (ObjectString*)object;
+            writeU8(writer, (uint8_t)(string->obj.isInterned ? STRING_INTERNED :
+                                      string->obj.internAsKey ? STRING_RAW_KEY : STRING_RAW));
+            writeStr(writer, string->chars, string->length);
+            break;
+        }
+        case OBJECT_LIST:{
+            ObjectList* list = (ObjectList*)object;
+            writeU32(writer, (uint32_t)list->count);
+            for(int i = 0; i < list->count; i++){
+                writeValue(writer, list->items[i]);
+            }
+            break;
+        }
+        case OBJECT_MAP:
+            writeTable(writer, &((ObjectMap*)object)->table);
+            break;
+        case OBJECT_FUNC:{
+            ObjectFunc* func = (ObjectFunc*)object;
+            writeU32(writer, (uint32_t)func->upvalueCnt);   // first, closures are sized by it
+            writeU64(writer, func->flatUpvalues);
+            writeU8(writer, (uint8_t)func->type);
+            writeU32(writer, (uint32_t)func->arity);
+            writeU32(writer, (uint32_t)func->maxRegSlots);
+            writeRef(writer, (Object*)func->name);
+            writeRef(writer, (Object*)func->srcName);
+            writeRef(writer, (Object*)func->fieldOwner);
+
+            writeU8(writer, func->lazySrc != NULL ? 1 : 0);
+            if(func->lazySrc != NULL){
+                writeU32(writer, (uint32_t)func->lazyLine);
+                writeStr(writer, func->lazySrc, (size_t)func->lazyLen);
+            }
+
+            writeU32(writer, (uint32_t)func->chunk.count);
+            for(size_t i = 0; i < func->chunk.count; i++){
+                writeU32(writer, func->chunk.code[i]);
+            }
+            writeU32(writer, (uint32_t)func->chunk.lineCount);
+            for(int i = 0; i < func->chunk.lineCount; i++){
+                writeU32(writer, (uint32_t)func->chunk.lines[i].offset);
+                writeU32(writer, (uint32_t)func->chunk.lines[i].line);
+            }
+
+            writeU32(writer, (uint32_t)func->chunk.constants.count);
+            for(size_t i = 0; i < func->chunk.constants.count; i++){
+                writeValue(writer, func->chunk.constants.values[i]);
+            }
+            break;
+        }
+        case OBJECT_CFUNC:
+            writeCFunc(writer, (ObjectCFunc*)object);
+            break;
+        case OBJECT_MODULE:{
+            ObjectModule* module = (ObjectModule*)object;
+            writeU8(writer, (uint8_t)module->kind);
+            writeU8(writer, (uint8_t)module->status);
+            writeRef(writer, (Object*)module->name);
+            writeRef(writer, (Object*)module->path);
+            writeEnv(writer, &module->members);
+            break;
+        }
+        case OBJECT_CLOSURE:{
+            ObjectClosure* closure = (ObjectClosure*)object;
+            writeRef(writer, (Object*)closure->func);
+
+            // the globals are the VM's own or those of a loaded module
+            ObjectModule* owner = NULL;
+            if(closure->globals != &writer->vm->globals){
+                owner = envOwner(writer, closure->globals);
+                if(owner == NULL){
+                    snapshotError(writer->vm, "Cannot save a function of a module that is not loaded.");
+                    writer->failed = true;
+                    break;
+                }
+            }
+            writeRef(writer, (Object*)owner);
+
+            writeU32(writer, (uint32_t)closure->upvalueCnt);
+            for(int i = 0; i < closure->upvalueCnt; i++){
+                if(IS_FLAT_UPVALUE(closure->func, i)){
+                    writeValue(writer, closure->upvalues[i].value);
+                }else{
+                    writeRef(writer, (Object*)closure->upvalues[i].ref);
+                }
+            }
+            break;
+        }
+        case OBJECT_UPVALUE:
+            writeValue(writer, ((ObjectUpvalue*)object)->closed);
+            break;
+        case OBJECT_CLASS:{
+            ObjectClass* klass = (ObjectClass*)object;
+            writeRef(writer, (Object*)klass->name);
+            writeTable(writer, &klass->methods);
+            writeTable(writer, &klass->fields);
+            break;
+        }
+        case OBJECT_INSTANCE:{
+            ObjectInstance* instance = (ObjectInstance*)object;
+            writeRef(writer, (Object*)instance->klass);
+            writeTable(writer, &instance->fields);
+            break;
+        }
+        case OBJECT_BOUND_METHOD:{
+            ObjectBoundMethod* bound = (ObjectBoundMethod*)object;
+            writeValue(writer, bound->receiver);
+            writeRef(writer, bound->method);
+            break;
+        }
+        case OBJECT_ITERATOR:{
+            ObjectIterator* iterator = (ObjectIterator*)object;
+            writeValue(writer, iterator->receiver);
+            writeU32(writer, (uint32_t)iterator->index);
+            break;
+        }
+        case OBJECT_FILE:
+            writer->failed = true;  // rejected while tracing
+            break;
+        case OBJECT_ROPE:{
+            ObjectRope* rope = (ObjectRope*)object;
+            writeU8(writer, STRING_RAW);
+            if(rope->flat != NULL){
+                writeStr(writer, rope->flat->chars, rope->flat->length);
+                break;
+            }
+
+            char* chars = (char*)malloc(rope->length);
+            if(chars == NULL){
+                snapshotError(writer->vm, "Out of memory while writing the snapshot.");
+                writer->failed = true;
+                break;
+            }
+            ropeCopy(rope, chars);
+            writeStr(writer, chars, rope->length);
+            free(chars);
+            break;
+        }
+    }
+}
+
+static void writeSnapshot(SnapshotWriter* writer){
+    VM* vm = writer->vm;
+
+    // modules first, closures look up the owner of their globals among them
+    visitTable(writer, &vm->modCache);
+    visitEnv(writer, &vm->globals);
+    for(uint32_t i = 0; i < writer->count && !writer->failed; i++){
+        traceObject(writer, writer->objects[i]);
+    }
+    if(writer->failed){
+        return;
+    }
+
+    writeBytes(writer, SNAPSHOT_MAGIC, 4);
+    uint8_t format[4] = {(uint8_t)SNAPSHOT_FORMAT, (uint8_t)(SNAPSHOT_FORMAT >> 8), 0, 0};
+    writeBytes(writer, format, sizeof(format));
+    writeStr(writer, CIETO_VERSION, strlen(CIETO_VERSION));
+
+    writeU32(writer, writer->count);
+    for(uint32_t i = 0; i < writer->count && !writer->failed; i++){
+        Object* object = writer->objects[i];
+        writeU8(writer, (uint8_t)(object->type == OBJECT_ROPE ? OBJECT_STRING : object->type));
+
+        size_t sizeAt = writer->out.count;
+        writeU32(writer, 0);
+        writeObject(writer, object);
+        if(writer->failed){
+            break;
+        }
+
+        uint32_t size = (uint32_t)(writer->out.count - sizeAt - 4);
+        for(int b = 0; b < 4; b++){
+            writer->out.data[sizeAt + b] = (uint8_t)(size >> (b * 8));
+        }
+    }
+
+    writeU8(writer, (uint8_t)vm->gcMode);
+    writeEnv(writer, &vm->globals);
+    writeTable(writer, &vm->modCache);
+}
+
+bool writeSnapshotFile(VM* vm, const char* path){
+    if(vm->frameCount != 0){
+        snapshotError(vm, "Cannot save a snapshot while code is running.");
+        return false;
+    }
+
+    SnapshotWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.vm = vm;
+    initBytecodeBuffer(&writer.out);
+
+    GCMode mode = vm->gcMode;
+    gcSetMode(vm, GC_MODE_OFF);
+
+    writeSnapshot(&writer);
+
+    gcSetMode(vm, mode);
+
+    bool ok = !writer.failed;
+    if(ok){
+        FILE* file = fopen(path, "wb");
+        ok = file != NULL && fwrite(writer.out.data, 1, writer.out.count, file) == writer.out.count;
+        if(file != NULL){
+            ok = fclose(file) == 0 && ok;
+        }
+        if(!ok){
+            snapshotError(vm, "Could not write snapshot file '%s'.", path);
+        }
+    }
+
+    freeBytecodeBuffer(&writer.out);
+    free(writer.objects);
+    free(writer.keys);
+    free(writer.ids);
+    return ok;
+}
+
+static const uint8_t* readBytes(SnapshotReader* reader, size_t len){
+    if(reader->failed || (size_t)(reader->end - reader->cur) < len){
+        reader->failed = true;
+        return NULL;
+    }
+    const uint8_t* bytes = reader->cur;
+    reader->cur += len;
+    return bytes;
+}
+
+static uint8_t readU8(SnapshotReader* reader){
+    const uint8_t* bytes = readBytes(reader, 1);
+    return bytes != NULL ? bytes[0] : 0;
+}
+
+static uint32_t readU32(SnapshotReader* reader){
+    const uint8_t* bytes = readBytes(reader, 4);
+    if(bytes == NULL){
+        return 0;
+    }
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+           ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint64_t readU64(SnapshotReader* reader){
+    const uint8_t* bytes = readBytes(reader, 8);
+    uint64_t value = 0;
+    for(int i = 0; bytes != NULL && i < 8; i++){
+        value |= (uint64_t)bytes[i] << (i * 8);
+    }
+    return value;
+}
+
+static const char* readStr(SnapshotReader* reader, uint32_t* len){
+    *len = readU32(reader);
+    const char* chars = (const char*)readBytes(reader, *len);
+    if(*len > INT32_MAX - 1){
+        reader->failed = true;
+    }
+    return chars;
+}
+
+static Object* readRef(SnapshotLoader* loader, SnapshotReader* reader, int type, bool optional){
+    // type -1 takes any object
+    uint32_t id = readU32(reader);
+    if(id == SNAPSHOT_NO_OBJECT && optional){
+        return NULL;
+    }
+    if(id >= loader->count || loader->objects[id] == NULL ||
+       (type >= 0 && loader->objects[id]->type != (ObjectType)type)){
+        reader->failed = true;
+        return NULL;
+    }
+    return loader->objects[id];
+}
+
+static Value readValue(SnapshotLoader* loader, SnapshotReader* reader){
+    switch(readU8(reader)){
+        case SN_NULL:   return NULL_VAL;
+        case SN_TRUE:   return BOOL_VAL(true);
+        case SN_FALSE:  return BOOL_VAL(false);
+        case SN_EMPTY:  return EMPTY_VAL;
+        case SN_NUM:{
+            Value num = (Value)readU64(reader);
+            if(!IS_NUM(num)){
+                reader->failed = true;  // other bit patterns would pose as objects
+                return NULL_VAL;
+            }
+            return num;
+        }
+        case SN_OBJECT:{
+            Object* object = readRef(loader, reader, -1, false);
+            return object != NULL ? OBJECT_VAL(object) : NULL_VAL;
+        }
+        default:
+            reader->failed = true;
+            return NULL_VAL;
+    }
+}
+
+static void readTable(SnapshotLoader* loader, SnapshotReader* reader, HashTable* table){
+    uint32_t count = readU32(reader);
+    if(reader->failed || count > (size_t)(reader->end - reader->cur) / 2){
+        reader->failed = true;  // every entry takes at least two bytes
+        return;
+    }
+    tableReserve(loader->vm, table, (int)count);
+
+    for(uint32_t i = 0; i < count && !reader->failed; i++){
+        Value key = readValue(loader, reader);
+        Value value = readValue(loader, reader);
+        if(IS_EMPTY(key)){
+            reader->failed = true;
+            break;
+        }
+        tableSet(loader->vm, table, key, value);
+    }
+}
+
+static void readEnv(SnapshotLoader* loader, SnapshotReader* reader, GlobalEnv* env){
+    uint32_t count = readU32(reader);
+    for(uint32_t i = 0; i < count && !reader->failed; i++){
+        ObjectString* name = (ObjectString*)readRef(loader, reader, OBJECT_STRING, false);
+        Value value = readValue(loader, reader);
+
+        // appended in slot order, so every slot keeps its number
+        uint32_t slot;
+        if(reader->failed || !globalEnsureSlot(loader->vm, env, name, &slot) || slot != i){
+            reader->failed = true;
+            break;
+        }
+        env->values[slot] = value;
+    }
+}
+
+static Object* createCFunc(SnapshotLoader* loader, SnapshotReader* reader){
+    VM* vm = loader->vm;
+    bool host = readU8(reader) != 0;
+    uint32_t len;
+    const char* name = readStr(reader, &len);
+    if(reader->failed){
+        return NULL;
+    }
+
+    if(host){
+        // unlinked until the host registers the function under this name again
+        return (Object*)newHostCFunc(vm, loader->hostAdapter, NULL, NULL);
+    }
+
+    CFunc func = nativeFunc(name, len);
+    if(func == NULL){
+        snapshotError(vm, "Snapshot refers to an unknown native function '%.*s'.", (int)len, name);
+        reader->failed = true;
+        return NULL;
+    }
+    return (Object*)newCFunc(vm, func);
+}
+
+static Object* createObject(SnapshotLoader* loader, uint32_t index){
+    VM* vm = loader->vm;
+    SnapshotReader reader = {vm, loader->bodies[index], loader->bodies[index] + loader->sizes[index], false};
+    Object* object = NULL;
+
+    switch(loader->types[index]){
+        case OBJECT_STRING:{
+            uint8_t kind = readU8(&reader);
+            uint32_t len;
+            const char* chars = readStr(&reader, &len);
+            if(reader.failed || reader.cur != reader.end || kind > STRING_RAW_KEY){
+                break;
+            }
+
+            // only strings that were interned go back into vm->strings
+            if(kind == STRING_INTERNED){
+                object = (Object*)copyString(vm, chars, (int)len);
+            }else{
+                ObjectString* string = copyStringRaw(vm, chars, (int)len);
+                string->obj.internAsKey = kind == STRING_RAW_KEY;
+                object = (Object*)string;
+            }
+            break;
+        }
+        case OBJECT_LIST:
+            object = (Object*)newList(vm);
+            break;
+        case OBJECT_MAP:
+            object = (Object*)newMap(vm);
+            break;
+        case OBJECT_FUNC:{
+            uint32_t upvalueCnt = readU32(&reader);
+            if(!reader.failed && upvalueCnt <= UINT16_MAX + 1){
+                ObjectFunc* func = newFunction(vm);
+                func->upvalueCnt = (int)upvalueCnt;
+                func->flatUpvalues = readU64(&reader);
+                object = (Object*)func;
+            }
+            break;
+        }
+        case OBJECT_CFUNC:
+            object = createCFunc(loader, &reader);
+            break;
+        case OBJECT_MODULE:{
+            uint8_t kind = readU8(&reader);
+            if(!reader.failed && kind <= MODULE_SCRIPT){
+                object = (Object*)newModule(vm, NULL, NULL, (ModuleKind)kind);
+            }
+            break;
+        }
+        case OBJECT_UPVALUE:{
+            ObjectUpvalue* upvalue = newUpvalue(vm, NULL);
+            upvalue->location = &upvalue->closed;
+            object = (Object*)upvalue;
+            break;
+        }
+        case OBJECT_CLASS:
+            object = (Object*)newClass(vm, NULL);
+            break;
+        case OBJECT_BOUND_METHOD:
+            object = (Object*)newBoundMethod(vm, NULL_VAL, NULL);
+            break;
+        case OBJECT_ITERATOR:
+            object = (Object*)newIterator(vm, NULL_VAL);
+            break;
+        default:
+            break;
+    }
+    return object;
+}
+
+static bool fillObject(SnapshotLoader* loader, uint32_t index){
+    VM* vm = loader->vm;
+    SnapshotReader reader = {vm, loader->bodies[index], loader->bodies[index] + loader->sizes[index], false};
+    Object* object = loader->objects[index];
+
+    switch(object->type){
+        case OBJECT_STRING:
+        case OBJECT_CFUNC:
+            return true;    // complete when created
+        case OBJECT_LIST:{
+            ObjectList* list = (ObjectList*)object;
+            uint32_t count = readU32(&reader);
+            for(uint32_t i = 0; i < count && !reader.failed; i++){
+                appendToList(vm, list, readValue(loader, &reader));
+            }
+            break;
+        }
+        case OBJECT_MAP:
+            readTable(loader, &reader, &((ObjectMap*)object)->table);
+            break;
+        case OBJECT_FUNC:{
+            ObjectFunc* func = (ObjectFunc*)object;
+            readU32(&reader);   // upvalueCnt and flatUpvalues, read when created
+            readU64(&reader);
+            uint8_t type = readU8(&reader);
+            if(type > TYPE_INITIALIZER){
+                return false;
+            }
+            func->type = (FuncType)type;
+            func->arity = (int)readU32(&reader);
+            func->maxRegSlots = (int)readU32(&reader);
+            func->name = (ObjectString*)readRef(loader, &reader, OBJECT_STRING, true);
+            func->srcName = (ObjectString*)readRef(loader, &reader, OBJECT_STRING, true);
+            func->fieldOwner = (ObjectClass*)readRef(loader, &reader, OBJECT_CLASS, true);
+
+            if(readU8(&reader) != 0){
+                func->lazyLine = (int)readU32(&reader);
+                uint32_t len;
+                const char* src = readStr(&reader, &len);
+                if(reader.failed){
+                    break;
+                }
+                func->lazySrc = GROW_ARRAY(vm, char, NULL, 0, len + 1);
+                memcpy(func->lazySrc, src, len);
+                func->lazySrc[len] = '\0';
+                func->lazyLen = (int)len;
+            }
+
+            uint32_t codeCnt = readU32(&reader);
+            const uint8_t* code = readBytes(&reader, (size_t)codeCnt * sizeof(uint32_t));
+            uint32_t lineCnt = readU32(&reader);
+            const uint8_t* lines = readBytes(&reader, (size_t)lineCnt * 2 * sizeof(uint32_t));
+            if(reader.failed || (codeCnt == 0 && func->lazySrc == NULL) ||
+               (lineCnt == 0) != (codeCnt == 0) || lineCnt > codeCnt){
+                reader.failed = true;
+                break;
+            }
+
+            // sized exactly, as shrinkChunk() leaves a compiled chunk
+            Chunk* chunk = &func->chunk;
+            if(codeCnt > 0){
+                chunk->code = GROW_ARRAY(vm, Instruction, NULL, 0, codeCnt);
+                chunk->lines = GROW_ARRAY(vm, LineStart, NULL, 0, lineCnt);
+                chunk->count = codeCnt;
+                chunk->capacity = codeCnt;
+                chunk->lineCapacity = (int)lineCnt;
+
+                SnapshotReader block = {vm, code, code + (size_t)codeCnt * sizeof(uint32_t), false};
+                for(uint32_t i = 0; i < codeCnt; i++){
+                    chunk->code[i] = readU32(&block);
+                }
+
+                // runs start at 0 and strictly increase, or getLine() could not search them
+                block = (SnapshotReader){vm, lines, lines + (size_t)lineCnt * 2 * sizeof(uint32_t), false};
+                for(uint32_t i = 0; i < lineCnt; i++){
+                    uint32_t offset = readU32(&block);
+                    uint32_t line = readU32(&block);
+                    if(offset >= codeCnt || line > INT32_MAX ||
+                       (i == 0 ? offset != 0 : offset <= (uint32_t)chunk->lines[i - 1].offset)){
+                        reader.failed = true;
+                        break;
+                    }
+                    chunk->lines[i].offset = (int)offset;
+                    chunk->lines[i].line = (int)line;
+                    chunk->lineCount++;
+                }
+            }
+
+            uint32_t constCnt = readU32(&reader);
+            for(uint32_t i = 0; i < constCnt && !reader.failed; i++){
+                writeValueArray(vm, &chunk->constants, readValue(loader, &reader));
+            }
+            break;
+        }
+        case OBJECT_MODULE:{
+            ObjectModule* module = (ObjectModule*)object;
+            readU8(&reader);    // kind, read when created
+            uint8_t status = readU8(&reader);
+            if(status > MODULE_ERROR){
+                return false;
+            }
+            module->status = (ModuleStatus)status;
+            module->name = (ObjectString*)readRef(loader, &reader, OBJECT_STRING, true);
+            module->path = (ObjectString*)readRef(loader, &reader, OBJECT_STRING, true);
+            readEnv(loader, &reader, &module->members);
+            break;
+        }
+        case OBJECT_CLOSURE:{
+            ObjectClosure* closure = (ObjectClosure*)object;
+            readU32(&reader);   // func, read when created
+            ObjectModule* owner = (ObjectModule*)readRef(loader, &reader, OBJECT_MODULE, true);
+            closure->globals = owner != NULL ? &owner->members : &vm->globals;
+
+            if(readU32(&reader) != (uint32_t)closure->upvalueCnt){
+                reader.failed = true;
+                break;
+            }
+            for(int i = 0; i < closure->upvalueCnt && !reader.failed; i++){
+                if(IS_FLAT_UPVALUE(closure->func, i)){
+                    closure->upvalues[i].value = readValue(loader, &reader);
+                }else{
+                    closure->upvalues[i].ref = (ObjectUpvalue*)readRef(loader, &reader, OBJECT_UPVALUE, true);
+                }
+            }
+            break;
+        }
+        case OBJECT_UPVALUE:
+            ((ObjectUpvalue*)object)->closed = readValue(loader, &reader);
+            break;
+        case OBJECT_CLASS:{
+            ObjectClass* klass = (ObjectClass*)object;
+            klass->name = (ObjectString*)readRef(loader, &reader, OBJECT_STRING, true);
+            readTable(loader, &reader, &klass->methods);
+            readTable(loader, &reader, &klass->fields);
+            break;
+        }
+        case OBJECT_INSTANCE:{
+            ObjectInstance* instance = (ObjectInstance*)object;
+            instance->klass = (ObjectClass*)readRef(loader, &reader, OBJECT_CLASS, false);
+            readTable(loader, &reader, &instance->fields);
+            break;
+        }
+        case OBJECT_BOUND_METHOD:{
+            ObjectBoundMethod* bound = (ObjectBoundMethod*)object;
+            bound->receiver = readValue(loader, &reader);
+            bound->method = readRef(loader, &reader, -1, false);
+            if(bound->method != NULL && bound->method->type != OBJECT_CLOSURE &&
+               bound->method->type != OBJECT_CFUNC){
+                reader.failed = true;
+            }
+            break;
+        }
+        case OBJECT_ITERATOR:{
+            ObjectIterator* iterator = (ObjectIterator*)object;
+            iterator->receiver = readValue(loader, &reader);
+            iterator->index = (int)readU32(&reader);
+            break;
+        }
+        default:
+            return false;
+    }
+    return !reader.failed && reader.cur == reader.end;
+}
+
+static bool readObjects(SnapshotLoader* loader, SnapshotReader* reader){
+    VM* vm = loader->vm;
+    uint32_t count = readU32(reader);
+    if(reader->failed || count > (size_t)(reader->end - reader->cur) / 5){
+        return false;   // every record takes at least five bytes
+    }
+
+    loader->count = count;
+    loader->objects = (Object**)calloc(count + 1, sizeof(Object*));
+    loader->types = (uint8_t*)malloc(count + 1);
+    loader->bodies = (const uint8_t**)malloc(sizeof(uint8_t*) * (count + 1));
+    loader->sizes = (uint32_t*)malloc(sizeof(uint32_t) * (count + 1));
+    if(loader->objects == NULL || loader->types == NULL || loader->bodies == NULL || loader->sizes == NULL){
+        return false;
+    }
+
+    for(uint32_t i = 0; i < count; i++){
+        loader->types[i] = readU8(reader);
+        loader->sizes[i] = readU32(reader);
+        loader->bodies[i] = readBytes(reader, loader->sizes[i]);
+    }
+    if(reader->failed){
+        return false;
+    }
+
+    // closures are sized by their function and instances wait for their class,
+    // so those two are created after everything else
+    ObjectClass* placeholder = NULL;
+    for(int round = 0; round < 2; round++){
+        for(uint32_t i = 0; i < count; i++){
+            bool late = loader->types[i] == OBJECT_CLOSURE || loader->types[i] == OBJECT_INSTANCE;
+            if(late != (round == 1)){
+                continue;
+            }
+
+            if(loader->types[i] == OBJECT_CLOSURE){
+                SnapshotReader body = {vm, loader->bodies[i], loader->bodies[i] + loader->sizes[i], false};
+                ObjectFunc* func = (ObjectFunc*)readRef(loader, &body, OBJECT_FUNC, false);
+                loader->objects[i] = func != NULL ? (Object*)newClosure(vm, func, &vm->globals) : NULL;
+            }else if(loader->types[i] == OBJECT_INSTANCE){
+                if(placeholder == NULL){
+                    placeholder = newClass(vm, NULL);
+                }
+                loader->objects[i] = (Object*)newInstance(vm, placeholder);
+            }else{
+                loader->objects[i] = createObject(loader, i);
+            }
+
+            if(loader->objects[i] == NULL){
+                return false;
+            }
+        }
+    }
+
+    for(uint32_t i = 0; i < count; i++){
+        if(!fillObject(loader, i)){
+            return false;
+        }
+    }
+
+    // code is checked once its constants are all linked
+    for(uint32_t i = 0; i < count; i++){
+        if(loader->types[i] == OBJECT_FUNC && !verifyFunc((ObjectFunc*)loader->objects[i])){
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool readSnapshot(SnapshotLoader* loader, const uint8_t* data, size_t size){
+    VM* vm = loader->vm;
+    SnapshotReader reader = {vm, data, data + size, false};
+
+    const uint8_t* magic = readBytes(&reader, 4);
+    const uint8_t* format = readBytes(&reader, 4);
+    uint32_t versionLen;
+    const char* version = readStr(&reader, &versionLen);
+    if(reader.failed || memcmp(magic, SNAPSHOT_MAGIC, 4) != 0 ||
+       format[0] != (uint8_t)SNAPSHOT_FORMAT || format[1] != (uint8_t)(SNAPSHOT_FORMAT >> 8) ||
+       versionLen != strlen(CIETO_VERSION) || memcmp(version, CIETO_VERSION, versionLen) != 0){
+        return false;   // the instruction set is only stable within a release
+    }
+
+    if(!readObjects(loader, &reader)){
+        return false;
+    }
+
+    uint8_t mode = readU8(&reader);
+
+    // the snapshot's globals, prelude included, replace any the VM has
+    freeGlobalEnv(vm, &vm->globals);
+    readEnv(loader, &reader, &vm->globals);
+    readTable(loader, &reader, &vm->modCache);
+
+    if(reader.failed || reader.cur != reader.end || mode > GC_MODE_OFF){
+        return false;
+    }
+    gcSetMode(vm, (GCMode)mode);
+    return true;
+}
+
+bool loadSnapshotFile(VM* vm, const char* path, CFunc hostAdapter){
+    BytecodeImage image;
+    if(!mapBytecodeFile(path, &image)){
+        snapshotError(vm, "Could not read snapshot file '%s'.", path);
+        return false;
+    }
+
+    SnapshotLoader loader;
+    memset(&loader, 0, sizeof(loader));
+    loader.vm = vm;
+    loader.hostAdapter = hostAdapter;
+
+    // nothing is rooted while the heap is rebuilt
+    GCMode mode = vm->gcMode;
+    gcSetMode(vm, GC_MODE_OFF);
+    vm->lastError[0] = '\0';
+
+    bool ok = readSnapshot(&loader, image.data, image.size);
+    if(!ok){
+        gcSetMode(vm, mode);
+        if(vm->lastError[0] == '\0'){
+            snapshotError(vm, "'%s' is not a snapshot of this Cieto release, or it is damaged.", path);
+        }
+    }
+
+    unmapBytecodeFile(&image);
+    free(loader.objects);
+    free(loader.types);
+    free(loader.bodies);
+    free(loader.sizes);
+    return ok;
+}
@@ -0,0 +1,33 @@
+#ifndef CIETO_SNAPSHOT_H
+#define CIETO_SNAPSHOT_H
+
+#include "vm.h"
+
+/*
+ * The heap of an idle VM, restorable without running any script:
+ *
+ * | magic "CSNP" | u16 format | u16 0 | str version |
+ * | u32 n | n * (u8 type, u32 size, body) |   every reachable object
+ * | u8 gc mode | env globals | u32 m | m * (value key, value module) |
+ *
+ * Objects refer to each other by their u32 index in the file, so shared
+ * and cyclic structures come back as they were. An env is its slots in
+ * order, each a u32 name index and a value, so compiled code keeps its
+ * global slot numbers. A string records whether it was interned, raw
+ * ones like concatenation results stay out of vm->strings on load.
+ * Native functions are stored by name, "iter" or "fs.read", and
+ * re-linked on load. Host functions are stored by the global they are
+ * bound to and come back unlinked, calling them fails until the host
+ * registers them again.
+ *
+ * Like .pco files, a snapshot only loads in the release that wrote it.
+*/
+
+#define SNAPSHOT_MAGIC      "CSNP"
+#define SNAPSHOT_FORMAT     5
+
+// fail with a message in vm->lastError
+bool writeSnapshotFile(VM* vm, const char* path);
+bool loadSnapshotFile(VM* vm, const char* path, CFunc hostAdapter);
+
+#endif // CIETO_SNAPSHOT_H
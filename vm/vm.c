@@ -1,3 +1,4 @@
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -11,6 +12,8 @@
 #include "mem.h"
 #include "registry.h"
 #include "module_loader.h"
+#include "import_prefetch.h"
+#include "bundle.h"
 #include "gc_policy.h"
 
 #include "methods/list.h"
@@ -18,6 +21,8 @@
 
 #include "modules/fs.h"
 
+#include "xxhash.h"
+
 #ifdef DEBUG_TRACE
 #include "debug.h"
 #endif
@@ -109,19 +114,45 @@ void recover(VM* vm){
     vm->curGlobal = &vm->globals;
     vm->globalStack[0] = vm->curGlobal;
     vm->hadRuntimeError = false;
+    vm->nativeDepth = 0;
+}
+
+/*
+ * rand() is shared by the whole process, so only the first VM seeds it
+ * and draws its hash seed from it. Later VMs, like the import prefetch
+ * workers on their own threads, leave it alone, or they would reseed
+ * the sequence random() is reading in the main VM.
+*/
+static atomic_flag randSeeded = ATOMIC_FLAG_INIT;
+
+static uint64_t newHashSeed(VM* vm){
+    uint64_t seed;
+    if(!atomic_flag_test_and_set(&randSeeded)){
+        srand((unsigned int)time(NULL));
+        uint64_t p1 = (uint64_t)rand();
+        uint64_t p2 = (uint64_t)rand();
+        seed = (p1 << 32) | p2;
+    }else{
+        seed = XXH3_64bits_withSeed(&vm, sizeof(vm), (uint64_t)time(NULL));
+    }
+    return seed == 0 ? 1 : seed;
 }
 
 void initVM(VM* vm, int argc, const char* argv[]){
+    initBareVM(vm, argc, argv);
+    registerPrelude(vm, &vm->globals);
+}
+
+void initBareVM(VM* vm, int argc, const char* argv[]){
     resetStack(vm);
     vm->objects = NULL;
+    memset(vm->charStrings, 0, sizeof(vm->charStrings));
+    memset(vm->intStrings, 0, sizeof(vm->intStrings));
     vm->openUpvalues = NULL;
     vm->frameCount = 0;
+    vm->nativeDepth = 0;
 
-    srand((unsigned int)time(NULL));
-    uint64_t p1 = (uint64_t)rand();
-    uint64_t p2 = (uint64_t)rand();
-    vm->hash_seed = (p1 << 32) | p2;
-    if(vm->hash_seed == 0) vm->hash_seed = 1;
+    vm->hash_seed = newHashSeed(vm);
 
     initHashTable(&vm->strings);
     initGlobalEnv(&vm->globals);
@@ -145,10 +176,22 @@ void initVM(VM* vm, int argc, const char* argv[]){
     vm->initString = NULL;
     vm->initString = copyString(vm, "init", 4);
 
+    for(int c = 0; c < 256; c++){
+        char chars[1] = {(char)c};
+        vm->charStrings[c] = copyString(vm, chars, 1);
+    }
+
     vm->argc = argc;
     vm->argv = argv;
 
     vm->hadRuntimeError = false;
+    vm->eagerCompile = false;
+    vm->quietCompile = false;
+    memset(&vm->importStats, 0, sizeof(ImportStats));
+    vm->importPrefetch = true;
+    vm->prefetch = NULL;
+    vm->bundle = NULL;
+    vm->cacheDir = NULL;
 
     /*
      * initVM() is also used directly by the CLI. The embedding API overrides this after initialization.
@@ -161,15 +204,20 @@ void initVM(VM* vm, int argc, const char* argv[]){
     vm->output.userData = NULL;
     vm->errOutput.write = defaultEWrite;
     vm->errOutput.userData = NULL;
-
-    registerPrelude(vm);
 }
 
 void freeVM(VM* vm){
+    stopImportPrefetch(vm);
+
     freeHashTable(vm, &vm->strings);
     freeGlobalEnv(vm, &vm->globals);
     freeHashTable(vm, &vm->modCache);
 
+    free(vm->cacheDir);
+    vm->cacheDir = NULL;
+    freeImportStats(&vm->importStats);
+    closeBundle(vm);
+
     vm->globalCnt = 0;
     vm->curGlobal = NULL;
     vm->openUpvalues = NULL;
@@ -223,6 +271,14 @@ static bool isTruthy(Value value){
     // NULL is considered falsy
 }
 
+// a rope leaving the registers becomes its string, see ObjectRope
+static inline Value flattenSlot(VM* vm, Value* slot){
+    if(IS_ROPE(*slot)){
+        *slot = OBJECT_VAL(flattenRope(vm, AS_ROPE(*slot)));
+    }
+    return *slot;
+}
+
 static bool isValidKey(Value key){
     if(IS_NUM(key)){
         double n = AS_NUM(key);
@@ -267,7 +323,6 @@ static void closeUpvalues(VM* vm, Value* last){
 InterpreterStatus interpret(VM* vm, const char* code, const char* srcName){
     vm->lastError[0] = '\0';
 
-    Value* stackBase = vm->stackTop;
     ObjectFunc* func = compile(vm, code, srcName);
 
     if(func == NULL){
@@ -275,6 +330,12 @@ InterpreterStatus interpret(VM* vm, const char* code, const char* srcName){
         return VM_COMPILE_ERROR;
     }
 
+    return interpretFunc(vm, func);
+}
+
+InterpreterStatus interpretFunc(VM* vm, ObjectFunc* func){
+    Value* stackBase = vm->stackTop;
+
     push(vm, OBJECT_VAL(func));
 
     ObjectClosure* closure = newClosure(vm, func, vm->curGlobal);
@@ -397,10 +458,26 @@ static Value bindStringFunc(VM* vm, Value receiver, ObjectString* name){
             func = string_lower;
         }else if(memcmp(name->chars, "split", 5) == 0){
             func = string_split;
+        }else if(memcmp(name->chars, "count", 5) == 0){
+            func = string_count;
         }
     }else if(name->length == 7){
         if(memcmp(name->chars, "replace", 7) == 0){
             func = string_replace;
+        }else if(memcmp(name->chars, "isDigit", 7) == 0){
+            func = string_isDigit;
+        }else if(memcmp(name->chars, "isAlpha", 7) == 0){
+            func = string_isAlpha;
+        }else if(memcmp(name->chars, "isSpace", 7) == 0){
+            func = string_isSpace;
+        }
+    }else if(name->length == 8){
+        if(memcmp(name->chars, "endsWith", 8) == 0){
+            func = string_endsWith;
+        }
+    }else if(name->length == 10){
+        if(memcmp(name->chars, "startsWith", 10) == 0){
+            func = string_startsWith;
         }
     }
 
@@ -429,6 +506,7 @@ static InterpreterStatus run(VM* vm){
         [OP_SET_GLOBAL]     = &&DO_OP_SET_GLOBAL,
         [OP_GET_UPVAL]      = &&DO_OP_GET_UPVAL,
         [OP_SET_UPVAL]      = &&DO_OP_SET_UPVAL,
+        [OP_GET_UPVAL_FLAT] = &&DO_OP_GET_UPVAL_FLAT,
 
         [OP_GET_INDEX]      = &&DO_OP_GET_INDEX,
         [OP_SET_INDEX]      = &&DO_OP_SET_INDEX,
@@ -440,16 +518,22 @@ static InterpreterStatus run(VM* vm){
         [OP_MUL]            = &&DO_OP_MUL,
         [OP_DIV]            = &&DO_OP_DIV,
         [OP_MOD]            = &&DO_OP_MOD,
+        [OP_ADD_NN]         = &&DO_OP_ADD_NN,
+        [OP_SUB_NN]         = &&DO_OP_SUB_NN,
+        [OP_MUL_NN]         = &&DO_OP_MUL_NN,
         [OP_NEG]            = &&DO_OP_NEG,
         [OP_NOT]            = &&DO_OP_NOT,
 
         [OP_EQ]             = &&DO_OP_EQ,
         [OP_LT]             = &&DO_OP_LT,
         [OP_LE]             = &&DO_OP_LE,
+        [OP_LT_NN]          = &&DO_OP_LT_NN,
+        [OP_LE_NN]          = &&DO_OP_LE_NN,
 
         [OP_JMP]            = &&DO_OP_JMP,
         [OP_JMP_IF_FALSE]   = &&DO_OP_JMP_IF_FALSE,
         [OP_JMP_IF_TRUE]    = &&DO_OP_JMP_IF_TRUE,
+        [OP_SWITCH]         = &&DO_OP_SWITCH,
         [OP_RETURN]         = &&DO_OP_RETURN,
 
         [OP_CLOSURE]        = &&DO_OP_CLOSURE,
@@ -465,14 +549,17 @@ static InterpreterStatus run(VM* vm){
         [OP_SYSTEM]         = &&DO_OP_SYSTEM,
 
         [OP_TO_STRING]      = &&DO_OP_TO_STRING,
+        [OP_CONCAT]         = &&DO_OP_CONCAT,
 
         [OP_CALL]           = &&DO_OP_CALL,
 
         [OP_IMPORT]         = &&DO_OP_IMPORT,
+        [OP_GET_MODULE]     = &&DO_OP_GET_MODULE,
 
         [OP_BUILD_LIST]     = &&DO_OP_BUILD_LIST,
         [OP_INIT_LIST]      = &&DO_OP_INIT_LIST,
         [OP_FILL_LIST]      = &&DO_OP_FILL_LIST,
+        [OP_CLONE_K]        = &&DO_OP_CLONE_K,
         [OP_BUILD_MAP]      = &&DO_OP_BUILD_MAP,
         [OP_SLICE]          = &&DO_OP_SLICE,
 
@@ -506,6 +593,23 @@ static InterpreterStatus run(VM* vm){
             R(GET_ARG_A(instruction)) = type(AS_NUM(b) op AS_NUM(c)); \
         } while(false)
 
+    // compiler proved both operands are numbers, see emitNumOp()
+    #define NUM_OP(op) \
+        do { \
+            double b = AS_NUM(R(GET_ARG_B(instruction))); \
+            double c = AS_NUM(R(GET_ARG_C(instruction))); \
+            R(GET_ARG_A(instruction)) = NUM_VAL(b op c); \
+        } while(false)
+
+    #define NUM_CMP(op) \
+        do { \
+            double b = AS_NUM(R(GET_ARG_B(instruction))); \
+            double c = AS_NUM(R(GET_ARG_C(instruction))); \
+            if((b op c) != GET_ARG_A(instruction)){ \
+                frame->ip++; \
+            } \
+        } while(false)
+
     DISPATCH();
 
     DO_OP_MOVE:
@@ -559,18 +663,23 @@ static InterpreterStatus run(VM* vm){
 
     DO_OP_GET_UPVAL:
     {
-        R(GET_ARG_A(instruction)) = *frame->closure->upvalues[GET_ARG_B(instruction)]->location;
+        R(GET_ARG_A(instruction)) = *frame->closure->upvalues[GET_ARG_B(instruction)].ref->location;
     } DISPATCH();
 
     DO_OP_SET_UPVAL:
     {
-        *frame->closure->upvalues[GET_ARG_B(instruction)]->location = R(GET_ARG_A(instruction));
+        *frame->closure->upvalues[GET_ARG_B(instruction)].ref->location = R(GET_ARG_A(instruction));
+    } DISPATCH();
+
+    DO_OP_GET_UPVAL_FLAT:
+    {
+        R(GET_ARG_A(instruction)) = frame->closure->upvalues[GET_ARG_B(instruction)].value;
     } DISPATCH();
 
     DO_OP_GET_INDEX:
     {
-        Value val = R(GET_ARG_B(instruction));
-        Value key = R(GET_ARG_C(instruction));
+        Value val = flattenSlot(vm, &R(GET_ARG_B(instruction)));
+        Value key = flattenSlot(vm, &R(GET_ARG_C(instruction)));
         Value result = NULL_VAL;
 
         if(IS_LIST(val)){
@@ -616,9 +725,7 @@ static InterpreterStatus run(VM* vm){
                 runtimeError(vm, "String index out of range.");
                 return VM_RUNTIME_ERROR;
             }
-            char chars[2] = {str->chars[index], '\0'};
-            ObjectString* charStr = copyStringRaw(vm, chars, 1);
-            result = OBJECT_VAL(charStr);
+            result = OBJECT_VAL(vm->charStrings[(uint8_t)str->chars[index]]);
         }else{
             runtimeError(vm, "Only list and map type support indexing.");
             return VM_RUNTIME_ERROR;
@@ -630,8 +737,8 @@ static InterpreterStatus run(VM* vm){
     DO_OP_SET_INDEX:
     {
         Value cont = R(GET_ARG_A(instruction));
-        Value key = R(GET_ARG_B(instruction));
-        Value newVal = R(GET_ARG_C(instruction));
+        Value key = flattenSlot(vm, &R(GET_ARG_B(instruction)));
+        Value newVal = flattenSlot(vm, &R(GET_ARG_C(instruction)));
 
         if(IS_LIST(cont)){
             if(!IS_NUM(key)){
@@ -657,7 +764,15 @@ static InterpreterStatus run(VM* vm){
                 return VM_RUNTIME_ERROR;
             }
 
-            tableSet(vm, &map->table, key, newVal);
+            if(IS_STRING(key) && AS_STRING(key)->obj.internAsKey){
+                // keys read from files come in raw, intern them on first use
+                key = OBJECT_VAL(internString(vm, AS_STRING(key)));
+                push(vm, key);
+                tableSet(vm, &map->table, key, newVal);
+                pop(vm);
+            }else{
+                tableSet(vm, &map->table, key, newVal);
+            }
         }else{
             runtimeError(vm, "Only map type support key-value assignment.");
             return VM_RUNTIME_ERROR;
@@ -666,7 +781,7 @@ static InterpreterStatus run(VM* vm){
 
     DO_OP_GET_PROPERTY:
     {
-        Value instanceVal = R(GET_ARG_B(instruction));
+        Value instanceVal = flattenSlot(vm, &R(GET_ARG_B(instruction)));
         Value keyVal = R(GET_ARG_C(instruction));
         if(!IS_STRING(keyVal)){
             runtimeError(vm, "Property name must be a string.");
@@ -732,7 +847,7 @@ static InterpreterStatus run(VM* vm){
             return VM_RUNTIME_ERROR;
         }
         ObjectString* key = AS_STRING(keyVal);
-        Value newVal = R(GET_ARG_C(instruction));
+        Value newVal = flattenSlot(vm, &R(GET_ARG_C(instruction)));
 
         if(IS_INSTANCE(instanceVal)){
             ObjectInstance* instance = AS_INSTANCE(instanceVal);
@@ -758,7 +873,7 @@ static InterpreterStatus run(VM* vm){
     {
         int a = GET_ARG_A(instruction);
         int b = GET_ARG_B(instruction);
-        Value val = R(b);
+        Value val = flattenSlot(vm, &R(b));
 
         if(IS_STRING(val)){
             R(a) = val;
@@ -768,6 +883,21 @@ static InterpreterStatus run(VM* vm){
         }
     } DISPATCH();
 
+    DO_OP_CONCAT:
+    {
+        int b = GET_ARG_B(instruction);
+        int cnt = GET_ARG_C(instruction);
+
+        // the converted parts stay in their registers, which keeps them rooted
+        for(int i = 0; i < cnt; i++){
+            if(!IS_STRING(R(b + i))){
+                R(b + i) = OBJECT_VAL(toString(vm, R(b + i)));
+            }
+        }
+
+        R(GET_ARG_A(instruction)) = OBJECT_VAL(concatStringsRaw(vm, &R(b), cnt));
+    } DISPATCH();
+
     DO_OP_NOT: {
         Value b = R(GET_ARG_B(instruction));
         R(GET_ARG_A(instruction)) = BOOL_VAL(!isTruthy(b));
@@ -778,6 +908,10 @@ static InterpreterStatus run(VM* vm){
         Value b = R(GET_ARG_B(instruction));
         Value c = R(GET_ARG_C(instruction));
         int a = GET_ARG_A(instruction);
+        if((IS_ROPE(b) || IS_ROPE(c)) && b != c){
+            b = flattenSlot(vm, &R(GET_ARG_B(instruction)));
+            c = flattenSlot(vm, &R(GET_ARG_C(instruction)));
+        }
         if(isEqual(b, c) != a){
             frame->ip++;
         }
@@ -815,6 +949,10 @@ static InterpreterStatus run(VM* vm){
         }
     } DISPATCH();
 
+    DO_OP_LT_NN: NUM_CMP(<); DISPATCH();
+
+    DO_OP_LE_NN: NUM_CMP(<=); DISPATCH();
+
     DO_OP_ADD: 
     {
         Value b = R(GET_ARG_B(instruction));
@@ -823,32 +961,23 @@ static InterpreterStatus run(VM* vm){
         if(IS_NUM(b) && IS_NUM(c)){
             double result = AS_NUM(b) + AS_NUM(c);
             R(GET_ARG_A(instruction)) = NUM_VAL(result);
-        }else if(IS_STRING(b) || IS_STRING(c)){
+        }else if(IS_STRING(b) || IS_STRING(c) || IS_ROPE(b) || IS_ROPE(c)){
             push(vm, b);
             push(vm, c);
 
-            ObjectString* bStr = IS_STRING(b) ? AS_STRING(b) : toString(vm, b);
-            vm->stackTop[-2] = OBJECT_VAL(bStr);
+            // long results become ropes, so s = s + piece in a loop stays linear
+            Object* left = IS_STRING(b) || IS_ROPE(b) ? AS_OBJECT(b) : (Object*)toString(vm, b);
+            vm->stackTop[-2] = OBJECT_VAL(left);
 
-            ObjectString* cStr = IS_STRING(c) ? AS_STRING(c) : toString(vm, c);
-            vm->stackTop[-1] = OBJECT_VAL(cStr);
+            Object* right = IS_STRING(c) || IS_ROPE(c) ? AS_OBJECT(c) : (Object*)toString(vm, c);
+            vm->stackTop[-1] = OBJECT_VAL(right);
 
-            size_t len = bStr->length + cStr->length;
-            char* chars = (char*)reallocate(vm, NULL, 0, len + 1);  // add 1 for '\0'
-            if(chars == NULL){
-                runtimeError(vm, "Memory allocation failed for string concatenation.");
-                return VM_RUNTIME_ERROR;
-            }
-            memcpy(chars, bStr->chars, bStr->length);
-            memcpy(chars + bStr->length, cStr->chars, cStr->length);
-            chars[len] = '\0';
-
-            ObjectString* reStr = takeStringRaw(vm, chars, (int)len);
+            Object* result = concatStringParts(vm, left, right);
 
             pop(vm);
             pop(vm);
 
-            R(GET_ARG_A(instruction)) = OBJECT_VAL(reStr);
+            R(GET_ARG_A(instruction)) = OBJECT_VAL(result);
         }else{
             runtimeError(vm, "Operands must be two numbers or two strings.");
             return VM_RUNTIME_ERROR;
@@ -859,6 +988,12 @@ static InterpreterStatus run(VM* vm){
 
     DO_OP_MUL: BI_OP(NUM_VAL, *); DISPATCH();
 
+    DO_OP_ADD_NN: NUM_OP(+); DISPATCH();
+
+    DO_OP_SUB_NN: NUM_OP(-); DISPATCH();
+
+    DO_OP_MUL_NN: NUM_OP(*); DISPATCH();
+
     DO_OP_DIV:
     {
         Value b = R(GET_ARG_B(instruction));
@@ -871,92 +1006,15 @@ static InterpreterStatus run(VM* vm){
                 return VM_RUNTIME_ERROR;
             }
             R(GET_ARG_A(instruction)) = NUM_VAL(AS_NUM(b) / v);
-        }else if(IS_STRING(b) && IS_STRING(c)){
-            ObjectString* aStr = AS_STRING(b);
-            ObjectString* bStr = AS_STRING(c);
-
-            #ifdef _WIN32
-                #define PATH_SEP '\\'
-                #define IS_SEP(c) ((c) == '\\' || (c) == '/')
-            #else
-                #define PATH_SEP '/'
-                #define IS_SEP(c) ((c) == '/')
-            #endif
-
-            ObjectString* checkList[2] = {aStr, bStr};
-            for(int j = 0; j < 2; j++){
-                ObjectString* str = checkList[j];
-                for(int i = 0; i < str->length; i++){
-                    char c = str->chars[i];
-                    bool invalid = false;
-                    if(c < 32) invalid = true;
-                    switch(c){
-                        case '<': case '>': case '*': case '"': 
-                        case '|': case '?': invalid = true; break;
-                        case ':': 
-                            #ifdef _WIN32
-                            if (!(i == 1 && ((str->chars[0] >= 'a' && str->chars[0] <= 'z') || 
-                                             (str->chars[0] >= 'A' && str->chars[0] <= 'Z')))) {
-                                invalid = true;
-                            }
-                            #else
-                            #endif
-                            break;
-                    }
-                    if(invalid){
-                        runtimeError(vm, "Path contains invalid characters.");
-                        return VM_RUNTIME_ERROR;
-                    }
-                }
-            }
-
-            bool resetPath = false;
-            #ifdef _WIN32
-                if(bStr->length >= 2 && bStr->chars[1] == ':' && 
-                   ((bStr->chars[0] >= 'a' && bStr->chars[0] <= 'z') || 
-                    (bStr->chars[0] >= 'A' && bStr->chars[0] <= 'Z')
-                )){
-                    resetPath = true;
-                }
-                if(bStr->length > 0 && IS_SEP(bStr->chars[0])) resetPath = true; 
-            #else
-                if(bStr->length > 0 && IS_SEP(bStr->chars[0])) resetPath = true;
-            #endif
-
-            if(resetPath || aStr->length == 0){
-                R(GET_ARG_A(instruction)) = OBJECT_VAL(bStr);
-            }else if(bStr->length == 0){
-                R(GET_ARG_A(instruction)) = OBJECT_VAL(aStr);
-            }else{
-                bool hasSepA = (aStr->length > 0 && IS_SEP(aStr->chars[aStr->length - 1]));
-                bool hasSepB = (bStr->length > 0 && IS_SEP(bStr->chars[0]));
-
-                size_t len = aStr->length + bStr->length - hasSepA - hasSepB + 1; 
-                // add 1 for sep; it is the length of valid chars
-                
-                char* chars = (char*)reallocate(vm, NULL, 0, len + 1);  // add 1 for '\0'
-                if(chars == NULL){
-                    runtimeError(vm, "Memory allocation failed for path join.");
-                    return VM_RUNTIME_ERROR;
-                }
-
-                memcpy(chars, aStr->chars, aStr->length);
-
-                if(!hasSepA && !hasSepB){
-                    chars[aStr->length] = PATH_SEP;
-                    memcpy(chars + aStr->length + 1, bStr->chars, bStr->length);
-                }else if(hasSepA && hasSepB){
-                    memcpy(chars + aStr->length, bStr->chars + 1, bStr->length - 1);
-                }else{
-                    memcpy(chars + aStr->length, bStr->chars, bStr->length);
-                }
-
-                chars[len] = '\0';
-
-                R(GET_ARG_A(instruction)) = OBJECT_VAL(takeStringRaw(vm, chars, (int)len));
+        }else if((IS_STRING(b) || IS_ROPE(b)) && (IS_STRING(c) || IS_ROPE(c))){
+            b = flattenSlot(vm, &R(GET_ARG_B(instruction)));
+            c = flattenSlot(vm, &R(GET_ARG_C(instruction)));
+            ObjectString* path = joinPathRaw(vm, AS_STRING(b), AS_STRING(c));
+            if(path == NULL){
+                runtimeError(vm, "Path contains invalid characters.");
+                return VM_RUNTIME_ERROR;
             }
-            #undef PATH_SEP
-            #undef IS_SEP
+            R(GET_ARG_A(instruction)) = OBJECT_VAL(path);
         }else{
             runtimeError(vm, "Operands must be numbers or strings.");
             return VM_RUNTIME_ERROR;
@@ -993,7 +1051,7 @@ static InterpreterStatus run(VM* vm){
     DO_OP_PRINT:
     {
         int a = GET_ARG_A(instruction);
-        valueWrite(R(a), &vm->output);
+        valueWrite(flattenSlot(vm, &R(a)), &vm->output);
         vmWriteCString(vm, "\n");
     } DISPATCH();
 
@@ -1021,6 +1079,35 @@ static InterpreterStatus run(VM* vm){
         }
     } DISPATCH();
 
+    DO_OP_SWITCH:
+    {
+        /*
+         * K[Bx] is either a dense list [base, off0, off1, ...] for integer
+         * cases or a map from case value to offset. Offset 0 means no case,
+         * which lands on the following JMP to default or the end.
+        */
+        Value val = flattenSlot(vm, &R(GET_ARG_A(instruction)));
+        Value table = K(GET_ARG_Bx(instruction));
+        int offset = 0;
+
+        if(IS_LIST(table)){
+            ObjectList* jumps = AS_LIST(table);
+            if(IS_NUM(val)){
+                double index = AS_NUM(val) - AS_NUM(jumps->items[0]);
+                if(index >= 0 && index < jumps->count - 1 && index == (int)index){
+                    offset = (int)AS_NUM(jumps->items[(int)index + 1]);
+                }
+            }
+        }else{
+            Value target;
+            if(tableGet(vm, &AS_MAP(table)->table, val, &target)){
+                offset = (int)AS_NUM(target);
+            }
+        }
+
+        frame->ip += offset;
+    } DISPATCH();
+
     DO_OP_CALL:
     {
         int a = GET_ARG_A(instruction);
@@ -1068,6 +1155,16 @@ static InterpreterStatus run(VM* vm){
 
         R(a) = OBJECT_VAL(result.module);
 
+        // the site always yields this module now, later runs skip the lookup
+        Chunk* chunk = &frame->closure->func->chunk;
+        if(chunk->constants.count <= MAX_ARG_BX){
+            // growing the pool may collect, the module body is not rooted yet
+            push(vm, result.closure != NULL ? OBJECT_VAL(result.closure) : NULL_VAL);
+            int moduleConst = addConstant(vm, chunk, OBJECT_VAL(result.module));
+            pop(vm);
+            frame->ip[-1] = CREATE_ABx(OP_GET_MODULE, a, moduleConst);
+        }
+
         if(result.closure != NULL){
             pushGlobal(vm, &result.module->members);
             vm->stackTop[0] = OBJECT_VAL(result.closure);
@@ -1079,15 +1176,29 @@ static InterpreterStatus run(VM* vm){
                 return VM_RUNTIME_ERROR;
             }
 
+            beginModuleRun(vm, result.statIndex);
             frame = &vm->frames[vm->frameCount - 1];
         }
     } DISPATCH();
 
+    DO_OP_GET_MODULE:
+    {
+        R(GET_ARG_A(instruction)) = K(GET_ARG_Bx(instruction));
+    } DISPATCH();
+
     DO_OP_CLOSURE:
     {
         int a = GET_ARG_A(instruction);
         int bx = GET_ARG_Bx(instruction);
         ObjectFunc* func = AS_FUNC(K(bx));
+
+        // nothing captured, every run can hand out the same closure
+        if(func->upvalueCnt == 0 && func->shared != NULL
+            && func->shared->globals == frame->globals){
+            R(a) = OBJECT_VAL(func->shared);
+            DISPATCH();
+        }
+
         ObjectClosure* closure = newClosure(vm, func, frame->globals);
         if(closure == NULL){
             runtimeError(vm, "Out of memory creating closure");
@@ -1095,14 +1206,26 @@ static InterpreterStatus run(VM* vm){
         }
         R(a) = OBJECT_VAL(closure);
 
+        if(func->upvalueCnt == 0){
+            func->shared = closure;
+        }
+
         for(int i = 0; i < closure->upvalueCnt; i++){
             Instruction nextInstruction = *frame->ip++;
-            int isLocal = GET_ARG_B(nextInstruction);
             int index = GET_ARG_C(nextInstruction);
-            if(isLocal){
-                closure->upvalues[i] = captureUpvalue(vm, &R(index));
-            }else{
-                closure->upvalues[i] = frame->closure->upvalues[index];
+            switch((CaptureKind)GET_ARG_B(nextInstruction)){
+                case CAPTURE_UPVAL:
+                    closure->upvalues[i].ref = frame->closure->upvalues[index].ref;
+                    break;
+                case CAPTURE_LOCAL:
+                    closure->upvalues[i].ref = captureUpvalue(vm, &R(index));
+                    break;
+                case CAPTURE_FLAT_UPVAL:
+                    closure->upvalues[i].value = frame->closure->upvalues[index].value;
+                    break;
+                case CAPTURE_FLAT_LOCAL:
+                    closure->upvalues[i].value = R(index);
+                    break;
             }
         }
     } DISPATCH();
@@ -1157,7 +1280,7 @@ static InterpreterStatus run(VM* vm){
             runtimeError(vm, "Field name must be a string.");
             return VM_RUNTIME_ERROR;
         }
-        tableSet(vm, &klass->fields, nameVal, R(c));
+        tableSet(vm, &klass->fields, nameVal, flattenSlot(vm, &R(c)));
     } DISPATCH();
 
     DO_OP_BUILD_LIST:
@@ -1210,7 +1333,7 @@ static InterpreterStatus run(VM* vm){
             }
 
             for(int k = 0; k < count; k++){
-                list->items[list->count++] = R(startReg + k);
+                list->items[list->count++] = flattenSlot(vm, &R(startReg + k));
             }
         }
     } DISPATCH();
@@ -1218,7 +1341,7 @@ static InterpreterStatus run(VM* vm){
     DO_OP_FILL_LIST:
     {
         int a = GET_ARG_A(instruction);
-        Value item = R(GET_ARG_B(instruction));
+        Value item = flattenSlot(vm, &R(GET_ARG_B(instruction)));
         Value countVal = R(GET_ARG_C(instruction));
 
         if(!IS_NUM(countVal)){
@@ -1250,6 +1373,36 @@ static InterpreterStatus run(VM* vm){
         R(a) = OBJECT_VAL(list);
     } DISPATCH();
 
+    DO_OP_CLONE_K:
+    {
+        /*
+         * K[Bx] is a template the compiler built from a literal. It never
+         * reaches a script, so the copy can take its storage wholesale.
+        */
+        int a = GET_ARG_A(instruction);
+        Value proto = K(GET_ARG_Bx(instruction));
+
+        if(IS_LIST(proto)){
+            ObjectList* from = AS_LIST(proto);
+            ObjectList* list = newList(vm);
+            push(vm, OBJECT_VAL(list));
+
+            list->items = (Value*)reallocate(vm, NULL, 0, sizeof(Value) * from->count);
+            memcpy(list->items, from->items, sizeof(Value) * from->count);
+            list->capacity = from->count;
+            list->count = from->count;
+
+            pop(vm);
+            R(a) = OBJECT_VAL(list);
+        }else{
+            ObjectMap* map = newMap(vm);
+            push(vm, OBJECT_VAL(map));
+            tableCopy(vm, &AS_MAP(proto)->table, &map->table);
+            pop(vm);
+            R(a) = OBJECT_VAL(map);
+        }
+    } DISPATCH();
+
     // R(A) = slice(R(B), start=R(C), end=R(C+1), step=R(C+2))
     // obj[start:end:step]
     DO_OP_SLICE: {
@@ -1257,7 +1410,7 @@ static InterpreterStatus run(VM* vm){
         int b = GET_ARG_B(instruction);
         int c = GET_ARG_C(instruction);
 
-        Value receiver = R(b);
+        Value receiver = flattenSlot(vm, &R(b));
         Value startVal = R(c);
         Value endVal   = R(c + 1);
         Value stepVal  = R(c + 2);
@@ -1359,6 +1512,8 @@ static InterpreterStatus run(VM* vm){
             ObjectString* str = AS_STRING(receiver);
             if(count <= 0){
                 R(a) = OBJECT_VAL(copyString(vm, "", 0));
+            }else if(step == 1){
+                R(a) = OBJECT_VAL(newStringView(vm, str, start, count));
             }else{
                 char* chars = (char*)reallocate(vm, NULL, 0, count + 1);
                 int destIdx = 0;
@@ -1403,7 +1558,7 @@ static InterpreterStatus run(VM* vm){
         int a = GET_ARG_A(instruction);
         int sBx = GET_ARG_sBx(instruction);
 
-        Value iter = R(a);
+        Value iter = flattenSlot(vm, &R(a));
         Value state = R(a + 1);
 
         bool hasNext = false;
@@ -1435,8 +1590,7 @@ static InterpreterStatus run(VM* vm){
             ObjectString* str = AS_STRING(iter);
             int index = IS_NUM(state) ? (int)AS_NUM(state) : 0;
             if(index < str->length){
-                char chars[2] = {str->chars[index], '\0'};
-                R(a + 2) = OBJECT_VAL(copyStringRaw(vm, chars, 1));
+                R(a + 2) = OBJECT_VAL(vm->charStrings[(uint8_t)str->chars[index]]);
                 R(a + 1) = NUM_VAL(index + 1);
                 hasNext = true;
             }
@@ -1461,13 +1615,13 @@ static InterpreterStatus run(VM* vm){
         int a = GET_ARG_A(instruction);
         int b = GET_ARG_B(instruction);
         
-        Value cmd = R(b);
+        Value cmd = flattenSlot(vm, &R(b));
         if(!IS_STRING(cmd)){
             runtimeError(vm, "System command expected to be a string.");
             return VM_RUNTIME_ERROR;
         }
         
-        int rawStatus = system(AS_STRING(cmd)->chars);
+        int rawStatus = system(AS_CSTRING(cmd));
         int status = normalizeSystemStatus(rawStatus);
         Value statusVal = NUM_VAL((double)status);
         R(a) = statusVal;
@@ -1515,6 +1669,9 @@ static InterpreterStatus run(VM* vm){
 
         if(frame->closure->func->type == TYPE_MODULE){
             popGlobal(vm);
+            if(vm->importStats.enabled){
+                endModuleRun(vm);
+            }
         }
 
         vm->frameCount--;
@@ -1537,6 +1694,11 @@ static InterpreterStatus run(VM* vm){
 }
 
 static bool call(VM* vm, ObjectClosure* closure, int argCnt){
+    if(closure->func->lazySrc != NULL && !compileLazyFunc(vm, closure->func, closure->globals)){
+        runtimeError(vm, "Could not compile function '%s'.", closure->func->name->chars);
+        return false;
+    }
+
     if(argCnt != closure->func->arity){
         runtimeError(vm, "Expected %d args but got %d.", closure->func->arity, argCnt);
         return false;
@@ -1569,6 +1731,12 @@ static bool call(VM* vm, ObjectClosure* closure, int argCnt){
     return true;
 }
 
+static void flattenArgs(VM* vm, int argCnt){
+    for(Value* arg = vm->stackTop - argCnt; arg < vm->stackTop; arg++){
+        flattenSlot(vm, arg);
+    }
+}
+
 static bool callValue(VM* vm, Value callee, int argCnt){
     if(IS_OBJECT(callee)){
         switch(OBJECT_TYPE(callee)){
@@ -1591,8 +1759,11 @@ static bool callValue(VM* vm, Value callee, int argCnt){
                 vm->stackTop[-argCnt -1] = bound->receiver;
                 Object* method = bound->method;
                 if(method->type == OBJECT_CFUNC){
+                    flattenArgs(vm, argCnt);
                     CFunc cfunc = AS_CFUNC(OBJECT_VAL(method));
+                    vm->nativeDepth++;
                     Value result = cfunc(vm, argCnt, vm->stackTop - argCnt);
+                    vm->nativeDepth--;
 
                     if(vm->hadRuntimeError){
                         return false;
@@ -1608,8 +1779,11 @@ static bool callValue(VM* vm, Value callee, int argCnt){
             case OBJECT_CLOSURE:
                 return call(vm, AS_CLOSURE(callee), argCnt);
             case OBJECT_CFUNC:{
+                flattenArgs(vm, argCnt);
                 CFunc cfunc = AS_CFUNC(callee);
+                vm->nativeDepth++;
                 Value result = cfunc(vm, argCnt, vm->stackTop - argCnt);
+                vm->nativeDepth--;
 
                 if(vm->hadRuntimeError){  
                     return false;
@@ -1679,6 +1853,7 @@ InterpreterStatus vmCallValue(
         return VM_RUNTIME_ERROR;
     }
 
+    flattenSlot(vm, vm->stackTop - 1);
     Value returnValue = pop(vm);
     vm->stackTop = stackBase;  
     // restore stack top to the base before the call
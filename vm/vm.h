@@ -20,6 +20,7 @@ typedef struct GCPolicy GCPolicy;
 #define GLOBAL_STATCK_MAX 64
 #define MAX_DEFERS 255
 #define VM_ERROR_MESSAGE_MAX 512
+#define INT_STRING_CACHE 1024
 
 typedef void(*VMWriteFunc)(const char* text, size_t length, void* userData);
 
@@ -43,8 +44,38 @@ typedef struct GCStats{
     double markMs;
     double internMs;
     double sweepMs;
+
+    // string dedup, the last pass only except dedupMs
+    size_t dedupStrings;        // live strings equal to an earlier one
+    size_t dedupBytes;          // heap they take
+    size_t dedupRefs;           // references redirected to the kept copy
+    double dedupMs;
 }GCStats;
 
+/*
+ * Where the time went for one script module, recorded when
+ * vm->importStats.enabled is set. origin is "source", "cache" or
+ * "prefetch", depending on where its code came from.
+*/
+typedef struct ImportStat{
+    char* path;
+    const char* origin;
+    double resolveMs;
+    double readMs;
+    double compileMs;
+    double executeMs;
+    double runStart;
+}ImportStat;
+
+typedef struct ImportStats{
+    bool enabled;
+    ImportStat* entries;
+    int count;
+    int capacity;
+    int* running;   // entries of the module bodies executing, innermost last
+    int runningCnt;
+}ImportStats;
+
 typedef struct VM{
     Value stack[STACK_MAX];  // Stack for values
     Value* stackTop;         // for alloc new CallFrame
@@ -64,6 +95,14 @@ typedef struct VM{
     HashTable modCache;
     Object* objects;
     ObjectString* initString;
+
+    /*
+     * Every one-byte string, made by initVM(), and the decimal strings of
+     * 0 .. INT_STRING_CACHE - 1, made on first use. Both are roots.
+    */
+    ObjectString* charStrings[256];
+    ObjectString* intStrings[INT_STRING_CACHE];
+
     ObjectUpvalue* openUpvalues;    // descending locations
     CallFrame frames[FRAMES_MAX];
     int frameCount;
@@ -73,9 +112,17 @@ typedef struct VM{
     size_t gcThreshold;
 
     GCMode gcMode;
+    GCDedup gcDedup;
     const GCPolicy* gcPolicy;
     bool gcRunning;
+
+    /*
+     * Native functions running on the C stack. They may hold strings in
+     * C locals, so dedup only redirects references when this is 0.
+    */
+    int nativeDepth;
     GCStats gcStats;
+    ImportStats importStats;
 
     Compiler* compiler;
     uint64_t hash_seed;
@@ -85,6 +132,40 @@ typedef struct VM{
 
     bool hadRuntimeError;
 
+    /*
+     * Top-level function bodies are compiled on their first call.
+     * Set this to compile everything up front, e.g. to surface syntax errors.
+    */
+    bool eagerCompile;
+
+    /*
+     * Compile errors are not printed, the compile just fails.
+     * Set on VMs that compile imports in the background.
+    */
+    bool quietCompile;
+
+    /*
+     * Whether runScript() compiles the script's imports on worker threads.
+     * The CLI turns it off with --no-prefetch.
+    */
+    bool importPrefetch;
+
+    /*
+     * Imports compiled ahead of time on worker threads, NULL if none.
+    */
+    struct ImportPrefetch* prefetch;
+
+    /*
+     * Precompiled modules of the running bundle, NULL if none.
+    */
+    struct Bundle* bundle;
+
+    /*
+     * Directory for compiled images of imported modules, NULL disables it.
+     * The CLI sets it up, embedders opt in through setCacheDir().
+    */
+    char* cacheDir;
+
     /*
      * Whether script code may terminate the host process through os.exit().
      * The CLI enables this to preserve its existing behavior.
@@ -109,6 +190,7 @@ typedef enum{
 }InterpreterStatus;
 
 void initVM(VM* vm, int argc, const char* argv[]);
+void initBareVM(VM* vm, int argc, const char* argv[]);  // no prelude, a snapshot brings its own
 void freeVM(VM* vm);
 void resetStack(VM* vm);
 void recover(VM* vm);
@@ -120,6 +202,7 @@ static bool isTruthy(Value value);
 static bool checkAccess(VM* vm, ObjectClass* instanceKlass, ObjectString* fieldName);
 
 InterpreterStatus interpret(VM* vm, const char* code, const char* srcName);
+InterpreterStatus interpretFunc(VM* vm, ObjectFunc* func);
 InterpreterStatus vmCallValue(VM* vm, Value callee, int argCount, const Value* args, Value* result);
 static InterpreterStatus run(VM* vm);
 